@@ -9,15 +9,48 @@
   - Multi-question assessment, add tips/procedures, run optimizer
 
  Save format (emotion_data.txt):
+   CLASS <class> <emotion> [<emotion> ...]      (emotion classes for transition rules)
+   RULE <from_class> <to_class>                 (no direct step from one class into the other)
+   GOALSET <set> <emotion> [<emotion> ...]      (positive states plans aim for)
+   GOALS <set>                                  (the goal set in use)
+   ALIAS "<surface form>" <emotion>             (another name for an emotion, any case)
+   KEYWORD "<phrase>" <emotion> [<weight>]      (words that hint at an emotion in free text)
    NODE <name> <valence> <baseline>
-   TIP  <emotion_name> "<tip text>"
+   TIP  <emotion_name> "<tip text>" [<tried> <helped> <day>]   (feedback and day of last success; optional on load)
    EDGE <from> <to> <weight> "<procedure>"
 
+ Check-ins are appended to <datafile>.checkins (binary, columnar; see "Check-in log").
+
  Compile:
-   gcc -std=c99 -Wall -O2 emotion_final_cleaned.c -o emo_tool
+   gcc -std=c99 -Wall -O2 code.c -o emo_tool -pthread -lm
 
  Run:
    ./emo_tool
+
+ Timeline of a session (Chrome trace-event JSON, any mode):
+   ./emo_tool --trace trace.json [batch|bench ...]
+
+ Scripted use (one command per line on stdin: plan, checkin, stats, save, quit):
+   ./emo_tool batch < commands.txt
+
+ Routing benchmark on synthetic maps (does not touch the data file):
+   ./emo_tool bench --sizes 10,100,1000,10000 --degree uniform|powerlaw|local
+   ./emo_tool bench-io --sizes 1000,5000,20000      (load/save/reload/free throughput)
+   ./emo_tool bench-log --rows 20000000             (check-in history: daily averages)
+
+ Differential check of every routing engine against the reference:
+   ./emo_tool selftest --graphs 500 --max-nodes 80
+
+ Parallel single-source costs for offline analysis (delta-stepping):
+   ./emo_tool sssp --data big_data.txt --from overwhelmed --threads 16 --out costs.tsv
+   ./emo_tool bench-sssp --nodes 1000000 --threads 1,8,16,32,64
+
+ All-pairs cost table for maps of a few thousand states (saved as <datafile>.apsp and
+ picked up by planning while the map is unchanged):
+   ./emo_tool apsp --data emotion_data.txt --csv heatmap.csv
+
+ Large synthetic data files for scale tests:
+   ./emo_tool gen big_data.txt --nodes 1000000 --tips-per-node 4 --tip-len 400
 */
 
 #define _POSIX_C_SOURCE 200809L
@@ -26,637 +59,6011 @@
 #include <string.h>
 #include <float.h>
 #include <ctype.h>
+#include <math.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #define MAX_NAME_LEN 48
 #define INIT_CAP 4
 #define MAX_LINE 1024
 #define SAVE_FILE "emotion_data.txt"
+#define TIP_TOP_K 3                // tips shown per plan step
 
-typedef struct { char *text; } Tip;
+typedef struct {
+    char *text;
+    int doc;                       // search index entry, -1 until indexed
+    uint64_t sim;                  // SimHash fingerprint, for near-duplicate checks
+    int tried, helped;             // user feedback
+    int day;                       // days since 1970 of the tip's last success (or its arrival)
+    float rank;                    // tip_rank(), cached
+} Tip;
 
 typedef struct Edge {
     int to;
     float weight;
     char *procedure;
+    unsigned char reverse;         // 1 = mirror arc added automatically, not saved
+    int doc;                       // search index entry of the procedure, -1 if none
 } Edge;
 
 typedef struct {
     char name[MAX_NAME_LEN];
     float valence;                 // internal only
     float baseline_intensity;      // internal only
+    uint64_t classes;              // rule classes this emotion belongs to
+    uint64_t forbid;               // classes it may not step into directly
+    uint64_t goal_sets;            // goal sets this emotion belongs to
     Edge *edges;
     int edges_count;
     int edges_cap;
     Tip *tips;
     int tips_count;
     int tips_cap;
+    int tip_top[TIP_TOP_K];        // best tips by rank, best first
+    int tip_top_count;
 } EmotionNode;
 
+/* Transition rules: up to RULE_MAX_CLASSES named classes of emotions, and for each
+   class the set of classes its members may not step into directly. */
+#define RULE_MAX_CLASSES 64
+
+typedef struct {
+    char name[MAX_NAME_LEN];
+    char **members;                // emotion names (members need not exist yet)
+    int members_count, members_cap;
+    uint64_t forbid_to;
+} RuleClass;
+
+typedef struct { const char *name; uint64_t classes; } RuleMember;   /* name: a class's member string */
+
+typedef struct {
+    RuleClass classes[RULE_MAX_CLASSES];
+    int count;
+    RuleMember *by_name;           // name -> class mask, open addressing (NULL name = empty)
+    int by_name_count, by_name_cap;
+} RuleTable;
+
+/* Goal sets: named lists of positive states; one is active and plans aim for it. */
+#define GOALSET_MAX 64
+
+typedef struct {
+    char name[MAX_NAME_LEN];
+    char **members;                // emotion names (members need not exist yet)
+    int members_count, members_cap;
+    int *nodes;                    // members that exist, as node indices
+    int nodes_count, nodes_cap;
+} GoalSet;
+
+typedef struct {
+    GoalSet sets[GOALSET_MAX];
+    int count;
+    int active;
+} GoalTable;
+
+/* Aliases: other surface forms of an emotion ("anxiety", "Stressed out"). They only
+   change how names are resolved and add no nodes or edges. */
+typedef struct { char *surface, *canonical; } Alias;
+
+typedef struct {
+    Alias *items;
+    int count, cap;
+} AliasTable;
+
+/* Keywords: phrases that suggest an emotion when a user describes how they feel. */
+typedef struct { char *phrase, *emotion; float weight; } Keyword;
+
+typedef struct {
+    Keyword *items;
+    int count, cap;
+} KeywordTable;
+
+struct NameIndex;
+struct NameHash;
+struct Lexicon;
+struct TextIndex;
+
 typedef struct {
     EmotionNode *nodes;
     int count;
     int cap;
+    long arcs;                     // total arcs over all nodes (engine selection)
+    unsigned long version;         // changes on every edit that can affect routing
+    RuleTable rules;
+    GoalTable goals;
+    AliasTable aliases;
+    KeywordTable keywords;
+    struct NameHash *name_hash;    // perfect hash over names and aliases, built on first lookup
+    int loading;                   // load_graph running: new names wait in the overflow table
+    struct Lexicon *lexicon;       // free-text matcher over names, aliases and keywords
+    struct TextIndex *text_index;  // word index over tips and procedures, built on first search
+    struct NameIndex *name_index;  // trigram index for name suggestions, built on first use
 } EmotionGraph;
 
+/* ---------- Hot-path counters ----------
+   Plain increments on one global struct: cheap enough to stay on in normal builds.
+   Compile with -DEMO_NO_STATS to remove them entirely (the allocation count stays).
+*/
+
+typedef struct {
+    unsigned long long queries;         /* routing searches started */
+    unsigned long long nodes_settled;
+    unsigned long long edges_relaxed;   /* arcs examined from settled nodes */
+    unsigned long long heap_ops;        /* priority-queue pushes/pops (queue-based engines) */
+    unsigned long long find_calls;      /* graph_find lookups */
+    unsigned long long find_probes;     /* names compared by graph_find */
+    unsigned long long allocs;          /* calls into the allocation helpers */
+    unsigned long long bytes_saved;
+    unsigned long long bytes_loaded;
+} EmoStats;
+
+static EmoStats emo_stats;
+
+#ifdef EMO_NO_STATS
+#define STAT_ADD(field, n) ((void)0)
+#else
+#define STAT_ADD(field, n) (emo_stats.field += (unsigned long long)(n))
+#endif
+#define STAT_INC(field) STAT_ADD(field, 1)
+/* Allocation calls are counted in every build (bench-io reports them), atomically
+   because routing workers allocate from several threads. */
+#define ALLOC_COUNT() ((void)__atomic_add_fetch(&emo_stats.allocs, 1, __ATOMIC_RELAXED))
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* ---------- Latency histograms ----------
+   HDR-style log-linear buckets: 16 sub-buckets per power of two of nanoseconds, so any
+   recorded value is reported within ~6% and a histogram is a fixed 8 KB array.
+*/
+
+#define HIST_SUB_BITS 4
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (64 * HIST_SUB)
+
+typedef struct {
+    unsigned long long counts[HIST_BUCKETS];
+    unsigned long long total;
+    uint64_t max_ns;
+} LatencyHist;
+
+enum { OP_CLASSIFY, OP_ROUTE, OP_RENDER, OP_LOAD, OP_SAVE, OP_COUNT };
+
+static int msb_index(uint64_t v) {
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(v);
+#else
+    int m = 0; while (v >>= 1) ++m; return m;
+#endif
+}
+
+#ifndef EMO_NO_STATS
+static const char *op_names[OP_COUNT] = {"classify", "route", "render", "load", "save"};
+static LatencyHist op_hist[OP_COUNT];
+
+static int hist_index(uint64_t v) {
+    if (v < HIST_SUB) return (int)v;
+    int shift = msb_index(v) - HIST_SUB_BITS;
+    return (shift + 1) * HIST_SUB + (int)((v >> shift) & (HIST_SUB - 1));
+}
+
+/* Highest value that falls into bucket idx. */
+static uint64_t hist_bucket_high(int idx) {
+    if (idx < HIST_SUB) return (uint64_t)idx;
+    int shift = idx / HIST_SUB - 1;
+    uint64_t low = (uint64_t)(HIST_SUB + idx % HIST_SUB) << shift;
+    return low + ((uint64_t)1 << shift) - 1;
+}
+
+static void hist_record(LatencyHist *h, uint64_t ns) {
+    h->counts[hist_index(ns)]++;
+    h->total++;
+    if (ns > h->max_ns) h->max_ns = ns;
+}
+
+/* Value at quantile q (0..1), reported as the bucket's upper bound clipped to the max. */
+static uint64_t hist_quantile(const LatencyHist *h, double q) {
+    if (h->total == 0) return 0;
+    unsigned long long rank = (unsigned long long)(q * (double)h->total);
+    if (rank >= h->total) rank = h->total - 1;
+    unsigned long long seen = 0;
+    for (int i=0;i<HIST_BUCKETS;++i) {
+        seen += h->counts[i];
+        if (seen > rank) { uint64_t v = hist_bucket_high(i); return v < h->max_ns ? v : h->max_ns; }
+    }
+    return h->max_ns;
+}
+
+#endif
+
+/* LAT_BEGIN starts an operation's clock; with EMO_NO_STATS it only takes the time when a
+   trace is being written, so a span may end on the same variable with TRACE_END. */
+#ifdef EMO_NO_STATS
+#define LAT_BEGIN(var) TRACE_BEGIN(var)
+#define LAT_RECORD(op, t0) ((void)(t0))
+#else
+#define LAT_BEGIN(var) uint64_t var = now_ns()
+#define LAT_RECORD(op, t0) hist_record(&op_hist[op], now_ns() - (t0))
+#endif
+
+/* ---------- Trace spans (Chrome trace-event export) ----------
+   Started with "emo_tool --trace FILE ...". Spans go into a fixed ring buffer (the
+   newest TRACE_CAP survive) and are written at exit as trace-event JSON, which
+   chrome://tracing or Perfetto open as a timeline. When tracing is off a span costs
+   one predictable branch; -DEMO_NO_TRACE removes them completely.
+*/
+
+#define TRACE_CAP 65536
+
+typedef struct { const char *name; uint64_t start_ns, end_ns; } TraceEvent;
+
+static struct {
+    int on;
+    const char *path;
+    uint64_t origin_ns;
+    TraceEvent *events;
+    unsigned long long written;     /* total spans recorded; ring index is written % TRACE_CAP */
+} trace_state;
+
+#ifdef EMO_NO_TRACE
+#define TRACE_BEGIN(var) uint64_t var = 0
+#define TRACE_END(name, var) ((void)(var))
+#else
+static void trace_add(const char *name, uint64_t start_ns) {
+    TraceEvent *ev = &trace_state.events[trace_state.written++ % TRACE_CAP];
+    ev->name = name; ev->start_ns = start_ns; ev->end_ns = now_ns();
+}
+
+#define TRACE_BEGIN(var) uint64_t var = trace_state.on ? now_ns() : 0
+#define TRACE_END(name, var) do { if (trace_state.on) trace_add((name), (var)); } while (0)
+#endif
+
+static void trace_flush(void) {
+    if (!trace_state.on) return;
+    FILE *f = fopen(trace_state.path, "w");
+    if (!f) { perror("fopen"); return; }
+    unsigned long long n = trace_state.written < TRACE_CAP ? trace_state.written : TRACE_CAP;
+    unsigned long long first = trace_state.written - n;
+    fprintf(f, "{\"traceEvents\":[\n");
+    for (unsigned long long i=0;i<n;++i) {
+        const TraceEvent *ev = &trace_state.events[(first + i) % TRACE_CAP];
+        fprintf(f, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}%s\n",
+                ev->name, (ev->start_ns - trace_state.origin_ns) / 1e3, (ev->end_ns - ev->start_ns) / 1e3,
+                (i + 1 < n) ? "," : "");
+    }
+    fprintf(f, "],\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped_spans\":%llu}}\n", first);
+    fclose(f);
+    trace_state.on = 0;
+}
+
+static void trace_start(const char *path) {
+    trace_state.events = malloc(sizeof(TraceEvent) * TRACE_CAP);
+    if (!trace_state.events) { perror("malloc"); exit(1); }
+    trace_state.path = path;
+    trace_state.origin_ns = now_ns();
+    trace_state.written = 0;
+    trace_state.on = 1;
+    atexit(trace_flush);
+}
+
+/* ---------- Memory accounting ----------
+   Current and peak bytes per subsystem, fed by the allocation helpers below.
+   Compiled out together with the counters under EMO_NO_STATS.
+*/
+
+typedef enum { MEM_NAMES, MEM_NODES, MEM_TIPS, MEM_PROCEDURES, MEM_EDGES, MEM_ROUTING, MEM_OTHER, MEM_CAT_COUNT } MemCat;
+
+#ifndef EMO_NO_STATS
+static const char *mem_cat_names[MEM_CAT_COUNT] = {"names", "node records", "tips", "procedures", "edge arrays", "routing buffers", "other"};
+
+typedef struct { long long current, peak; } MemUsage;
+static MemUsage mem_usage[MEM_CAT_COUNT], mem_total;
+
+/* Atomic because routing workers allocate from several threads. */
+static void mem_raise_peak(long long *peak, long long cur) {
+    long long p = __atomic_load_n(peak, __ATOMIC_RELAXED);
+    while (cur > p && !__atomic_compare_exchange_n(peak, &p, cur, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+#endif
+
+static void mem_account(MemCat cat, long long delta) {
+#ifdef EMO_NO_STATS
+    (void)cat; (void)delta;
+#else
+    mem_raise_peak(&mem_usage[cat].peak, __atomic_add_fetch(&mem_usage[cat].current, delta, __ATOMIC_RELAXED));
+    mem_raise_peak(&mem_total.peak, __atomic_add_fetch(&mem_total.current, delta, __ATOMIC_RELAXED));
+#endif
+}
+
 /* ---------- Utility helpers ---------- */
 
-static char *strdup_s(const char *s) {
+/* Each allocation is charged to a category; callers pass the sizes they already track
+   (capacities, string lengths) so no per-block header is needed. */
+static char *strdup_s(const char *s, MemCat cat) {
     if (!s) return NULL;
+    ALLOC_COUNT();
     size_t n = strlen(s) + 1;
     char *d = malloc(n);
     if (!d) { perror("malloc"); exit(1); }
     memcpy(d, s, n);
+    mem_account(cat, (long long)n);
     return d;
 }
-static void *realloc_or_die(void *p, size_t nmemb, size_t size) {
+static void free_str(char *s, MemCat cat) {
+    if (!s) return;
+    mem_account(cat, -(long long)(strlen(s) + 1));
+    free(s);
+}
+static void *realloc_or_die(void *p, size_t old_nmemb, size_t nmemb, size_t size, MemCat cat) {
+    ALLOC_COUNT();
     void *q = realloc(p, nmemb * size);
     if (!q && nmemb > 0) { perror("realloc"); exit(1); }
+    mem_account(cat, ((long long)nmemb - (long long)old_nmemb) * (long long)size);
     return q;
 }
+static void free_array(void *p, size_t nmemb, size_t size, MemCat cat) {
+    if (!p) return;
+    mem_account(cat, -(long long)(nmemb * size));
+    free(p);
+}
+/* Node records embed their names, so the name bytes are charged to MEM_NAMES. */
+static void account_node_array(long long delta_nodes) {
+    mem_account(MEM_NODES, -delta_nodes * MAX_NAME_LEN);
+    mem_account(MEM_NAMES, delta_nodes * MAX_NAME_LEN);
+}
 static void ensure_graph_capacity(EmotionGraph *g) {
     if (g->count >= g->cap) {
         int newcap = (g->cap == 0) ? 8 : g->cap * 2;
-        g->nodes = realloc_or_die(g->nodes, newcap, sizeof(EmotionNode));
+        account_node_array(newcap - g->cap);
+        g->nodes = realloc_or_die(g->nodes, g->cap, newcap, sizeof(EmotionNode), MEM_NODES);
         g->cap = newcap;
     }
 }
 static void ensure_edge_capacity(EmotionNode *n) {
     if (n->edges_count >= n->edges_cap) {
         int newcap = (n->edges_cap == 0) ? INIT_CAP : n->edges_cap * 2;
-        n->edges = realloc_or_die(n->edges, newcap, sizeof(Edge));
+        n->edges = realloc_or_die(n->edges, n->edges_cap, newcap, sizeof(Edge), MEM_EDGES);
         n->edges_cap = newcap;
     }
 }
 static void ensure_tip_capacity(EmotionNode *n) {
     if (n->tips_count >= n->tips_cap) {
         int newcap = (n->tips_cap == 0) ? INIT_CAP : n->tips_cap * 2;
-        n->tips = realloc_or_die(n->tips, newcap, sizeof(Tip));
+        n->tips = realloc_or_die(n->tips, n->tips_cap, newcap, sizeof(Tip), MEM_TIPS);
         n->tips_cap = newcap;
     }
 }
 
-/* ---------- Graph ops ---------- */
+/* ---------- Name lookup (minimal perfect hash) ----------
+   Every name and alias is a key under its case-folded FNV hash, compiled into a
+   minimal perfect hash by hash-and-displace: keys fall into buckets of about four, and
+   largest bucket first, each bucket takes the first seed that sends all its keys to
+   free slots. A lookup reads one seed and one slot and compares one string.
+   The table keeps one free slot per NAME_HASH_SLACK keys: with every slot needed, the
+   last buckets try seeds until they hit the few free slots, which made a 1M-name
+   build take seconds. The table is static. Nodes appended after a build, and names
+   that differ from an earlier one only in case, go to a small open-addressing overflow
+   table; once as many nodes have been appended as the build covered, the next lookup
+   rebuilds, so appends stay amortised O(1). While a file is loading, appended names
+   stay in the (growing) overflow table and the table is built once at the end.
+   Adding an alias drops the table.
+*/
 
-EmotionGraph *graph_new() {
-    EmotionGraph *g = malloc(sizeof(EmotionGraph));
-    if (!g) { perror("malloc"); exit(1); }
-    g->nodes = NULL; g->count = 0; g->cap = 0;
-    return g;
-}
+#define NAME_HASH_BUCKET_LOAD 4
+#define NAME_HASH_MIN_OVERFLOW 64
+#define NAME_HASH_SLACK 100
 
-int graph_find(EmotionGraph *g, const char *name) {
-    for (int i = 0; i < g->count; ++i) if (strcmp(g->nodes[i].name, name) == 0) return i;
-    return -1;
-}
+typedef struct { uint64_t hash; int node; int alias; } NameKey;   /* alias < 0: the node's own name */
+typedef struct { uint64_t hash; int node; } NameOverflow;
 
-int graph_add_node(EmotionGraph *g, const char *name, float valence, float baseline) {
-    int idx = graph_find(g, name);
-    if (idx != -1) return idx;
-    ensure_graph_capacity(g);
-    EmotionNode *n = &g->nodes[g->count];
-    strncpy(n->name, name, MAX_NAME_LEN-1);
-    n->name[MAX_NAME_LEN-1] = '\0';
-    n->valence = valence;
-    n->baseline_intensity = baseline;
-    n->edges = NULL; n->edges_count = 0; n->edges_cap = 0;
-    n->tips = NULL; n->tips_count = 0; n->tips_cap = 0;
-    return g->count++;
+struct NameHash {
+    NameKey *keys; int nkeys, nslots;  /* keys[slot]; empty slots have node and alias -1 */
+    uint32_t *seeds; int nbuckets;
+    int nodes;                         /* nodes [0, nodes) are in keys[] or overflow[] */
+    int appended;                      /* nodes put in overflow[] since the build */
+    NameOverflow *overflow; int overflow_cap, overflow_count;   /* node < 0: empty; power of two */
+};
+
+static uint64_t name_fold_hash(const char *s) {
+    uint64_t h = 1469598103934665603ULL;
+    for (; *s; ++s) { h ^= (uint64_t)tolower((unsigned char)*s); h *= 1099511628211ULL; }
+    return h;
 }
 
-/* Forbidden direct transitions: emotions that should NOT connect directly to positive goals.
-   Example: "overwhelmed" should not connect directly to "happy"/"calm"/"hopeful"/"peaceful".
-   graph_add_edge respects this check when 'filter_direct_positive' is 1.
-*/
-int is_positive_goal_name(const char *name) {
-    const char *goals[] = {"happy","calm","hopeful","peaceful"};
-    for (int i=0;i<4;++i) if (strcmp(name, goals[i])==0) return 1;
-    return 0;
+static int name_fold_eq(const char *a, const char *b) {
+    for (; *a && *b; ++a, ++b) if (tolower((unsigned char)*a) != tolower((unsigned char)*b)) return 0;
+    return *a == *b;
 }
 
-void graph_add_edge(EmotionGraph *g, const char *from, const char *to, float weight, const char *procedure) {
-    // Enforce forbidden direct connections for "overwhelmed"
-    if (strcmp(from, "overwhelmed") == 0 && is_positive_goal_name(to)) {
-        // refuse direct edge - do not add
-        // The system prefers routing overwhelmed -> grounded -> calm/happy
-        return;
-    }
+static uint32_t name_hash_bucket(uint64_t h, int nbuckets) { return (uint32_t)((h >> 32) % (uint64_t)nbuckets); }
 
-    int u = graph_find(g, from);
-    if (u == -1) u = graph_add_node(g, from, -0.5f, 5.0f);
-    int v = graph_find(g, to);
-    if (v == -1) v = graph_add_node(g, to, 0.0f, 5.0f);
+static uint32_t name_hash_slot(uint64_t h, uint32_t seed, int m) {
+    uint64_t x = h ^ ((uint64_t)seed * 0x9E3779B97F4A7C15ULL);
+    x ^= x >> 31; x *= 0xBF58476D1CE4E5B9ULL; x ^= x >> 29;
+    return (uint32_t)(x % (uint64_t)m);
+}
 
-    EmotionNode *nu = &g->nodes[u];
-    ensure_edge_capacity(nu);
-    Edge *e = &nu->edges[nu->edges_count++];
-    e->to = v;
-    e->weight = (weight < 0.0f) ? 0.0f : weight;
-    e->procedure = procedure ? strdup_s(procedure) : NULL;
+static const char *name_key_text(const EmotionGraph *g, const NameKey *k) {
+    return k->alias < 0 ? g->nodes[k->node].name : g->aliases.items[k->alias].surface;
+}
 
-    // Add reverse edge for undirected feel (reverse procedure not set)
-    EmotionNode *nv = &g->nodes[v];
-    ensure_edge_capacity(nv);
-    Edge *er = &nv->edges[nv->edges_count++];
-    er->to = u;
-    er->weight = (weight < 0.0f) ? 0.0f : weight;
-    er->procedure = NULL;
+static void name_overflow_put(struct NameHash *h, uint64_t hv, int node) {
+    uint32_t mask = (uint32_t)h->overflow_cap - 1, i = (uint32_t)hv & mask;
+    while (h->overflow[i].node >= 0) i = (i + 1) & mask;
+    h->overflow[i] = (NameOverflow){ hv, node };
+    h->overflow_count++;
 }
 
-void graph_add_tip(EmotionGraph *g, const char *emotion, const char *tip_text) {
-    int idx = graph_find(g, emotion);
-    if (idx == -1) idx = graph_add_node(g, emotion, -0.2f, 5.0f);
-    EmotionNode *n = &g->nodes[idx];
-    ensure_tip_capacity(n);
-    n->tips[n->tips_count++].text = strdup_s(tip_text);
+/* Doubles the overflow table; only loads append past the room a build leaves. */
+static void name_overflow_grow(struct NameHash *h) {
+    NameOverflow *old = h->overflow; int old_cap = h->overflow_cap;
+    h->overflow_cap = old_cap * 2;
+    h->overflow = realloc_or_die(NULL, 0, (size_t)h->overflow_cap, sizeof(NameOverflow), MEM_OTHER);
+    for (int i=0;i<h->overflow_cap;++i) h->overflow[i].node = -1;
+    h->overflow_count = 0;
+    for (int i=0;i<old_cap;++i) if (old[i].node >= 0) name_overflow_put(h, old[i].hash, old[i].node);
+    free_array(old, (size_t)old_cap, sizeof(NameOverflow), MEM_OTHER);
 }
 
-/* ---------- Friendly printing (no internals) ---------- */
+static void name_hash_free(EmotionGraph *g) {
+    struct NameHash *h = g->name_hash;
+    if (!h) return;
+    free_array(h->keys, (size_t)h->nslots + 1, sizeof(NameKey), MEM_OTHER);
+    free_array(h->seeds, (size_t)h->nbuckets, sizeof(uint32_t), MEM_OTHER);
+    free_array(h->overflow, (size_t)h->overflow_cap, sizeof(NameOverflow), MEM_OTHER);
+    free_array(h, 1, sizeof(*h), MEM_OTHER);
+    g->name_hash = NULL;
+}
 
-void graph_print_friendly(EmotionGraph *g) {
-    printf("Current emotional map (%d emotions):\n", g->count);
-    for (int i=0;i<g->count;++i) {
-        EmotionNode *n = &g->nodes[i];
-        printf(" - %s", n->name);
-        if (n->tips_count > 0) printf("  (tips: %d)", n->tips_count);
-        printf("\n");
-        for (int e=0;e<n->edges_count;++e) {
-            printf("     -> %s", g->nodes[n->edges[e].to].name);
-            if (n->edges[e].procedure) printf("  (action)");
-            printf("\n");
-        }
-    }
+static int name_hash_probe(const EmotionGraph *g, const struct NameHash *h, const char *name, uint64_t hv, int exact, int *probes);
+
+static int name_bucket_cmp_size(const void *a, const void *b) {
+    const int *x = a, *y = b;   /* {bucket, size} pairs, largest first */
+    return y[1] - x[1];
 }
 
-/* ---------- ASCII graph visualization ---------- */
+static void name_hash_build(EmotionGraph *g) {
+    name_hash_free(g);
+    TRACE_BEGIN(t0);
+    struct NameHash *h = realloc_or_die(NULL, 0, 1, sizeof(*h), MEM_OTHER);
+    memset(h, 0, sizeof(*h));
+    int total = g->count + g->aliases.count;
+    NameKey *cand = realloc_or_die(NULL, 0, (size_t)total + 1, sizeof(NameKey), MEM_OTHER);
 
-void graph_print_ascii(EmotionGraph *g) {
-    printf("\n=== ASCII Graph View ===\n");
-    for (int i = 0; i < g->count; i++) {
-        EmotionNode *n = &g->nodes[i];
-        printf("\n[%s]\n", n->name);
+    /* drop repeated keys: a case twin of an earlier node goes to the overflow table,
+       an alias that repeats a name or an earlier alias is ignored */
+    int dcap = 16; while (dcap < 2 * total) dcap <<= 1;
+    int *dedup = realloc_or_die(NULL, 0, (size_t)dcap, sizeof(int), MEM_OTHER);
+    for (int i=0;i<dcap;++i) dedup[i] = -1;
+    int *twins = realloc_or_die(NULL, 0, (size_t)g->count + 1, sizeof(int), MEM_OTHER);
+    int nkeys = 0, ntwins = 0;
+    for (int i=0;i<total;++i) {
+        NameKey k = i < g->count ? (NameKey){ 0, i, -1 } : (NameKey){ 0, -1, i - g->count };
+        k.hash = name_fold_hash(name_key_text(g, &k));
+        uint32_t j = (uint32_t)k.hash & (uint32_t)(dcap - 1);
+        int dup = 0;
+        for (; dedup[j] >= 0 && !dup; j = (j + 1) & (uint32_t)(dcap - 1))
+            dup = cand[dedup[j]].hash == k.hash && name_fold_eq(name_key_text(g, &cand[dedup[j]]), name_key_text(g, &k));
+        if (dup) { if (k.alias < 0) twins[ntwins++] = i; continue; }
+        dedup[j] = nkeys;
+        cand[nkeys++] = k;
+    }
+    free_array(dedup, (size_t)dcap, sizeof(int), MEM_OTHER);
 
-        if (n->tips_count > 0) {
-            printf("  Tips:\n");
-            for (int t = 0; t < n->tips_count; ++t) {
-                printf("    - %s\n", n->tips[t].text);
+    /* hash and displace, largest bucket first */
+    h->nkeys = nkeys;
+    int nslots = h->nslots = nkeys + nkeys / NAME_HASH_SLACK + 1;
+    h->nbuckets = nkeys / NAME_HASH_BUCKET_LOAD + 1;
+    h->seeds = realloc_or_die(NULL, 0, (size_t)h->nbuckets, sizeof(uint32_t), MEM_OTHER);
+    h->keys = realloc_or_die(NULL, 0, (size_t)nslots + 1, sizeof(NameKey), MEM_OTHER);
+    for (int i=0;i<=nslots;++i) h->keys[i] = (NameKey){ 0, -1, -1 };
+    int *start = realloc_or_die(NULL, 0, (size_t)h->nbuckets + 1, sizeof(int), MEM_OTHER);
+    int *by_bucket = realloc_or_die(NULL, 0, (size_t)nkeys + 1, sizeof(int), MEM_OTHER);
+    int *order = realloc_or_die(NULL, 0, (size_t)h->nbuckets, 2 * sizeof(int), MEM_OTHER);
+    unsigned char *taken = realloc_or_die(NULL, 0, (size_t)nslots + 1, 1, MEM_OTHER);
+    memset(start, 0, sizeof(int) * ((size_t)h->nbuckets + 1));
+    memset(taken, 0, (size_t)nslots + 1);
+    for (int i=0;i<nkeys;++i) start[name_hash_bucket(cand[i].hash, h->nbuckets) + 1]++;
+    for (int b=0;b<h->nbuckets;++b) { order[2*b] = b; order[2*b+1] = start[b+1]; start[b+1] += start[b]; }
+    for (int i=0;i<nkeys;++i) by_bucket[start[name_hash_bucket(cand[i].hash, h->nbuckets)]++] = i;
+    for (int b=h->nbuckets;b>0;--b) start[b] = start[b-1];
+    start[0] = 0;
+    qsort(order, (size_t)h->nbuckets, 2 * sizeof(int), name_bucket_cmp_size);
+    int failed = 0;
+    for (int o=0;o<h->nbuckets;++o) {
+        int b = order[2*o], size = order[2*o+1];
+        const int *members = by_bucket + start[b];
+        h->seeds[b] = 0;
+        if (size == 0) continue;
+        uint32_t slots[64], limit = 64u * (uint32_t)nkeys + 1024u, seed;
+        int fits = 0;
+        for (seed=0; seed<limit && size <= 64 && !fits; ++seed) {
+            fits = 1;
+            for (int k=0;k<size && fits;++k) {
+                slots[k] = name_hash_slot(cand[members[k]].hash, seed, nslots);
+                fits = !taken[slots[k]];
+                for (int q=0;q<k && fits;++q) fits = slots[q] != slots[k];
             }
         }
+        if (!fits) { failed = 1; break; }
+        h->seeds[b] = seed - 1;
+        for (int k=0;k<size;++k) { taken[slots[k]] = 1; h->keys[slots[k]] = cand[members[k]]; }
+    }
+    free_array(start, (size_t)h->nbuckets + 1, sizeof(int), MEM_OTHER);
+    free_array(by_bucket, (size_t)nkeys + 1, sizeof(int), MEM_OTHER);
+    free_array(order, (size_t)h->nbuckets, 2 * sizeof(int), MEM_OTHER);
+    free_array(taken, (size_t)nslots + 1, 1, MEM_OTHER);
+    if (failed) {   /* no seed found (never seen in practice): keep nodes in the overflow table */
+        free_array(h->keys, (size_t)nslots + 1, sizeof(NameKey), MEM_OTHER);
+        h->keys = realloc_or_die(NULL, 0, 1, sizeof(NameKey), MEM_OTHER);
+        h->nkeys = h->nslots = 0;
+        ntwins = 0;
+        for (int i=0;i<g->count;++i) twins[ntwins++] = i;
+    }
 
-        if (n->edges_count == 0) {
-            printf("  (no connections)\n");
-            continue;
-        }
+    h->nodes = g->count;
+    int room = ntwins + (g->count > NAME_HASH_MIN_OVERFLOW ? g->count : NAME_HASH_MIN_OVERFLOW) + 1;
+    h->overflow_cap = 16; while (h->overflow_cap < 2 * room) h->overflow_cap <<= 1;
+    h->overflow = realloc_or_die(NULL, 0, (size_t)h->overflow_cap, sizeof(NameOverflow), MEM_OTHER);
+    for (int i=0;i<h->overflow_cap;++i) h->overflow[i].node = -1;
+    for (int i=0;i<ntwins;++i) name_overflow_put(h, name_fold_hash(g->nodes[twins[i]].name), twins[i]);
+    free_array(twins, (size_t)g->count + 1, sizeof(int), MEM_OTHER);
+    free_array(cand, (size_t)total + 1, sizeof(NameKey), MEM_OTHER);
 
-        for (int e = 0; e < n->edges_count; e++) {
-            Edge *ed = &n->edges[e];
-            printf("   |-- %s", g->nodes[ed->to].name);
-            if (ed->procedure)
-                printf("  (action: %s)", ed->procedure);
-            printf("  [weight: %.2f]\n", ed->weight);
-        }
+    /* point aliases at their emotion now; one that does not exist yet stays -1 */
+    for (int i=0;i<h->nslots;++i) {
+        NameKey *k = &h->keys[i];
+        if (k->alias < 0) continue;
+        const char *canon = g->aliases.items[k->alias].canonical;
+        int probes = 0;
+        k->node = name_hash_probe(g, h, canon, name_fold_hash(canon), 1, &probes);
     }
-    printf("\n=========================\n");
+    g->name_hash = h;
+    TRACE_END("name_hash_build", t0);
 }
 
-/* ---------- Assessment prototypes & selection ---------- */
-
-typedef struct { char name[MAX_NAME_LEN]; float stress, overwhelm, anger, sadness; } Prototype;
+static struct NameHash *name_hash_sync(EmotionGraph *g) {
+    struct NameHash *h = g->name_hash;
+    int covered = h ? h->nodes - h->appended : 0;   /* nodes the build saw */
+    int loading = h && g->loading && g->count >= h->nodes;
+    if (!h || g->count < h->nodes
+        || (!loading && g->count - covered > (covered > NAME_HASH_MIN_OVERFLOW ? covered : NAME_HASH_MIN_OVERFLOW))) {
+        name_hash_build(g);
+        return g->name_hash;
+    }
+    for (; h->nodes < g->count; ++h->nodes, ++h->appended) {
+        if (2 * (h->overflow_count + 1) > h->overflow_cap) name_overflow_grow(h);
+        name_overflow_put(h, name_fold_hash(g->nodes[h->nodes].name), h->nodes);
+    }
+    return h;
+}
 
-int choose_closest_prototype(float s, float o, float a, float sd, Prototype *protos, int pcount) {
-    float bestd = FLT_MAX; int best = 0;
-    for (int i=0;i<pcount;++i) {
-        float ds = s - protos[i].stress;
-        float doo = o - protos[i].overwhelm;
-        float da = a - protos[i].anger;
-        float dsd = sd - protos[i].sadness;
-        float dist = ds*ds + doo*doo + da*da + dsd*dsd;
-        if (dist < bestd) { bestd = dist; best = i; }
+/* exact: the node whose name is exactly name; otherwise any name or alias equal up to case. */
+static int name_hash_probe(const EmotionGraph *g, const struct NameHash *h, const char *name, uint64_t hv, int exact, int *probes) {
+    if (h->nkeys) {
+        const NameKey *k = &h->keys[name_hash_slot(hv, h->seeds[name_hash_bucket(hv, h->nbuckets)], h->nslots)];
+        ++*probes;
+        if (k->hash == hv && (k->node >= 0 || k->alias >= 0)) {
+            const char *text = name_key_text(g, k);
+            if (k->alias < 0 ? (exact ? strcmp(text, name) == 0 : name_fold_eq(text, name)) : (!exact && name_fold_eq(text, name)))
+                return k->node;
+        }
     }
-    return best;
+    uint32_t mask = (uint32_t)h->overflow_cap - 1;
+    for (uint32_t i = (uint32_t)hv & mask; h->overflow[i].node >= 0; i = (i + 1) & mask) {
+        ++*probes;
+        if (h->overflow[i].hash != hv) continue;
+        const char *text = g->nodes[h->overflow[i].node].name;
+        if (exact ? strcmp(text, name) == 0 : name_fold_eq(text, name)) return h->overflow[i].node;
+    }
+    return -1;
 }
 
-/* ---------- Personalized Dijkstra (O(n^2)) ----------
-   Internal details are kept inside; user sees only the final path and actions.
-   Small heuristics:
-    - Nodes that have user tips are slightly favored (treated as easier)
-    - Edges with procedures are slightly favored
-    - Some nodes are blocked from direct positive edges (handled when adding edges)
+/* ---------- Tip and action search (inverted index) ----------
+   Every tip and every transition procedure is a document; each word (lowercase letters
+   and digits) has a posting list of the documents that contain it, in document order.
+   The index is built on the first search and then kept up to date by the tip and
+   procedure edits below: new text gets a new document, replaced text retires the old
+   one. A query is the documents holding every query word, where a word also matches
+   longer words it begins ("breath" finds "breaths" and "breathing"); the rarest word
+   goes first and the others can only confirm its candidates.
 */
 
-float run_dijkstra_personalized(EmotionGraph *g, int src, int dest, int out_path[], int *out_len) {
-    int n = g->count;
-    if (src < 0 || dest < 0) return FLT_MAX;
-    float dist[n]; int visited[n]; int prev[n];
-    for (int i=0;i<n;++i) { dist[i]=FLT_MAX; visited[i]=0; prev[i]=-1; }
-    dist[src] = 0.0f;
+#define TEXT_MAX_TERMS 8
+#define TEXT_MAX_WORD 32
 
-    for (int iter=0; iter<n; ++iter) {
-        int u=-1; float best=FLT_MAX;
-        for (int i=0;i<n;++i) if (!visited[i] && dist[i] < best) { best = dist[i]; u = i; }
-        if (u==-1) break;
-        visited[u] = 1;
-        if (u == dest) break;
-        EmotionNode *nu = &g->nodes[u];
-        for (int ei=0; ei < nu->edges_count; ++ei) {
-            Edge *e = &nu->edges[ei];
-            int v = e->to;
-            if (visited[v]) continue;
-            float w = e->weight;
-            if (g->nodes[v].tips_count > 0) w *= 0.85f;
-            if (e->procedure) w *= 0.8f;
-            /* small internal bias from valence (hidden) */
-            float valence_bias = (1.0f - g->nodes[v].valence) * 0.05f;
-            w = w * (1.0f - valence_bias);
-            float alt = dist[u] + w;
-            if (alt < dist[v]) { dist[v] = alt; prev[v] = u; }
+enum { TEXT_TIP, TEXT_PROCEDURE };
+
+typedef struct { int node, slot; unsigned char kind, live; } TextDoc;   /* slot: tip or edge index */
+typedef struct { char *word; int *docs; int count, cap; } TextTerm;
+
+struct TextIndex {
+    TextDoc *docs; int ndocs, docs_cap;
+    TextTerm *terms; int nterms, terms_cap;
+    int *slots; int slots_cap;                 /* open addressing over terms, -1 empty */
+    int *sorted; int nsorted;                  /* term ids in word order, for prefixes */
+    unsigned *stamp; unsigned char *level; int *cand; int scratch_cap;
+    unsigned epoch;
+};
+
+static uint64_t text_word_hash(const char *w) {
+    uint64_t h = 1469598103934665603ULL;
+    for (; *w; ++w) { h ^= (unsigned char)*w; h *= 1099511628211ULL; }
+    return h;
+}
+
+/* Next word of *p into word (folded, truncated to TEXT_MAX_WORD-1); 0 at the end. */
+static int text_next_word(const char **p, char *word) {
+    const char *s = *p;
+    while (*s && !isalnum((unsigned char)*s)) ++s;
+    if (!*s) { *p = s; return 0; }
+    int n = 0;
+    for (; isalnum((unsigned char)*s); ++s) if (n < TEXT_MAX_WORD - 1) word[n++] = (char)tolower((unsigned char)*s);
+    word[n] = '\0';
+    *p = s;
+    return 1;
+}
+
+static int text_term_get(struct TextIndex *ix, const char *word) {
+    if (2 * (ix->nterms + 1) > ix->slots_cap) {   /* keep room for one more term: grow and rehash */
+        int old = ix->slots_cap;
+        ix->slots_cap = old ? old * 2 : 1024;
+        free_array(ix->slots, old, sizeof(int), MEM_OTHER);
+        ix->slots = realloc_or_die(NULL, 0, ix->slots_cap, sizeof(int), MEM_OTHER);
+        for (int k=0;k<ix->slots_cap;++k) ix->slots[k] = -1;
+        for (int t=0;t<ix->nterms;++t) {
+            uint32_t j = (uint32_t)text_word_hash(ix->terms[t].word) & (uint32_t)(ix->slots_cap - 1);
+            while (ix->slots[j] >= 0) j = (j + 1) & (uint32_t)(ix->slots_cap - 1);
+            ix->slots[j] = t;
         }
     }
+    uint32_t mask = (uint32_t)ix->slots_cap - 1, i = (uint32_t)text_word_hash(word) & mask;
+    for (; ix->slots[i] >= 0; i = (i + 1) & mask)
+        if (strcmp(ix->terms[ix->slots[i]].word, word) == 0) return ix->slots[i];
+    if (ix->nterms == ix->terms_cap) {
+        int nc = ix->terms_cap ? ix->terms_cap * 2 : 256;
+        ix->terms = realloc_or_die(ix->terms, ix->terms_cap, nc, sizeof(TextTerm), MEM_OTHER);
+        ix->terms_cap = nc;
+    }
+    ix->terms[ix->nterms] = (TextTerm){ strdup_s(word, MEM_OTHER), NULL, 0, 0 };
+    ix->slots[i] = ix->nterms;
+    return ix->nterms++;
+}
 
-    if (dist[dest] == FLT_MAX) return FLT_MAX;
-    int temp[n]; int idx=0;
-    for (int cur = dest; cur != -1; cur = prev[cur]) temp[idx++] = cur;
-    *out_len = idx;
-    for (int i=0;i<idx;++i) out_path[i] = temp[idx-1-i];
-    return dist[dest];
+static int text_doc_add(struct TextIndex *ix, int kind, int node, int slot, const char *text) {
+    if (ix->ndocs == ix->docs_cap) {
+        int nc = ix->docs_cap ? ix->docs_cap * 2 : 256;
+        ix->docs = realloc_or_die(ix->docs, ix->docs_cap, nc, sizeof(TextDoc), MEM_OTHER);
+        ix->docs_cap = nc;
+    }
+    int d = ix->ndocs++;
+    ix->docs[d] = (TextDoc){ node, slot, (unsigned char)kind, 1 };
+    char word[TEXT_MAX_WORD];
+    for (const char *p = text; text_next_word(&p, word); ) {
+        int ti = text_term_get(ix, word);   /* may move ix->terms */
+        TextTerm *t = &ix->terms[ti];
+        if (t->count && t->docs[t->count-1] == d) continue;   /* word repeated in this text */
+        if (t->count == t->cap) {
+            int nc = t->cap ? t->cap * 2 : 4;
+            t->docs = realloc_or_die(t->docs, t->cap, nc, sizeof(int), MEM_OTHER);
+            t->cap = nc;
+        }
+        t->docs[t->count++] = d;
+    }
+    return d;
 }
 
-/* ---------- I/O helpers ---------- */
+/* Hooks for the graph edits: no-ops until the first search builds the index. */
+static int text_index_add(EmotionGraph *g, int kind, int node, int slot, const char *text) {
+    return g->text_index && text ? text_doc_add(g->text_index, kind, node, slot, text) : -1;
+}
 
-static void read_line_trim(char *buf, int size) {
-    if (!fgets(buf, size, stdin)) { buf[0]='\0'; return; }
-    size_t len = strlen(buf);
-    if (len>0 && buf[len-1]=='\n') buf[len-1] = '\0';
-    char *p=buf; while (*p && isspace((unsigned char)*p)) ++p;
-    if (p != buf) memmove(buf, p, strlen(p)+1);
+static void text_index_retire(EmotionGraph *g, int doc) {
+    if (g->text_index && doc >= 0) g->text_index->docs[doc].live = 0;
 }
-static int read_int_in_range(const char *prompt, int lo, int hi) {
-    char buf[128]; int val;
-    while (1) {
-        printf("%s (%d-%d): ", prompt, lo, hi);
-        read_line_trim(buf, sizeof(buf));
-        if (sscanf(buf, "%d", &val) == 1 && val >= lo && val <= hi) return val;
-        printf("  Please enter a number between %d and %d.\n", lo, hi);
+
+static void text_index_free(EmotionGraph *g) {
+    struct TextIndex *ix = g->text_index;
+    if (!ix) return;
+    for (int t=0;t<ix->nterms;++t) { free_str(ix->terms[t].word, MEM_OTHER); free_array(ix->terms[t].docs, ix->terms[t].cap, sizeof(int), MEM_OTHER); }
+    free_array(ix->terms, ix->terms_cap, sizeof(TextTerm), MEM_OTHER);
+    free_array(ix->docs, ix->docs_cap, sizeof(TextDoc), MEM_OTHER);
+    free_array(ix->slots, ix->slots_cap, sizeof(int), MEM_OTHER);
+    free_array(ix->sorted, ix->nsorted, sizeof(int), MEM_OTHER);
+    free_array(ix->stamp, ix->scratch_cap, sizeof(unsigned), MEM_OTHER);
+    free_array(ix->level, ix->scratch_cap, 1, MEM_OTHER);
+    free_array(ix->cand, ix->scratch_cap, sizeof(int), MEM_OTHER);
+    free_array(ix, 1, sizeof(*ix), MEM_OTHER);
+    g->text_index = NULL;
+}
+
+static struct TextIndex *text_index_get(EmotionGraph *g) {
+    if (g->text_index) return g->text_index;
+    TRACE_BEGIN(t0);
+    struct TextIndex *ix = realloc_or_die(NULL, 0, 1, sizeof(*ix), MEM_OTHER);
+    memset(ix, 0, sizeof(*ix));
+    for (int i=0;i<g->count;++i) {
+        EmotionNode *n = &g->nodes[i];
+        for (int t=0;t<n->tips_count;++t) n->tips[t].doc = text_doc_add(ix, TEXT_TIP, i, t, n->tips[t].text);
+        for (int e=0;e<n->edges_count;++e)
+            n->edges[e].doc = n->edges[e].procedure ? text_doc_add(ix, TEXT_PROCEDURE, i, e, n->edges[e].procedure) : -1;
     }
+    g->text_index = ix;
+    TRACE_END("text_index_build", t0);
+    return ix;
 }
 
-/* ---------- Persistence: save/load (format A) ---------- */
+static const struct TextIndex *text_sort_ix;
+static int text_term_cmp(const void *a, const void *b) {
+    return strcmp(text_sort_ix->terms[*(const int *)a].word, text_sort_ix->terms[*(const int *)b].word);
+}
 
-static void fwrite_quoted(FILE *f, const char *s) {
-    fputc('"', f);
-    for (; *s; ++s) {
-        if (*s == '"' || *s == '\\') fputc('\\', f);
-        fputc((unsigned char)*s, f);
+/* Term ids [*lo, *hi) of ix->sorted whose word begins with prefix. */
+static void text_prefix_range(struct TextIndex *ix, const char *prefix, int *lo, int *hi) {
+    if (ix->nsorted != ix->nterms) {
+        free_array(ix->sorted, ix->nsorted, sizeof(int), MEM_OTHER);
+        ix->sorted = realloc_or_die(NULL, 0, (size_t)ix->nterms, sizeof(int), MEM_OTHER);
+        for (int t=0;t<ix->nterms;++t) ix->sorted[t] = t;
+        text_sort_ix = ix;
+        qsort(ix->sorted, (size_t)ix->nterms, sizeof(int), text_term_cmp);
+        ix->nsorted = ix->nterms;
     }
-    fputc('"', f);
+    size_t plen = strlen(prefix);
+    int a = 0, b = ix->nsorted;
+    while (a < b) { int m = (a + b) / 2; if (strcmp(ix->terms[ix->sorted[m]].word, prefix) < 0) a = m + 1; else b = m; }
+    *lo = a;
+    while (b < ix->nsorted && strncmp(ix->terms[ix->sorted[b]].word, prefix, plen) == 0) ++b;
+    *hi = b;
 }
 
-int save_graph(EmotionGraph *g, const char *filename) {
-    FILE *f = fopen(filename, "w");
-    if (!f) { perror("fopen"); return 0; }
+static int int_cmp(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+/* Tips and procedures containing every word of query. Copies up to max matches (oldest
+   text first) into out and returns how many there are in all. */
+int text_search(EmotionGraph *g, const char *query, TextDoc out[], int max) {
+    TRACE_BEGIN(t0);
+    struct TextIndex *ix = text_index_get(g);
+    char words[TEXT_MAX_TERMS][TEXT_MAX_WORD];
+    int lo[TEXT_MAX_TERMS], hi[TEXT_MAX_TERMS], order[TEXT_MAX_TERMS]; long size[TEXT_MAX_TERMS];
+    int nw = 0;
+    for (const char *p = query; nw < TEXT_MAX_TERMS && text_next_word(&p, words[nw]); ) {
+        text_prefix_range(ix, words[nw], &lo[nw], &hi[nw]);
+        size[nw] = 0;
+        for (int k=lo[nw];k<hi[nw];++k) size[nw] += ix->terms[ix->sorted[k]].count;
+        if (size[nw] == 0) { TRACE_END("text_search", t0); return 0; }
+        order[nw] = nw; ++nw;
+    }
+    if (nw == 0) { TRACE_END("text_search", t0); return 0; }
+    for (int i=1;i<nw;++i) for (int j=i; j>0 && size[order[j]] < size[order[j-1]]; --j) { int x = order[j]; order[j] = order[j-1]; order[j-1] = x; }
+
+    if (ix->ndocs > ix->scratch_cap) {
+        int old = ix->scratch_cap, nc = ix->docs_cap;
+        ix->stamp = realloc_or_die(ix->stamp, old, nc, sizeof(unsigned), MEM_OTHER);
+        ix->level = realloc_or_die(ix->level, old, nc, 1, MEM_OTHER);
+        ix->cand = realloc_or_die(ix->cand, old, nc, sizeof(int), MEM_OTHER);
+        memset(ix->stamp + old, 0, sizeof(unsigned) * (size_t)(nc - old));
+        ix->scratch_cap = nc;
+    }
+    if (++ix->epoch == 0) { memset(ix->stamp, 0, sizeof(unsigned) * (size_t)ix->scratch_cap); ix->epoch = 1; }
+    /* the rarest word proposes candidates; each later word keeps the ones it holds,
+       probing its (sorted) posting lists per candidate when that is cheaper than a scan */
+    int nc = 0;
+    for (int k=lo[order[0]];k<hi[order[0]];++k) {
+        const TextTerm *t = &ix->terms[ix->sorted[k]];
+        for (int i=0;i<t->count;++i) {
+            int d = t->docs[i];
+            if (ix->stamp[d] != ix->epoch && ix->docs[d].live) { ix->stamp[d] = ix->epoch; ix->level[d] = 1; ix->cand[nc++] = d; }
+        }
+    }
+    for (int w=1;w<nw && nc>0;++w) {
+        int q = order[w], kept = 0;
+        if ((long)nc * (hi[q] - lo[q]) * 16 < size[q]) {
+            for (int i=0;i<nc;++i) {
+                int d = ix->cand[i], hit = 0;
+                for (int k=lo[q];k<hi[q] && !hit;++k) {
+                    const TextTerm *t = &ix->terms[ix->sorted[k]];
+                    int a = 0, b = t->count;
+                    while (a < b) { int m = (a + b) / 2; if (t->docs[m] < d) a = m + 1; else b = m; }
+                    hit = a < t->count && t->docs[a] == d;
+                }
+                if (hit) ix->cand[kept++] = d;
+            }
+        } else {
+            for (int k=lo[q];k<hi[q];++k) {
+                const TextTerm *t = &ix->terms[ix->sorted[k]];
+                for (int i=0;i<t->count;++i) {
+                    int d = t->docs[i];
+                    if (ix->stamp[d] == ix->epoch && ix->level[d] == w) ix->level[d] = (unsigned char)(w + 1);
+                }
+            }
+            for (int i=0;i<nc;++i) if (ix->level[ix->cand[i]] == w + 1) ix->cand[kept++] = ix->cand[i];
+        }
+        for (int i=0;i<kept;++i) ix->level[ix->cand[i]] = (unsigned char)(w + 1);
+        nc = kept;
+    }
+    int total = nc;
+    qsort(ix->cand, (size_t)total, sizeof(int), int_cmp);
+    for (int i=0;i<total && i<max;++i) out[i] = ix->docs[ix->cand[i]];
+    TRACE_END("text_search", t0);
+    return total;
+}
+
+/* ---------- Tip ranking ----------
+   Plans show only the best TIP_TOP_K tips of each step. A tip's rank grows with the
+   times it helped, shrinks with the times it was tried without helping, and gains
+   1 per TIP_RECENCY_DAYS since its last success (new tips count as a success today).
+   Adding the day instead of decaying the counts keeps every rank fixed while time
+   passes, so each node can keep its top list up to date as feedback arrives: a tip
+   that moves up is reinserted in O(k); only a top tip that moves down rescans its node.
+   Equal ranks keep the order the tips were added in.
+*/
+
+#define TIP_RECENCY_DAYS 30.0f
+
+static int tip_today(void) { return (int)(time(NULL) / 86400); }
+
+static float tip_rank(const Tip *t) {
+    return 2.0f * log2f(1.0f + (float)t->helped) - log2f(1.0f + (float)(t->tried - t->helped))
+         + (float)t->day / TIP_RECENCY_DAYS;
+}
+
+static int tip_better(const EmotionNode *n, int a, int b) {
+    float ra = n->tips[a].rank, rb = n->tips[b].rank;
+    return ra > rb || (ra == rb && a < b);
+}
+
+/* Inserts tip t (not in the list) into n's top list if it ranks high enough. */
+static void tip_top_offer(EmotionNode *n, int t) {
+    int k = n->tip_top_count;
+    if (k == TIP_TOP_K) {
+        if (!tip_better(n, t, n->tip_top[k-1])) return;
+        --k;
+    } else n->tip_top_count++;
+    for (; k > 0 && tip_better(n, t, n->tip_top[k-1]); --k) n->tip_top[k] = n->tip_top[k-1];
+    n->tip_top[k] = t;
+}
+
+static void tip_top_rebuild(EmotionNode *n) {
+    n->tip_top_count = 0;
+    for (int t=0;t<n->tips_count;++t) tip_top_offer(n, t);
+}
+
+/* Recomputes the rank of tip t after its feedback changed and fixes the top list. */
+static void tip_rerank(EmotionNode *n, int t) {
+    float old = n->tips[t].rank;
+    n->tips[t].rank = tip_rank(&n->tips[t]);
+    int pos = -1;
+    for (int k=0;k<n->tip_top_count;++k) if (n->tip_top[k] == t) pos = k;
+    if (pos < 0) { tip_top_offer(n, t); return; }
+    if (n->tips[t].rank < old && n->tips_count > TIP_TOP_K) { tip_top_rebuild(n); return; }
+    for (int k=pos;k+1<n->tip_top_count;++k) n->tip_top[k] = n->tip_top[k+1];
+    n->tip_top_count--;
+    tip_top_offer(n, t);
+}
+
+/* The user tried tip t of n; helped says whether it worked. */
+void tip_record(EmotionNode *n, int t, int helped) {
+    Tip *tp = &n->tips[t];
+    tp->tried++;
+    if (helped) { tp->helped++; tp->day = tip_today(); }
+    tip_rerank(n, t);
+}
+
+/* ---------- Near-duplicate tips (SimHash) ----------
+   Merged maps repeat the same advice with small edits ("5 slow breaths (inhale 4s...").
+   Each tip carries a 64-bit SimHash of its 4-character shingles (text folded as for
+   detection), computed when the tip is added; similar texts get fingerprints a few bits
+   apart. Tips are one short sentence, and with so few shingles a one-word edit moves
+   the fingerprint by 10-15 bits, about as far as two different tips that share most
+   words ("see" / "hear"). So the fingerprint only picks candidates, within
+   TIP_SIMHASH_DISTANCE bits; a candidate is a near duplicate when the Jaccard
+   similarity of the two 3-character shingle sets reaches TIP_NEAR_JACCARD.
+   The merge pass finds candidates with banded LSH: fingerprints are cut into 4-bit
+   bands, and two that close must agree on at least one of them, so a tip is only
+   compared with kept tips of its emotion that share an (emotion, band, nibble) bucket.
+   The first copy stays and takes over the feedback of the copies it replaces.
+*/
+
+#define TIP_SIMHASH_DISTANCE 15
+#define TIP_SIMHASH_BANDS 16       /* four bits each; must exceed TIP_SIMHASH_DISTANCE */
+#define TIP_NEAR_JACCARD 0.67f
+
+static int lex_fold(const char *text, char *buf, int cap);
+
+/* Bit counts are kept as eight bytes per word (byte k of lanes[j] counts bit 8j+k) and
+   flushed before a byte can overflow: eight adds per shingle instead of 64. */
+static uint64_t simhash_spread[256];   /* byte k = bit k of the index */
+
+static uint64_t tip_simhash(const char *text) {
+    if (!simhash_spread[1])
+        for (int x=0;x<256;++x) for (int k=0;k<8;++k) if (x >> k & 1) simhash_spread[x] |= (uint64_t)1 << (8 * k);
+    char buf[MAX_LINE];
+    int n = lex_fold(text, buf, sizeof(buf)), counts[64] = {0}, nf = 0, pending = 0;
+    uint64_t lanes[8] = {0};
+    for (int i=0; i+4<=n; ++i, ++nf) {
+        uint64_t h = 1469598103934665603ULL;
+        for (int k=0;k<4;++k) { h ^= (unsigned char)buf[i+k]; h *= 1099511628211ULL; }
+        h ^= h >> 33; h *= 0xFF51AFD7ED558CCDULL; h ^= h >> 33;
+        for (int j=0;j<8;++j) lanes[j] += simhash_spread[h >> (8 * j) & 0xFF];
+        if (++pending == 255 || i + 5 > n) {
+            for (int j=0;j<8;++j) { for (int k=0;k<8;++k) counts[8*j+k] += (int)(lanes[j] >> (8 * k) & 0xFF); lanes[j] = 0; }
+            pending = 0;
+        }
+    }
+    uint64_t fp = 0;
+    for (int b=0;b<64;++b) if (2 * counts[b] > nf) fp |= (uint64_t)1 << b;
+    return fp;
+}
+
+static int tip_candidate(uint64_t a, uint64_t b) { return __builtin_popcountll(a ^ b) <= TIP_SIMHASH_DISTANCE; }
+
+/* Sorted distinct hashes of the 3-character shingles of a folded tip. */
+typedef struct { uint32_t h[MAX_LINE]; int n; } TipShingles;
+
+static int u32_cmp(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void tip_shingles(const char *text, TipShingles *out) {
+    char buf[MAX_LINE];
+    int n = lex_fold(text, buf, sizeof(buf)), m = 0;
+    for (int i=0; i+3<=n; ++i) {
+        uint32_t h = 2166136261u;
+        for (int k=0;k<3;++k) { h ^= (unsigned char)buf[i+k]; h *= 16777619u; }
+        out->h[m++] = h;
+    }
+    qsort(out->h, (size_t)m, sizeof(uint32_t), u32_cmp);
+    out->n = 0;
+    for (int i=0;i<m;++i) if (i == 0 || out->h[i] != out->h[i-1]) out->h[out->n++] = out->h[i];
+}
+
+static int tip_shingles_near(const TipShingles *a, const TipShingles *b) {
+    int i = 0, j = 0, common = 0;
+    while (i < a->n && j < b->n) {
+        if (a->h[i] == b->h[j]) { ++common; ++i; ++j; }
+        else if (a->h[i] < b->h[j]) ++i;
+        else ++j;
+    }
+    int all = a->n + b->n - common;
+    return all > 0 && (float)common >= TIP_NEAR_JACCARD * (float)all;
+}
+
+/* A tip of n close to text, or -1. A node holds few tips, so this is a straight scan. */
+int tip_find_near(const EmotionNode *n, const char *text) {
+    uint64_t fp = tip_simhash(text);
+    static TipShingles want, have;   /* 4 KB each: kept off the stack */
+    int ready = 0;
+    for (int t=0;t<n->tips_count;++t) {
+        if (!tip_candidate(fp, n->tips[t].sim)) continue;
+        if (!ready) { tip_shingles(text, &want); ready = 1; }
+        tip_shingles(n->tips[t].text, &have);
+        if (tip_shingles_near(&want, &have)) return t;
+    }
+    return -1;
+}
+
+static void text_index_free(EmotionGraph *g);
+static void graph_touch(EmotionGraph *g);
+
+typedef struct { int next, node, slot; } TipBucketEntry;
+
+static uint32_t tip_bucket(int node, int band, uint64_t fp, uint32_t mask) {
+    uint64_t x = ((uint64_t)(unsigned)node << 16) | ((uint64_t)band << 8) | (fp >> (4 * band) & 0xF);
+    x ^= x >> 31; x *= 0xBF58476D1CE4E5B9ULL; x ^= x >> 29;
+    return (uint32_t)x & mask;
+}
+
+/* Drops near-duplicate tips of every emotion, keeping the first; returns how many went.
+   Ranks of kept tips change with the merged feedback, so touched nodes rebuild their top list. */
+long tips_dedup(EmotionGraph *g) {
+    TRACE_BEGIN(t0);
+    long total = 0, removed = 0;
+    int most = 1;
+    for (int i=0;i<g->count;++i) {
+        total += g->nodes[i].tips_count;
+        if (g->nodes[i].tips_count > most) most = g->nodes[i].tips_count;
+    }
+    size_t cap = (size_t)total * TIP_SIMHASH_BANDS + 1, nheads = 16;
+    while (nheads < cap) nheads <<= 1;
+    int *heads = realloc_or_die(NULL, 0, nheads, sizeof(int), MEM_OTHER);
+    TipBucketEntry *entries = realloc_or_die(NULL, 0, cap, sizeof(TipBucketEntry), MEM_OTHER);
+    for (size_t k=0;k<nheads;++k) heads[k] = -1;
+    int nentries = 0, stamp = 0; uint32_t mask = (uint32_t)(nheads - 1);
+    int *checked = realloc_or_die(NULL, 0, (size_t)most, sizeof(int), MEM_OTHER);   /* kept slot -> stamp of last check */
+    for (int k=0;k<most;++k) checked[k] = 0;
+    static TipShingles cur, other;
     for (int i=0;i<g->count;++i) {
         EmotionNode *n = &g->nodes[i];
-        fprintf(f, "NODE %s %.3f %.3f\n", n->name, n->valence, n->baseline_intensity);
+        int kept = 0;
         for (int t=0;t<n->tips_count;++t) {
-            fprintf(f, "TIP %s ", n->name);
-            fwrite_quoted(f, n->tips[t].text); fputc('\n', f);
+            uint64_t fp = n->tips[t].sim;
+            int dup = -1, ready = 0;
+            ++stamp;
+            for (int b=0;b<TIP_SIMHASH_BANDS && dup < 0;++b)
+                for (int e = heads[tip_bucket(i, b, fp, mask)]; e >= 0 && dup < 0; e = entries[e].next) {
+                    int slot = entries[e].slot;
+                    if (entries[e].node != i || checked[slot] == stamp) continue;
+                    checked[slot] = stamp;   /* a candidate shares up to TIP_SIMHASH_BANDS buckets */
+                    if (!tip_candidate(fp, n->tips[slot].sim)) continue;
+                    if (!ready) { tip_shingles(n->tips[t].text, &cur); ready = 1; }
+                    tip_shingles(n->tips[slot].text, &other);
+                    if (tip_shingles_near(&cur, &other)) dup = slot;
+                }
+            if (dup >= 0) {
+                Tip *keep = &n->tips[dup];
+                keep->tried += n->tips[t].tried; keep->helped += n->tips[t].helped;
+                if (n->tips[t].day > keep->day) keep->day = n->tips[t].day;
+                keep->rank = tip_rank(keep);
+                free_str(n->tips[t].text, MEM_TIPS); ++removed; continue;
+            }
+            n->tips[kept] = n->tips[t];
+            for (int b=0;b<TIP_SIMHASH_BANDS;++b) {
+                uint32_t h = tip_bucket(i, b, fp, mask);
+                entries[nentries] = (TipBucketEntry){ heads[h], i, kept };
+                heads[h] = nentries++;
+            }
+            ++kept;
+        }
+        if (kept < n->tips_count) { n->tips_count = kept; tip_top_rebuild(n); }
+    }
+    free_array(heads, nheads, sizeof(int), MEM_OTHER);
+    free_array(entries, cap, sizeof(TipBucketEntry), MEM_OTHER);
+    free_array(checked, (size_t)most, sizeof(int), MEM_OTHER);
+    if (removed) { text_index_free(g); graph_touch(g); }   /* tip slots moved */
+    TRACE_END("tips_dedup", t0);
+    return removed;
+}
+
+/* ---------- Graph ops ---------- */
+
+/* Versions come from one global sequence so a cache built for one graph can never match
+   a later graph that reuses its address. */
+static unsigned long graph_epoch;
+static void graph_touch(EmotionGraph *g) { g->version = ++graph_epoch; }
+
+static void rules_reset_defaults(EmotionGraph *g);
+static void goals_reset_defaults(EmotionGraph *g);
+
+EmotionGraph *graph_new() {
+    EmotionGraph *g = malloc(sizeof(EmotionGraph));
+    if (!g) { perror("malloc"); exit(1); }
+    ALLOC_COUNT();
+    mem_account(MEM_OTHER, (long long)sizeof(EmotionGraph));
+    g->nodes = NULL; g->count = 0; g->cap = 0; g->arcs = 0;
+    g->rules.count = 0; g->rules.by_name = NULL; g->rules.by_name_count = g->rules.by_name_cap = 0;
+    g->goals.count = 0; g->goals.active = 0;
+    g->aliases.items = NULL; g->aliases.count = 0; g->aliases.cap = 0;
+    g->keywords.items = NULL; g->keywords.count = 0; g->keywords.cap = 0;
+    g->name_hash = NULL; g->loading = 0;
+    g->lexicon = NULL;
+    g->text_index = NULL;
+    g->name_index = NULL;
+    rules_reset_defaults(g);
+    goals_reset_defaults(g);
+    graph_touch(g);
+    return g;
+}
+
+int graph_find(EmotionGraph *g, const char *name) {
+    STAT_INC(find_calls);
+    TRACE_BEGIN(t0);
+    int probes = 0;
+    int idx = name_hash_probe(g, name_hash_sync(g), name, name_fold_hash(name), 1, &probes);
+    STAT_ADD(find_probes, probes);
+    TRACE_END("graph_find", t0);
+    return idx;
+}
+
+/* Name as a user typed it: an exact name, then any name or alias in another case. */
+int graph_resolve(EmotionGraph *g, const char *name) {
+    int idx = graph_find(g, name);
+    if (idx >= 0) return idx;
+    int probes = 0;
+    struct NameHash *h = name_hash_sync(g);
+    uint64_t hv = name_fold_hash(name);
+    idx = name_hash_probe(g, h, name, hv, 0, &probes);
+    if (idx < 0 && h->nkeys) {   /* an alias whose emotion was added after the build */
+        const NameKey *k = &h->keys[name_hash_slot(hv, h->seeds[name_hash_bucket(hv, h->nbuckets)], h->nslots)];
+        if (k->hash == hv && k->alias >= 0 && name_fold_eq(name_key_text(g, k), name))
+            idx = graph_find(g, g->aliases.items[k->alias].canonical);
+    }
+    STAT_ADD(find_probes, probes);
+    return idx;
+}
+
+static uint64_t rules_classes_of_name(const RuleTable *r, const char *name);
+static uint64_t rules_forbid_of(const RuleTable *r, uint64_t classes);
+static void goals_attach_node(EmotionGraph *g, int idx);
+
+/* Appends a node without the name lookup; callers guarantee the name is new. */
+static int graph_append_node(EmotionGraph *g, const char *name, float valence, float baseline) {
+    ensure_graph_capacity(g);
+    EmotionNode *n = &g->nodes[g->count];
+    strncpy(n->name, name, MAX_NAME_LEN-1);
+    n->name[MAX_NAME_LEN-1] = '\0';
+    n->valence = valence;
+    n->baseline_intensity = baseline;
+    n->classes = rules_classes_of_name(&g->rules, n->name);
+    n->forbid = rules_forbid_of(&g->rules, n->classes);
+    n->edges = NULL; n->edges_count = 0; n->edges_cap = 0;
+    n->tips = NULL; n->tips_count = 0; n->tips_cap = 0;
+    n->tip_top_count = 0;
+    graph_touch(g);
+    goals_attach_node(g, g->count);
+    return g->count++;
+}
+
+int graph_add_node(EmotionGraph *g, const char *name, float valence, float baseline) {
+    int idx = graph_find(g, name);
+    if (idx != -1) return idx;
+    return graph_append_node(g, name, valence, baseline);
+}
+
+/* ---------- Transition rules ----------
+   Clinician rules ("no direct step from class A into class B") are compiled into two
+   masks per node: the classes it belongs to and the classes it may not step into, so
+   checking a transition is one AND however many rules exist. Membership is kept by
+   name, so a CLASS line may list emotions that are created later; a hashed name ->
+   class mask map gives a new emotion its masks without scanning the classes. Edges
+   between existing emotions use the cached masks. A data file with no
+   CLASS/RULE lines gets the built-in rule: overwhelmed may not jump straight to a
+   positive state.
+*/
+
+static int rules_class_find(const RuleTable *r, const char *name) {
+    for (int i=0;i<r->count;++i) if (strcmp(r->classes[i].name, name) == 0) return i;
+    return -1;
+}
+
+/* Returns the class index, creating it if needed; -1 when the table is full. */
+static int rules_class_add(EmotionGraph *g, const char *name) {
+    RuleTable *r = &g->rules;
+    int c = rules_class_find(r, name);
+    if (c >= 0 || r->count == RULE_MAX_CLASSES) return c;
+    RuleClass *rc = &r->classes[r->count];
+    strncpy(rc->name, name, MAX_NAME_LEN-1); rc->name[MAX_NAME_LEN-1] = '\0';
+    rc->members = NULL; rc->members_count = rc->members_cap = 0; rc->forbid_to = 0;
+    return r->count++;
+}
+
+/* Slot of name in the member map: its entry, or the empty slot where it belongs. */
+static RuleMember *rules_member_slot(const RuleTable *r, const char *name) {
+    uint32_t mask = (uint32_t)r->by_name_cap - 1, i = (uint32_t)text_word_hash(name) & mask;
+    while (r->by_name[i].name && strcmp(r->by_name[i].name, name) != 0) i = (i + 1) & mask;
+    return &r->by_name[i];
+}
+
+static void rules_member_grow(RuleTable *r) {
+    RuleMember *old = r->by_name; int old_cap = r->by_name_cap;
+    r->by_name_cap = old_cap ? old_cap * 2 : 16;
+    r->by_name = realloc_or_die(NULL, 0, (size_t)r->by_name_cap, sizeof(RuleMember), MEM_OTHER);
+    memset(r->by_name, 0, sizeof(RuleMember) * (size_t)r->by_name_cap);
+    for (int i=0;i<old_cap;++i) if (old[i].name) *rules_member_slot(r, old[i].name) = old[i];
+    free_array(old, old_cap, sizeof(RuleMember), MEM_OTHER);
+}
+
+static uint64_t rules_classes_of_name(const RuleTable *r, const char *name) {
+    if (!r->by_name_cap) return 0;
+    const RuleMember *m = rules_member_slot(r, name);
+    return m->name ? m->classes : 0;
+}
+
+static uint64_t rules_forbid_of(const RuleTable *r, uint64_t classes) {
+    uint64_t f = 0;
+    for (uint64_t m = classes; m; ) { int c = msb_index(m); f |= r->classes[c].forbid_to; m &= ~((uint64_t)1 << c); }
+    return f;
+}
+
+static void rules_recompute_forbid(EmotionGraph *g) {
+    for (int i=0;i<g->count;++i) g->nodes[i].forbid = rules_forbid_of(&g->rules, g->nodes[i].classes);
+    graph_touch(g);
+}
+
+void rules_add_member(EmotionGraph *g, int c, const char *emotion) {
+    RuleTable *r = &g->rules; RuleClass *rc = &r->classes[c];
+    if (rules_classes_of_name(r, emotion) >> c & 1) return;
+    if (rc->members_count == rc->members_cap) {
+        int nc = rc->members_cap ? rc->members_cap * 2 : 4;
+        rc->members = realloc_or_die(rc->members, rc->members_cap, nc, sizeof(char *), MEM_OTHER);
+        rc->members_cap = nc;
+    }
+    char *member = rc->members[rc->members_count++] = strdup_s(emotion, MEM_OTHER);
+    if (2 * (r->by_name_count + 1) > r->by_name_cap) rules_member_grow(r);
+    RuleMember *m = rules_member_slot(r, member);
+    if (!m->name) { m->name = member; m->classes = 0; r->by_name_count++; }
+    m->classes |= (uint64_t)1 << c;
+    int idx = graph_find(g, emotion);
+    if (idx >= 0) {
+        EmotionNode *n = &g->nodes[idx];
+        n->classes |= (uint64_t)1 << c;
+        n->forbid = rules_forbid_of(&g->rules, n->classes);
+        graph_touch(g);
+    }
+}
+
+void rules_add_rule(EmotionGraph *g, int from_class, int to_class) {
+    g->rules.classes[from_class].forbid_to |= (uint64_t)1 << to_class;
+    rules_recompute_forbid(g);
+}
+
+/* Empties the table (every node loses its classes). */
+static void rules_clear(EmotionGraph *g) {
+    RuleTable *r = &g->rules;
+    for (int c=0;c<r->count;++c) {
+        RuleClass *rc = &r->classes[c];
+        for (int i=0;i<rc->members_count;++i) free_str(rc->members[i], MEM_OTHER);
+        free_array(rc->members, rc->members_cap, sizeof(char *), MEM_OTHER);
+    }
+    r->count = 0;
+    free_array(r->by_name, r->by_name_cap, sizeof(RuleMember), MEM_OTHER);
+    r->by_name = NULL; r->by_name_count = r->by_name_cap = 0;
+    for (int i=0;i<g->count;++i) g->nodes[i].classes = g->nodes[i].forbid = 0;
+    graph_touch(g);
+}
+
+static void rules_reset_defaults(EmotionGraph *g) {
+    rules_clear(g);
+    int overload = rules_class_add(g, "overload"), positive = rules_class_add(g, "positive");
+    rules_add_member(g, overload, "overwhelmed");
+    const char *goals[] = {"happy","calm","hopeful","peaceful"};
+    for (int i=0;i<4;++i) rules_add_member(g, positive, goals[i]);
+    rules_add_rule(g, overload, positive);
+}
+
+static int is_forbidden_transition(const EmotionGraph *g, int u, int v) {
+    return (g->nodes[u].forbid & g->nodes[v].classes) != 0;
+}
+
+/* Same check by name, for emotions that may not exist yet: existing ones use their
+   cached masks, the others the member map. */
+static int rules_forbid_resolved(const EmotionGraph *g, int u, const char *from, int v, const char *to) {
+    uint64_t f = u >= 0 ? g->nodes[u].forbid : rules_forbid_of(&g->rules, rules_classes_of_name(&g->rules, from));
+    return f && (f & (v >= 0 ? g->nodes[v].classes : rules_classes_of_name(&g->rules, to))) != 0;
+}
+
+int rules_forbid_names(EmotionGraph *g, const char *from, const char *to) {
+    return rules_forbid_resolved(g, graph_find(g, from), from, graph_find(g, to), to);
+}
+
+/* ---------- Goal sets ----------
+   The positive states a plan aims for are data: GOALSET lines name sets of emotions,
+   GOALS picks the active one (default: the first). Each set keeps its member names and
+   the node indices of members that exist; each node keeps a bit per set, so "is this a
+   goal?" is one shift and AND. Missing members are not created: a set member becomes a
+   goal when an emotion of that name is added.
+*/
+
+/* Members are unique by name, so each node is pushed at most once per set. */
+static void goal_set_push_node(GoalSet *gs, int idx) {
+    if (gs->nodes_count == gs->nodes_cap) {
+        int nc = gs->nodes_cap ? gs->nodes_cap * 2 : 4;
+        gs->nodes = realloc_or_die(gs->nodes, gs->nodes_cap, nc, sizeof(int), MEM_OTHER);
+        gs->nodes_cap = nc;
+    }
+    gs->nodes[gs->nodes_count++] = idx;
+}
+
+static void goals_attach_node(EmotionGraph *g, int idx) {
+    GoalTable *t = &g->goals; EmotionNode *n = &g->nodes[idx];
+    n->goal_sets = 0;
+    for (int s=0;s<t->count;++s)
+        for (int i=0;i<t->sets[s].members_count;++i)
+            if (strcmp(t->sets[s].members[i], n->name) == 0) {
+                n->goal_sets |= (uint64_t)1 << s;
+                goal_set_push_node(&t->sets[s], idx);
+                break;
+            }
+}
+
+int goals_find(const EmotionGraph *g, const char *name) {
+    for (int i=0;i<g->goals.count;++i) if (strcmp(g->goals.sets[i].name, name) == 0) return i;
+    return -1;
+}
+
+/* Returns the set index, creating it if needed; -1 when the table is full. */
+int goals_set_add(EmotionGraph *g, const char *name) {
+    GoalTable *t = &g->goals;
+    int s = goals_find(g, name);
+    if (s >= 0 || t->count == GOALSET_MAX) return s;
+    GoalSet *gs = &t->sets[t->count];
+    memset(gs, 0, sizeof(*gs));
+    strncpy(gs->name, name, MAX_NAME_LEN-1);
+    return t->count++;
+}
+
+void goals_add_member(EmotionGraph *g, int s, const char *emotion) {
+    GoalSet *gs = &g->goals.sets[s];
+    for (int i=0;i<gs->members_count;++i) if (strcmp(gs->members[i], emotion) == 0) return;
+    if (gs->members_count == gs->members_cap) {
+        int nc = gs->members_cap ? gs->members_cap * 2 : 4;
+        gs->members = realloc_or_die(gs->members, gs->members_cap, nc, sizeof(char *), MEM_OTHER);
+        gs->members_cap = nc;
+    }
+    gs->members[gs->members_count++] = strdup_s(emotion, MEM_OTHER);
+    int idx = graph_find(g, emotion);
+    if (idx >= 0) { g->nodes[idx].goal_sets |= (uint64_t)1 << s; goal_set_push_node(gs, idx); }
+}
+
+static void goals_clear(EmotionGraph *g) {
+    GoalTable *t = &g->goals;
+    for (int s=0;s<t->count;++s) {
+        GoalSet *gs = &t->sets[s];
+        for (int i=0;i<gs->members_count;++i) free_str(gs->members[i], MEM_OTHER);
+        free_array(gs->members, gs->members_cap, sizeof(char *), MEM_OTHER);
+        free_array(gs->nodes, gs->nodes_cap, sizeof(int), MEM_OTHER);
+    }
+    t->count = 0; t->active = 0;
+    for (int i=0;i<g->count;++i) g->nodes[i].goal_sets = 0;
+}
+
+static void goals_reset_defaults(EmotionGraph *g) {
+    goals_clear(g);
+    int s = goals_set_add(g, "default");
+    const char *names[] = {"happy","calm","peaceful","hopeful"};
+    for (int i=0;i<4;++i) goals_add_member(g, s, names[i]);
+}
+
+/* Node indices of the active set's existing members. */
+static int goals_active(const EmotionGraph *g, const int **out) {
+    const GoalSet *gs = &g->goals.sets[g->goals.active];
+    *out = gs->nodes;
+    return g->goals.count ? gs->nodes_count : 0;
+}
+
+static int is_goal(const EmotionGraph *g, int v) {
+    return (int)(g->nodes[v].goal_sets >> g->goals.active & 1);
+}
+
+/* ---------- Aliases ---------- */
+
+/* The first alias for a surface form wins; one that spells an emotion's own name is
+   kept (and saved) but the emotion takes precedence. */
+void aliases_add(EmotionGraph *g, const char *surface, const char *canonical) {
+    AliasTable *t = &g->aliases;
+    if (t->count == t->cap) {
+        int nc = t->cap ? t->cap * 2 : 8;
+        t->items = realloc_or_die(t->items, t->cap, nc, sizeof(Alias), MEM_OTHER);
+        t->cap = nc;
+    }
+    t->items[t->count].surface = strdup_s(surface, MEM_OTHER);
+    t->items[t->count].canonical = strdup_s(canonical, MEM_OTHER);
+    t->count++;
+    name_hash_free(g);
+}
+
+static void aliases_clear(EmotionGraph *g) {
+    AliasTable *t = &g->aliases;
+    for (int i=0;i<t->count;++i) { free_str(t->items[i].surface, MEM_OTHER); free_str(t->items[i].canonical, MEM_OTHER); }
+    free_array(t->items, t->cap, sizeof(Alias), MEM_OTHER);
+    t->items = NULL; t->count = 0; t->cap = 0;
+    name_hash_free(g);
+}
+
+static Edge *graph_find_arc(EmotionGraph *g, int u, int v) {
+    EmotionNode *nu = &g->nodes[u];
+    for (int e=0;e<nu->edges_count;++e) if (nu->edges[e].to == v) return &nu->edges[e];
+    return NULL;
+}
+
+static void graph_push_arc(EmotionGraph *g, int u, int v, float weight, const char *procedure, int reverse) {
+    EmotionNode *nu = &g->nodes[u];
+    ensure_edge_capacity(nu);
+    Edge *e = &nu->edges[nu->edges_count++];
+    e->to = v;
+    e->weight = (weight < 0.0f) ? 0.0f : weight;
+    e->procedure = procedure ? strdup_s(procedure, MEM_PROCEDURES) : NULL;
+    e->reverse = (unsigned char)reverse;
+    e->doc = text_index_add(g, TEXT_PROCEDURE, u, nu->edges_count - 1, e->procedure);
+    g->arcs++;
+    graph_touch(g);
+}
+
+/* Index-based edge insertion shared by graph_add_edge and the synthetic graph builders.
+   Adding an existing transition again is a no-op, except that an automatic mirror arc
+   becomes a real one (with the given weight and procedure) so it is saved. */
+static void graph_add_edge_idx(EmotionGraph *g, int u, int v, float weight, const char *procedure) {
+    // Refuse transitions the rule table forbids (e.g. overwhelmed -> happy); the system
+    // prefers routing overwhelmed -> grounded -> calm/happy
+    if (is_forbidden_transition(g, u, v)) return;
+
+    Edge *existing = graph_find_arc(g, u, v);
+    if (existing && existing->reverse) {
+        existing->weight = (weight < 0.0f) ? 0.0f : weight;
+        if (existing->procedure) free_str(existing->procedure, MEM_PROCEDURES);
+        existing->procedure = procedure ? strdup_s(procedure, MEM_PROCEDURES) : NULL;
+        existing->reverse = 0;
+        text_index_retire(g, existing->doc);
+        existing->doc = text_index_add(g, TEXT_PROCEDURE, u, (int)(existing - g->nodes[u].edges), existing->procedure);
+        graph_touch(g);
+    } else if (!existing) {
+        graph_push_arc(g, u, v, weight, procedure, 0);
+    }
+
+    // Add reverse edge for undirected feel (reverse procedure not set); the mirror of
+    // e.g. happy -> overwhelmed would itself be a forbidden jump, so it is skipped
+    if (!is_forbidden_transition(g, v, u) && !graph_find_arc(g, v, u))
+        graph_push_arc(g, v, u, weight, NULL, 1);
+}
+
+void graph_add_edge(EmotionGraph *g, const char *from, const char *to, float weight, const char *procedure) {
+    // Check the rules before creating any nodes
+    int u = graph_find(g, from), v = graph_find(g, to);
+    if (rules_forbid_resolved(g, u, from, v, to)) return;
+
+    if (u == -1) u = graph_add_node(g, from, -0.5f, 5.0f);
+    if (v == -1) v = graph_add_node(g, to, 0.0f, 5.0f);
+    graph_add_edge_idx(g, u, v, weight, procedure);
+}
+
+static void graph_add_tip_idx(EmotionGraph *g, int idx, const char *tip_text) {
+    EmotionNode *n = &g->nodes[idx];
+    ensure_tip_capacity(n);
+    Tip *t = &n->tips[n->tips_count++];
+    t->text = strdup_s(tip_text, MEM_TIPS);
+    t->doc = text_index_add(g, TEXT_TIP, idx, n->tips_count - 1, t->text);
+    t->sim = tip_simhash(t->text);
+    t->tried = t->helped = 0;
+    t->day = tip_today();
+    t->rank = tip_rank(t);
+    tip_top_offer(n, n->tips_count - 1);
+    graph_touch(g);   /* a node's first tip makes it cheaper to reach */
+}
+
+/* Replaces (or with NULL removes) the procedure on arc ei of node u. */
+static void graph_set_procedure(EmotionGraph *g, int u, int ei, const char *procedure) {
+    Edge *e = &g->nodes[u].edges[ei];
+    if (e->procedure) { free_str(e->procedure, MEM_PROCEDURES); e->procedure = NULL; }
+    if (procedure) e->procedure = strdup_s(procedure, MEM_PROCEDURES);
+    e->reverse = 0;   /* an edited mirror arc is now a user transition */
+    text_index_retire(g, e->doc);
+    e->doc = text_index_add(g, TEXT_PROCEDURE, u, ei, e->procedure);
+    graph_touch(g);
+}
+
+EmotionNode *graph_add_tip(EmotionGraph *g, const char *emotion, const char *tip_text) {
+    int idx = graph_find(g, emotion);
+    if (idx == -1) idx = graph_add_node(g, emotion, -0.2f, 5.0f);
+    graph_add_tip_idx(g, idx, tip_text);
+    return &g->nodes[idx];
+}
+
+void graph_clear(EmotionGraph *g);
+
+/* ---------- Name suggestions (trigram index) ----------
+   Typos should not become new emotions. Every name is split into case-folded
+   trigrams (padded: "^^a", "^an", ..., "us$"); each trigram hashes to a posting list
+   of node indices. A query counts shared trigrams per node with one pass over its own
+   posting lists, keeps the best few by Dice score and re-ranks them by edit distance.
+   Nodes are only ever appended, so the index catches up lazily; graph_clear drops it.
+*/
+
+#define NAME_TRIGRAM_BUCKETS (1 << 16)
+#define NAME_SUGGEST_CANDIDATES 8
+
+typedef struct { int *ids; int count, cap; } NamePosting;
+
+struct NameIndex {
+    NamePosting *buckets;
+    int indexed;                   /* nodes [0, indexed) are in the index */
+    unsigned *stamp; unsigned short *hits; int *touched; int scratch_cap;
+    unsigned epoch;
+};
+
+/* Distinct trigram hashes of a name; returns how many (at most MAX_NAME_LEN + 1). */
+static int name_trigrams(const char *name, unsigned *out) {
+    char buf[MAX_NAME_LEN + 3];
+    int len = 0;
+    buf[len++] = '^'; buf[len++] = '^';
+    for (const char *p = name; *p && len < MAX_NAME_LEN + 1; ++p) buf[len++] = (char)tolower((unsigned char)*p);
+    buf[len++] = '$';
+    int n = 0;
+    for (int i=0;i+2<len;++i) {
+        unsigned h = ((unsigned char)buf[i] * 961u + (unsigned char)buf[i+1] * 31u + (unsigned char)buf[i+2]) & (NAME_TRIGRAM_BUCKETS - 1);
+        int dup = 0;
+        for (int k=0;k<n && !dup;++k) dup = out[k] == h;
+        if (!dup) out[n++] = h;
+    }
+    return n;
+}
+
+static void name_index_free(EmotionGraph *g) {
+    struct NameIndex *ix = g->name_index;
+    if (!ix) return;
+    for (int b=0;b<NAME_TRIGRAM_BUCKETS;++b) free_array(ix->buckets[b].ids, ix->buckets[b].cap, sizeof(int), MEM_OTHER);
+    free_array(ix->buckets, NAME_TRIGRAM_BUCKETS, sizeof(NamePosting), MEM_OTHER);
+    free_array(ix->stamp, ix->scratch_cap, sizeof(unsigned), MEM_OTHER);
+    free_array(ix->hits, ix->scratch_cap, sizeof(unsigned short), MEM_OTHER);
+    free_array(ix->touched, ix->scratch_cap, sizeof(int), MEM_OTHER);
+    free_array(ix, 1, sizeof(*ix), MEM_OTHER);
+    g->name_index = NULL;
+}
+
+static struct NameIndex *name_index_sync(EmotionGraph *g) {
+    struct NameIndex *ix = g->name_index;
+    if (!ix) {
+        ix = realloc_or_die(NULL, 0, 1, sizeof(*ix), MEM_OTHER);
+        memset(ix, 0, sizeof(*ix));
+        ix->buckets = realloc_or_die(NULL, 0, NAME_TRIGRAM_BUCKETS, sizeof(NamePosting), MEM_OTHER);
+        memset(ix->buckets, 0, sizeof(NamePosting) * NAME_TRIGRAM_BUCKETS);
+        g->name_index = ix;
+    }
+    if (ix->indexed == g->count) return ix;
+    unsigned tri[MAX_NAME_LEN + 1];
+    for (int i=ix->indexed;i<g->count;++i) {
+        int nt = name_trigrams(g->nodes[i].name, tri);
+        for (int k=0;k<nt;++k) {
+            NamePosting *p = &ix->buckets[tri[k]];
+            if (p->count == p->cap) {
+                int nc = p->cap ? p->cap * 2 : 4;
+                p->ids = realloc_or_die(p->ids, p->cap, nc, sizeof(int), MEM_OTHER);
+                p->cap = nc;
+            }
+            p->ids[p->count++] = i;
+        }
+    }
+    ix->indexed = g->count;
+    if (g->count > ix->scratch_cap) {
+        int old = ix->scratch_cap, nc = g->count * 2;
+        ix->stamp = realloc_or_die(ix->stamp, old, nc, sizeof(unsigned), MEM_OTHER);
+        ix->hits = realloc_or_die(ix->hits, old, nc, sizeof(unsigned short), MEM_OTHER);
+        ix->touched = realloc_or_die(ix->touched, old, nc, sizeof(int), MEM_OTHER);
+        memset(ix->stamp + old, 0, sizeof(unsigned) * (size_t)(nc - old));
+        ix->scratch_cap = nc;
+    }
+    return ix;
+}
+
+/* Case-insensitive Levenshtein distance. */
+static int name_edit_distance(const char *a, const char *b) {
+    int la = (int)strlen(a), lb = (int)strlen(b);
+    int row[MAX_NAME_LEN + 1];
+    if (la > MAX_NAME_LEN) la = MAX_NAME_LEN;
+    if (lb > MAX_NAME_LEN) lb = MAX_NAME_LEN;
+    for (int j=0;j<=lb;++j) row[j] = j;
+    for (int i=1;i<=la;++i) {
+        int diag = row[0]; row[0] = i;
+        for (int j=1;j<=lb;++j) {
+            int up = row[j];
+            int sub = diag + (tolower((unsigned char)a[i-1]) != tolower((unsigned char)b[j-1]));
+            int best = up + 1 < row[j-1] + 1 ? up + 1 : row[j-1] + 1;
+            row[j] = sub < best ? sub : best;
+            diag = up;
+        }
+    }
+    return row[lb];
+}
+
+/* Closest existing emotion to a name that is not in the map, or -1 when nothing is
+   close: within a couple of edits, or sharing at least half of its trigrams. */
+int graph_suggest_name(EmotionGraph *g, const char *name) {
+    if (g->count == 0 || !*name) return -1;
+    TRACE_BEGIN(t0);
+    struct NameIndex *ix = name_index_sync(g);
+    unsigned tri[MAX_NAME_LEN + 1];
+    int nt = name_trigrams(name, tri), ntouched = 0;
+    if (++ix->epoch == 0) { memset(ix->stamp, 0, sizeof(unsigned) * (size_t)ix->scratch_cap); ix->epoch = 1; }
+    for (int k=0;k<nt;++k) {
+        const NamePosting *p = &ix->buckets[tri[k]];
+        for (int i=0;i<p->count;++i) {
+            int id = p->ids[i];
+            if (ix->stamp[id] != ix->epoch) { ix->stamp[id] = ix->epoch; ix->hits[id] = 0; ix->touched[ntouched++] = id; }
+            ix->hits[id]++;
+        }
+    }
+    /* keep the best few by Dice coefficient (hash collisions only ever add hits) */
+    int cand[NAME_SUGGEST_CANDIDATES]; float dice[NAME_SUGGEST_CANDIDATES]; int nc = 0;
+    for (int t=0;t<ntouched;++t) {
+        int id = ix->touched[t];
+        int len = (int)strlen(g->nodes[id].name);
+        float d = 2.0f * ix->hits[id] / (float)(nt + (len < MAX_NAME_LEN ? len : MAX_NAME_LEN) + 1);
+        if (nc < NAME_SUGGEST_CANDIDATES) { cand[nc] = id; dice[nc++] = d; }
+        else {
+            int worst = 0;
+            for (int k=1;k<nc;++k) if (dice[k] < dice[worst]) worst = k;
+            if (d > dice[worst]) { cand[worst] = id; dice[worst] = d; }
+        }
+    }
+    int best = -1, best_dist = 0; float best_dice = 0.0f;
+    int max_dist = (int)strlen(name) / 4 + 1;
+    for (int k=0;k<nc;++k) {
+        int dist = name_edit_distance(name, g->nodes[cand[k]].name);
+        if (dist > max_dist && dice[k] < 0.5f) continue;
+        if (best < 0 || dist < best_dist || (dist == best_dist && dice[k] > best_dice)) { best = cand[k]; best_dist = dist; best_dice = dice[k]; }
+    }
+    TRACE_END("name_suggest", t0);
+    return best;
+}
+
+/* ---------- Free-text detection (Aho-Corasick) ----------
+   "I'm totally swamped and kind of lonely" -> overwhelmed, lonely. Names, aliases and
+   KEYWORD phrases are patterns in one Aho-Corasick automaton, so a text of any length
+   is scanned once whatever the size of the lexicon. Text and patterns are folded the
+   same way (lowercase letters and digits, every other run of characters becomes one
+   space, padded with a space at each end), which also makes every match whole words.
+   A match inside a longer one ("stressed" in "stressed out") is dropped. Walking back
+   from a match, intensifiers ("very", "so") and filler words ("feel", "at all") are
+   skipped: a negation ("not", "never", "don't") within two other words cancels the
+   match, and an intensifier before the first other word makes it count half as much
+   again. The walk stops at the start of the clause (sentence punctuation, "but",
+   "and"), so "not tired, but sad" still finds sad. The automaton is rebuilt when
+   an emotion, alias or keyword has been added since the last scan.
+*/
+
+#define DETECT_MAX_HITS 8
+
+typedef struct { int node; float score; } DetectHit;
+
+typedef struct { int first_child, next_sibling, fail, dict, pattern; unsigned char ch; } LexState;
+typedef struct { int node, len; float weight; } LexPattern;
+typedef struct { int start, end; int pattern; } LexMatch;
+
+struct Lexicon {
+    LexState *states; int nstates, states_cap;
+    LexPattern *patterns; int npatterns, patterns_cap;
+    int root_next[256];
+    int built_nodes, built_aliases, built_keywords;
+    char *text; int text_cap;                       /* folded input */
+    LexMatch *matches; int matches_cap;
+    unsigned *stamp; float *score; int *touched; int scratch_cap;
+    unsigned epoch;
+};
+
+void keywords_add(EmotionGraph *g, const char *phrase, const char *emotion, float weight) {
+    KeywordTable *t = &g->keywords;
+    if (t->count == t->cap) {
+        int nc = t->cap ? t->cap * 2 : 8;
+        t->items = realloc_or_die(t->items, t->cap, nc, sizeof(Keyword), MEM_OTHER);
+        t->cap = nc;
+    }
+    t->items[t->count].phrase = strdup_s(phrase, MEM_OTHER);
+    t->items[t->count].emotion = strdup_s(emotion, MEM_OTHER);
+    t->items[t->count].weight = weight;
+    t->count++;
+}
+
+static void keywords_clear(EmotionGraph *g) {
+    KeywordTable *t = &g->keywords;
+    for (int i=0;i<t->count;++i) { free_str(t->items[i].phrase, MEM_OTHER); free_str(t->items[i].emotion, MEM_OTHER); }
+    free_array(t->items, t->cap, sizeof(Keyword), MEM_OTHER);
+    t->items = NULL; t->count = 0; t->cap = 0;
+}
+
+/* Folds text into buf as " word word " and returns its length. With clauses set, a
+   run holding sentence punctuation becomes " . ", a word of its own that no pattern
+   contains (buf then needs 3 * strlen(text) + 3 bytes). */
+static int lex_fold_marked(const char *text, char *buf, int cap, int clauses) {
+    int n = 0;
+    buf[n++] = ' ';
+    for (const char *p = text; *p && n < cap - (clauses ? 4 : 2); ++p) {
+        unsigned char c = (unsigned char)*p;
+        if (isalnum(c)) buf[n++] = (char)tolower(c);
+        else {
+            if (buf[n-1] != ' ') buf[n++] = ' ';
+            if (clauses && strchr(".,;:!?", c) && (n < 2 || buf[n-2] != '.')) { buf[n++] = '.'; buf[n++] = ' '; }
+        }
+    }
+    if (buf[n-1] != ' ') buf[n++] = ' ';
+    buf[n] = '\0';
+    return n;
+}
+
+static int lex_fold(const char *text, char *buf, int cap) { return lex_fold_marked(text, buf, cap, 0); }
+
+static void lexicon_free(EmotionGraph *g) {
+    struct Lexicon *lx = g->lexicon;
+    if (!lx) return;
+    free_array(lx->states, lx->states_cap, sizeof(LexState), MEM_OTHER);
+    free_array(lx->patterns, lx->patterns_cap, sizeof(LexPattern), MEM_OTHER);
+    free_array(lx->text, lx->text_cap, 1, MEM_OTHER);
+    free_array(lx->matches, lx->matches_cap, sizeof(LexMatch), MEM_OTHER);
+    free_array(lx->stamp, lx->scratch_cap, sizeof(unsigned), MEM_OTHER);
+    free_array(lx->score, lx->scratch_cap, sizeof(float), MEM_OTHER);
+    free_array(lx->touched, lx->scratch_cap, sizeof(int), MEM_OTHER);
+    free_array(lx, 1, sizeof(*lx), MEM_OTHER);
+    g->lexicon = NULL;
+}
+
+static int lex_child(const struct Lexicon *lx, int s, unsigned char c) {
+    if (s == 0) return lx->root_next[c];
+    for (int k = lx->states[s].first_child; k > 0; k = lx->states[k].next_sibling)
+        if (lx->states[k].ch == c) return k;
+    return -1;
+}
+
+static int lex_new_state(struct Lexicon *lx, int parent, unsigned char c) {
+    if (lx->nstates == lx->states_cap) {
+        int nc = lx->states_cap ? lx->states_cap * 2 : 256;
+        lx->states = realloc_or_die(lx->states, lx->states_cap, nc, sizeof(LexState), MEM_OTHER);
+        lx->states_cap = nc;
+    }
+    int s = lx->nstates++;
+    lx->states[s] = (LexState){ 0, 0, 0, 0, -1, c };
+    if (parent == 0) lx->root_next[c] = s;
+    else if (parent > 0) { lx->states[s].next_sibling = lx->states[parent].first_child; lx->states[parent].first_child = s; }
+    return s;
+}
+
+/* The first pattern to reach a state keeps it: names before aliases before keywords. */
+static void lex_add_pattern(struct Lexicon *lx, const char *phrase, int node, float weight) {
+    char buf[MAX_LINE];
+    int len = lex_fold(phrase, buf, sizeof(buf));
+    if (len < 3) return;   /* nothing but separators */
+    int s = 0;
+    for (int i=0;i<len;++i) {
+        int next = lex_child(lx, s, (unsigned char)buf[i]);
+        s = next >= 0 ? next : lex_new_state(lx, s, (unsigned char)buf[i]);
+    }
+    if (lx->states[s].pattern >= 0) return;
+    if (lx->npatterns == lx->patterns_cap) {
+        int nc = lx->patterns_cap ? lx->patterns_cap * 2 : 64;
+        lx->patterns = realloc_or_die(lx->patterns, lx->patterns_cap, nc, sizeof(LexPattern), MEM_OTHER);
+        lx->patterns_cap = nc;
+    }
+    lx->states[s].pattern = lx->npatterns;
+    lx->patterns[lx->npatterns++] = (LexPattern){ node, len, weight };
+}
+
+static struct Lexicon *lexicon_sync(EmotionGraph *g) {
+    struct Lexicon *lx = g->lexicon;
+    if (lx && lx->built_nodes == g->count && lx->built_aliases == g->aliases.count && lx->built_keywords == g->keywords.count) return lx;
+    lexicon_free(g);
+    TRACE_BEGIN(t0);
+    lx = realloc_or_die(NULL, 0, 1, sizeof(*lx), MEM_OTHER);
+    memset(lx, 0, sizeof(*lx));
+    for (int c=0;c<256;++c) lx->root_next[c] = -1;
+    lex_new_state(lx, -1, 0);   /* root */
+    for (int i=0;i<g->count;++i) lex_add_pattern(lx, g->nodes[i].name, i, 1.0f);
+    for (int i=0;i<g->aliases.count;++i) {
+        int v = graph_find(g, g->aliases.items[i].canonical);
+        if (v >= 0) lex_add_pattern(lx, g->aliases.items[i].surface, v, 1.0f);
+    }
+    for (int i=0;i<g->keywords.count;++i) {
+        int v = graph_find(g, g->keywords.items[i].emotion);
+        if (v >= 0) lex_add_pattern(lx, g->keywords.items[i].phrase, v, g->keywords.items[i].weight);
+    }
+
+    /* failure and dictionary links, breadth first; the root loops to itself */
+    int *queue = realloc_or_die(NULL, 0, (size_t)lx->nstates, sizeof(int), MEM_OTHER);
+    int qh = 0, qt = 0;
+    for (int c=0;c<256;++c) {
+        int k = lx->root_next[c];
+        if (k > 0) { lx->states[k].fail = 0; lx->states[k].dict = 0; queue[qt++] = k; }
+        else lx->root_next[c] = 0;
+    }
+    while (qh < qt) {
+        int s = queue[qh++];
+        for (int k = lx->states[s].first_child; k > 0; k = lx->states[k].next_sibling) {
+            unsigned char c = lx->states[k].ch;
+            int f = lx->states[s].fail, next;
+            while ((next = lex_child(lx, f, c)) < 0) f = lx->states[f].fail;
+            lx->states[k].fail = next;
+            lx->states[k].dict = lx->states[next].pattern >= 0 ? next : lx->states[next].dict;
+            queue[qt++] = k;
+        }
+    }
+    free_array(queue, (size_t)lx->nstates, sizeof(int), MEM_OTHER);
+
+    lx->built_nodes = g->count; lx->built_aliases = g->aliases.count; lx->built_keywords = g->keywords.count;
+    lx->scratch_cap = g->count;
+    lx->stamp = realloc_or_die(NULL, 0, (size_t)lx->scratch_cap, sizeof(unsigned), MEM_OTHER);
+    lx->score = realloc_or_die(NULL, 0, (size_t)lx->scratch_cap, sizeof(float), MEM_OTHER);
+    lx->touched = realloc_or_die(NULL, 0, (size_t)lx->scratch_cap, sizeof(int), MEM_OTHER);
+    memset(lx->stamp, 0, sizeof(unsigned) * (size_t)lx->scratch_cap);
+    g->lexicon = lx;
+    TRACE_END("lexicon_build", t0);
+    return lx;
+}
+
+/* The word that ends just before position pos of folded text (pos is a word start). */
+static int lex_word_before(const char *text, int pos, int *start) {
+    int end = pos - 1;   /* the space before the word at pos */
+    int b = end;
+    while (b > 0 && text[b-1] != ' ') --b;
+    *start = b;
+    return end - b;
+}
+
+/* How the words before a match affect it. */
+enum { LEX_OTHER, LEX_NEGATOR, LEX_INTENSIFIER, LEX_FILLER, LEX_CLAUSE };
+
+typedef struct { const char *word; int len, kind; } LexWordKind;
+#define LEX_W(w, k) { w, (int)sizeof(w) - 1, k }
+
+static const LexWordKind lex_word_kinds[] = {
+    LEX_W("not", LEX_NEGATOR), LEX_W("no", LEX_NEGATOR), LEX_W("never", LEX_NEGATOR),
+    LEX_W("t", LEX_NEGATOR), LEX_W("without", LEX_NEGATOR), LEX_W("hardly", LEX_NEGATOR),   /* "t": don't, isn't */
+    LEX_W("very", LEX_INTENSIFIER), LEX_W("really", LEX_INTENSIFIER), LEX_W("so", LEX_INTENSIFIER),
+    LEX_W("totally", LEX_INTENSIFIER), LEX_W("extremely", LEX_INTENSIFIER), LEX_W("super", LEX_INTENSIFIER),
+    LEX_W("completely", LEX_INTENSIFIER), LEX_W("incredibly", LEX_INTENSIFIER),
+    LEX_W(".", LEX_CLAUSE), LEX_W("but", LEX_CLAUSE), LEX_W("and", LEX_CLAUSE), LEX_W("or", LEX_CLAUSE),
+    LEX_W("though", LEX_CLAUSE), LEX_W("although", LEX_CLAUSE), LEX_W("because", LEX_CLAUSE),
+    LEX_W("yet", LEX_CLAUSE), LEX_W("however", LEX_CLAUSE), LEX_W("while", LEX_CLAUSE),
+    LEX_W("i", LEX_FILLER), LEX_W("m", LEX_FILLER), LEX_W("im", LEX_FILLER), LEX_W("am", LEX_FILLER),
+    LEX_W("is", LEX_FILLER), LEX_W("are", LEX_FILLER), LEX_W("was", LEX_FILLER), LEX_W("were", LEX_FILLER),
+    LEX_W("be", LEX_FILLER), LEX_W("been", LEX_FILLER), LEX_W("being", LEX_FILLER), LEX_W("s", LEX_FILLER),
+    LEX_W("ve", LEX_FILLER), LEX_W("d", LEX_FILLER), LEX_W("ll", LEX_FILLER), LEX_W("feel", LEX_FILLER),
+    LEX_W("feels", LEX_FILLER), LEX_W("feeling", LEX_FILLER), LEX_W("felt", LEX_FILLER), LEX_W("get", LEX_FILLER),
+    LEX_W("getting", LEX_FILLER), LEX_W("got", LEX_FILLER), LEX_W("at", LEX_FILLER), LEX_W("all", LEX_FILLER),
+    LEX_W("a", LEX_FILLER), LEX_W("bit", LEX_FILLER), LEX_W("little", LEX_FILLER), LEX_W("kind", LEX_FILLER),
+    LEX_W("sort", LEX_FILLER), LEX_W("of", LEX_FILLER), LEX_W("too", LEX_FILLER), LEX_W("quite", LEX_FILLER),
+    LEX_W("that", LEX_FILLER), LEX_W("this", LEX_FILLER), LEX_W("the", LEX_FILLER), LEX_W("just", LEX_FILLER),
+    LEX_W("even", LEX_FILLER), LEX_W("any", LEX_FILLER), LEX_W("anymore", LEX_FILLER), LEX_W("more", LEX_FILLER),
+    LEX_W("much", LEX_FILLER), LEX_W("as", LEX_FILLER),
+};
+
+#define LEX_KIND_SLOTS 256   /* open addressing over lex_word_kinds; index + 1, 0 = empty */
+static unsigned char lex_kind_slot[LEX_KIND_SLOTS];
+
+static uint32_t lex_kind_hash(const char *w, int len) {
+    uint32_t h = 2166136261u;
+    for (int i=0;i<len;++i) { h ^= (unsigned char)w[i]; h *= 16777619u; }
+    return h & (LEX_KIND_SLOTS - 1);
+}
+
+static int lex_word_kind(const char *text, int start, int len) {
+    int nkinds = (int)(sizeof(lex_word_kinds) / sizeof(lex_word_kinds[0]));
+    if (!lex_kind_slot[lex_kind_hash(lex_word_kinds[0].word, lex_word_kinds[0].len)])
+        for (int i=0;i<nkinds;++i) {
+            uint32_t h = lex_kind_hash(lex_word_kinds[i].word, lex_word_kinds[i].len);
+            while (lex_kind_slot[h]) h = (h + 1) & (LEX_KIND_SLOTS - 1);
+            lex_kind_slot[h] = (unsigned char)(i + 1);
+        }
+    for (uint32_t h = lex_kind_hash(text + start, len); lex_kind_slot[h]; h = (h + 1) & (LEX_KIND_SLOTS - 1)) {
+        const LexWordKind *k = &lex_word_kinds[lex_kind_slot[h] - 1];
+        if (k->len == len && memcmp(text + start, k->word, (size_t)len) == 0) return k->kind;
+    }
+    return LEX_OTHER;
+}
+
+/* Fills hits[] with the emotions the text mentions, strongest first; returns how many. */
+int detect_emotions(EmotionGraph *g, const char *text, DetectHit hits[], int max_hits) {
+    if (g->count == 0 || max_hits < 1) return 0;
+    TRACE_BEGIN(t0);
+    struct Lexicon *lx = lexicon_sync(g);
+    int need = 3 * (int)strlen(text) + 3;
+    if (need > lx->text_cap) {
+        lx->text = realloc_or_die(lx->text, lx->text_cap, need, 1, MEM_OTHER);
+        lx->text_cap = need;
+    }
+    int n = lex_fold_marked(text, lx->text, need, 1), nm = 0;
+    const char *t = lx->text;
+
+    /* one pass; matches arrive in order of their end, longest first at each end */
+    for (int i=0, s=0; i<n; ++i) {
+        unsigned char c = (unsigned char)t[i];
+        int next;
+        while ((next = lex_child(lx, s, c)) < 0) s = lx->states[s].fail;
+        s = next;
+        for (int o = lx->states[s].pattern >= 0 ? s : lx->states[s].dict; o > 0; o = lx->states[o].dict) {
+            int pi = lx->states[o].pattern;
+            LexMatch m = { i + 1 - lx->patterns[pi].len, i + 1, pi };
+            while (nm > 0 && lx->matches[nm-1].start >= m.start) --nm;   /* inside this one */
+            if (nm > 0 && m.start >= lx->matches[nm-1].start && m.end <= lx->matches[nm-1].end) continue;
+            if (nm == lx->matches_cap) {
+                int nc = lx->matches_cap ? lx->matches_cap * 2 : 32;
+                lx->matches = realloc_or_die(lx->matches, lx->matches_cap, nc, sizeof(LexMatch), MEM_OTHER);
+                lx->matches_cap = nc;
+            }
+            lx->matches[nm++] = m;
+        }
+    }
+
+    if (++lx->epoch == 0) { memset(lx->stamp, 0, sizeof(unsigned) * (size_t)lx->scratch_cap); lx->epoch = 1; }
+    int ntouched = 0;
+    for (int k=0;k<nm;++k) {
+        const LexMatch *m = &lx->matches[k];
+        const LexPattern *pat = &lx->patterns[m->pattern];
+        float w = pat->weight;
+        int ws, wl = m->start > 0 ? lex_word_before(t, m->start + 1, &ws) : 0, others = 0, boost = 0;
+        for (int back=0; back<8 && wl > 0 && others < 2; ++back) {   /* "not sad", "never felt so down" */
+            int kind = lex_word_kind(t, ws, wl);
+            if (kind == LEX_CLAUSE) break;
+            if (kind == LEX_NEGATOR) { w = 0.0f; break; }
+            if (kind == LEX_INTENSIFIER) boost |= others == 0;
+            else if (kind == LEX_OTHER) ++others;
+            wl = ws > 0 ? lex_word_before(t, ws, &ws) : 0;
+        }
+        if (boost) w *= 1.5f;
+        if (w <= 0.0f) continue;
+        if (lx->stamp[pat->node] != lx->epoch) { lx->stamp[pat->node] = lx->epoch; lx->score[pat->node] = 0.0f; lx->touched[ntouched++] = pat->node; }
+        lx->score[pat->node] += w;
+    }
+
+    /* strongest first; ties go to the earlier emotion */
+    int nh = 0;
+    for (int k=0;k<ntouched;++k) {
+        DetectHit h = { lx->touched[k], lx->score[lx->touched[k]] };
+        int pos = nh < max_hits ? nh++ : max_hits;
+        while (pos > 0 && (hits[pos-1].score < h.score || (hits[pos-1].score == h.score && hits[pos-1].node > h.node))) {
+            if (pos < max_hits) hits[pos] = hits[pos-1];
+            --pos;
+        }
+        if (pos < max_hits) hits[pos] = h;
+    }
+    TRACE_END("detect", t0);
+    return nh;
+}
+
+/* ---------- Friendly printing (no internals) ---------- */
+
+void graph_print_friendly(EmotionGraph *g) {
+    printf("Current emotional map (%d emotions):\n", g->count);
+    for (int i=0;i<g->count;++i) {
+        EmotionNode *n = &g->nodes[i];
+        printf(" - %s", n->name);
+        if (n->tips_count > 0) printf("  (tips: %d)", n->tips_count);
+        printf("\n");
+        for (int e=0;e<n->edges_count;++e) {
+            printf("     -> %s", g->nodes[n->edges[e].to].name);
+            if (n->edges[e].procedure) printf("  (action)");
+            printf("\n");
+        }
+    }
+}
+
+/* ---------- ASCII graph visualization ---------- */
+
+void graph_print_ascii(EmotionGraph *g) {
+    printf("\n=== ASCII Graph View ===\n");
+    for (int i = 0; i < g->count; i++) {
+        EmotionNode *n = &g->nodes[i];
+        printf("\n[%s]\n", n->name);
+
+        if (n->tips_count > 0) {
+            printf("  Tips:\n");
+            for (int t = 0; t < n->tips_count; ++t) {
+                printf("    - %s\n", n->tips[t].text);
+            }
+        }
+
+        if (n->edges_count == 0) {
+            printf("  (no connections)\n");
+            continue;
+        }
+
+        for (int e = 0; e < n->edges_count; e++) {
+            Edge *ed = &n->edges[e];
+            printf("   |-- %s", g->nodes[ed->to].name);
+            if (ed->procedure)
+                printf("  (action: %s)", ed->procedure);
+            printf("  [weight: %.2f]\n", ed->weight);
+        }
+    }
+    printf("\n=========================\n");
+}
+
+/* ---------- Assessment prototypes & selection ---------- */
+
+typedef struct { char name[MAX_NAME_LEN]; float stress, overwhelm, anger, sadness; } Prototype;
+
+/* Check-in prototypes: typical (stress, overwhelm, anger, sadness) ratings per emotion. */
+static Prototype default_protos[] = {
+    {"anxious", 7, 6, 2, 3},
+    {"sad", 3, 3, 1, 8},
+    {"angry", 4, 2, 8, 2},
+    {"overwhelmed", 8, 9, 3, 6},
+    {"lonely", 2, 3, 1, 6},
+    {"calm", 1, 1, 0, 0},
+    {"hopeful", 1, 1, 0, 1},
+    {"happy", 0, 0, 0, 0}
+};
+#define DEFAULT_PROTO_COUNT ((int)(sizeof(default_protos)/sizeof(default_protos[0])))
+
+int choose_closest_prototype(float s, float o, float a, float sd, Prototype *protos, int pcount) {
+    float bestd = FLT_MAX; int best = 0;
+    for (int i=0;i<pcount;++i) {
+        float ds = s - protos[i].stress;
+        float doo = o - protos[i].overwhelm;
+        float da = a - protos[i].anger;
+        float dsd = sd - protos[i].sadness;
+        float dist = ds*ds + doo*doo + da*da + dsd*dsd;
+        if (dist < bestd) { bestd = dist; best = i; }
+    }
+    return best;
+}
+
+/* ---------- Personalized Dijkstra (O(n^2)) ----------
+   Internal details are kept inside; user sees only the final path and actions.
+   Small heuristics:
+    - Nodes that have user tips are slightly favored (treated as easier)
+    - Edges with procedures are slightly favored
+    - Some nodes are blocked from direct positive edges (handled when adding edges)
+*/
+
+/* Routing buffers are reused across queries instead of living on the stack,
+   so large maps neither overflow the stack nor pay for a fresh allocation per query. */
+static struct { float *dist; int *visited; int *prev; int *temp; int *heap; int *pos; float *key; int cap; } route_scratch;
+
+static void route_scratch_reserve(int n) {
+    if (n <= route_scratch.cap) return;
+    int old = route_scratch.cap;
+    /* key[] carries 4 floats of padding for the SIMD scan */
+    route_scratch.key = realloc_or_die(route_scratch.key, old ? old + 4 : 0, n + 4, sizeof(float), MEM_ROUTING);
+    route_scratch.dist = realloc_or_die(route_scratch.dist, old, n, sizeof(float), MEM_ROUTING);
+    route_scratch.visited = realloc_or_die(route_scratch.visited, old, n, sizeof(int), MEM_ROUTING);
+    route_scratch.prev = realloc_or_die(route_scratch.prev, old, n, sizeof(int), MEM_ROUTING);
+    route_scratch.temp = realloc_or_die(route_scratch.temp, old, n, sizeof(int), MEM_ROUTING);
+    route_scratch.heap = realloc_or_die(route_scratch.heap, old, n, sizeof(int), MEM_ROUTING);
+    route_scratch.pos = realloc_or_die(route_scratch.pos, old, n, sizeof(int), MEM_ROUTING);
+    route_scratch.cap = n;
+}
+
+/* Personalized cost of taking edge e; every routing engine must use exactly this. */
+static float personalized_weight(const EmotionGraph *g, const Edge *e) {
+    float w = e->weight;
+    if (g->nodes[e->to].tips_count > 0) w *= 0.85f;
+    if (e->procedure) w *= 0.8f;
+    /* small internal bias from valence (hidden) */
+    float valence_bias = (1.0f - g->nodes[e->to].valence) * 0.05f;
+    return w * (1.0f - valence_bias);
+}
+
+/* Writes the src..dest route recorded in prev[] into out_path; returns its length. */
+static int route_emit_path(int dest, const int *prev, int out_path[]) {
+    int *temp = route_scratch.temp; int idx=0;
+    for (int cur = dest; cur != -1; cur = prev[cur]) temp[idx++] = cur;
+    for (int i=0;i<idx;++i) out_path[i] = temp[idx-1-i];
+    return idx;
+}
+
+float run_dijkstra_personalized(EmotionGraph *g, int src, int dest, int out_path[], int *out_len) {
+    int n = g->count;
+    if (src < 0 || dest < 0) return FLT_MAX;
+    TRACE_BEGIN(t0);
+    route_scratch_reserve(n);
+    float *dist = route_scratch.dist; int *visited = route_scratch.visited; int *prev = route_scratch.prev;
+    for (int i=0;i<n;++i) { dist[i]=FLT_MAX; visited[i]=0; prev[i]=-1; }
+    dist[src] = 0.0f;
+    STAT_INC(queries);
+
+    for (int iter=0; iter<n; ++iter) {
+        int u=-1; float best=FLT_MAX;
+        for (int i=0;i<n;++i) if (!visited[i] && dist[i] < best) { best = dist[i]; u = i; }
+        if (u==-1) break;
+        visited[u] = 1;
+        STAT_INC(nodes_settled);
+        if (u == dest) break;
+        EmotionNode *nu = &g->nodes[u];
+        STAT_ADD(edges_relaxed, nu->edges_count);
+        for (int ei=0; ei < nu->edges_count; ++ei) {
+            Edge *e = &nu->edges[ei];
+            int v = e->to;
+            if (visited[v] || (nu->forbid & g->nodes[v].classes)) continue;
+            float alt = dist[u] + personalized_weight(g, e);
+            if (alt < dist[v]) { dist[v] = alt; prev[v] = u; }
+        }
+    }
+
+    if (dist[dest] == FLT_MAX) { TRACE_END("dijkstra", t0); return FLT_MAX; }
+    *out_len = route_emit_path(dest, prev, out_path);
+    TRACE_END("dijkstra", t0);
+    return dist[dest];
+}
+
+/* ---------- Binary-heap Dijkstra ----------
+   Same weights and stopping rule as run_dijkstra_personalized, but the next node comes
+   from an indexed min-heap (decrease-key via pos[]), so a query is O((V+E) log V)
+   instead of O(V^2). Results agree with the reference up to ties between equal routes.
+*/
+
+static void heap_sift_up(int *heap, int *pos, const float *key, int i) {
+    int v = heap[i];
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (key[heap[parent]] <= key[v]) break;
+        heap[i] = heap[parent]; pos[heap[i]] = i;
+        i = parent;
+    }
+    heap[i] = v; pos[v] = i;
+}
+
+static void heap_sift_down(int *heap, int *pos, const float *key, int count, int i) {
+    int v = heap[i];
+    for (;;) {
+        int c = 2 * i + 1;
+        if (c >= count) break;
+        if (c + 1 < count && key[heap[c+1]] < key[heap[c]]) ++c;
+        if (key[v] <= key[heap[c]]) break;
+        heap[i] = heap[c]; pos[heap[i]] = i;
+        i = c;
+    }
+    heap[i] = v; pos[v] = i;
+}
+
+float route_heap(EmotionGraph *g, int src, int dest, int out_path[], int *out_len) {
+    int n = g->count;
+    if (src < 0 || dest < 0) return FLT_MAX;
+    TRACE_BEGIN(t0);
+    route_scratch_reserve(n);
+    float *dist = route_scratch.dist; int *visited = route_scratch.visited; int *prev = route_scratch.prev;
+    int *heap = route_scratch.heap, *pos = route_scratch.pos, hn = 0;
+    for (int i=0;i<n;++i) { dist[i]=FLT_MAX; visited[i]=0; prev[i]=-1; pos[i]=-1; }
+    dist[src] = 0.0f;
+    heap[hn++] = src; pos[src] = 0;
+    STAT_INC(queries); STAT_INC(heap_ops);
+
+    while (hn > 0) {
+        int u = heap[0];
+        pos[u] = -1;
+        if (--hn > 0) { heap[0] = heap[hn]; heap_sift_down(heap, pos, dist, hn, 0); }
+        STAT_INC(heap_ops);
+        visited[u] = 1;
+        STAT_INC(nodes_settled);
+        if (u == dest) break;
+        EmotionNode *nu = &g->nodes[u];
+        STAT_ADD(edges_relaxed, nu->edges_count);
+        for (int ei=0; ei < nu->edges_count; ++ei) {
+            Edge *e = &nu->edges[ei];
+            int v = e->to;
+            if (visited[v] || (nu->forbid & g->nodes[v].classes)) continue;
+            float alt = dist[u] + personalized_weight(g, e);
+            if (alt < dist[v]) {
+                dist[v] = alt; prev[v] = u;
+                if (pos[v] < 0) { heap[hn] = v; pos[v] = hn; ++hn; }
+                heap_sift_up(heap, pos, dist, pos[v]);
+                STAT_INC(heap_ops);
+            }
+        }
+    }
+
+    if (dist[dest] == FLT_MAX) { TRACE_END("dijkstra_heap", t0); return FLT_MAX; }
+    *out_len = route_emit_path(dest, prev, out_path);
+    TRACE_END("dijkstra_heap", t0);
+    return dist[dest];
+}
+
+/* ---------- Small-graph bitset Dijkstra ----------
+   Most personal maps (the seeded default has 11 emotions) fit in 64 nodes. Here the
+   state lives in fixed stack arrays and two 64-bit masks: 'open' holds reached but
+   unsettled nodes, and the minimum is picked by walking its set bits with ctz. Bits are
+   visited in ascending order with a strict '<', so ties resolve exactly like the
+   reference scan. Larger maps are handed to the reference engine.
+*/
+
+#define SMALL_GRAPH_MAX 64
+
+static int ctz64(uint64_t m) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(m);
+#else
+    int i = 0; while (!(m & 1)) { m >>= 1; ++i; } return i;
+#endif
+}
+
+float route_bitset(EmotionGraph *g, int src, int dest, int out_path[], int *out_len) {
+    int n = g->count;
+    if (n > SMALL_GRAPH_MAX) return run_dijkstra_personalized(g, src, dest, out_path, out_len);
+    if (src < 0 || dest < 0) return FLT_MAX;
+    TRACE_BEGIN(t0);
+    float dist[SMALL_GRAPH_MAX]; int prev[SMALL_GRAPH_MAX];
+    dist[src] = 0.0f; prev[src] = -1;
+    uint64_t open = (uint64_t)1 << src, settled = 0;
+    STAT_INC(queries);
+
+    while (open) {
+        uint64_t m = open;
+        int u = ctz64(m); float best = dist[u];
+        for (m &= m - 1; m; m &= m - 1) { int i = ctz64(m); if (dist[i] < best) { best = dist[i]; u = i; } }
+        open &= ~((uint64_t)1 << u);
+        settled |= (uint64_t)1 << u;
+        STAT_INC(nodes_settled);
+        if (u == dest) break;
+        EmotionNode *nu = &g->nodes[u];
+        STAT_ADD(edges_relaxed, nu->edges_count);
+        for (int ei=0; ei < nu->edges_count; ++ei) {
+            Edge *e = &nu->edges[ei];
+            int v = e->to;
+            uint64_t bit = (uint64_t)1 << v;
+            if ((settled & bit) || (nu->forbid & g->nodes[v].classes)) continue;
+            float alt = dist[u] + personalized_weight(g, e);
+            if (!(open & bit) || alt < dist[v]) { dist[v] = alt; prev[v] = u; open |= bit; }
+        }
+    }
+
+    if (!(settled & ((uint64_t)1 << dest))) { TRACE_END("dijkstra_bitset", t0); return FLT_MAX; }
+    route_scratch_reserve(n);
+    int idx = 0;
+    for (int cur = dest; cur != -1; cur = prev[cur]) route_scratch.temp[idx++] = cur;
+    for (int i=0;i<idx;++i) out_path[i] = route_scratch.temp[idx-1-i];
+    *out_len = idx;
+    TRACE_END("dijkstra_bitset", t0);
+    return dist[dest];
+}
+
+/* ---------- Dense-graph Dijkstra with SIMD min-selection ----------
+   The O(V^2) scheme wins on dense maps once picking the next node is cheap. key[] holds
+   the tentative distance of every unsettled node and +inf for settled ones, so the scan
+   is a branch-free argmin over one float array (4 lanes at a time with SSE2). Each lane
+   keeps its first minimum and lanes are merged by lowest index, which reproduces the
+   reference's tie-breaking; nodes still at FLT_MAX count as unreached, as there.
+*/
+
+static int argmin_keys(const float *key, int n) {
+    float best; int u;
+#if defined(__SSE2__)
+    __m128 vmin = _mm_set1_ps(INFINITY);
+    __m128i vidx = _mm_set1_epi32(-1), cur = _mm_setr_epi32(0, 1, 2, 3), four = _mm_set1_epi32(4);
+    for (int i=0;i<n;i+=4) {
+        __m128 k = _mm_loadu_ps(key + i);
+        __m128i lt = _mm_castps_si128(_mm_cmplt_ps(k, vmin));
+        vmin = _mm_min_ps(k, vmin);
+        vidx = _mm_or_si128(_mm_and_si128(lt, cur), _mm_andnot_si128(lt, vidx));
+        cur = _mm_add_epi32(cur, four);
+    }
+    float mins[4]; int idxs[4];
+    _mm_storeu_ps(mins, vmin);
+    _mm_storeu_si128((__m128i *)idxs, vidx);
+    best = mins[0]; u = idxs[0];
+    for (int l=1;l<4;++l)
+        if (mins[l] < best || (mins[l] == best && idxs[l] >= 0 && (u < 0 || idxs[l] < u))) { best = mins[l]; u = idxs[l]; }
+#else
+    best = INFINITY; u = -1;
+    for (int i=0;i<n;++i) if (key[i] < best) { best = key[i]; u = i; }
+#endif
+    return (best < FLT_MAX) ? u : -1;
+}
+
+float route_dense(EmotionGraph *g, int src, int dest, int out_path[], int *out_len) {
+    int n = g->count;
+    if (src < 0 || dest < 0) return FLT_MAX;
+    TRACE_BEGIN(t0);
+    route_scratch_reserve(n);
+    float *key = route_scratch.key, *dist = route_scratch.dist; int *prev = route_scratch.prev;
+    for (int i=0;i<n;++i) { key[i]=FLT_MAX; prev[i]=-1; }
+    for (int i=n;i<n+4;++i) key[i] = INFINITY;
+    key[src] = 0.0f;
+    STAT_INC(queries);
+
+    int reached = 0;
+    for (int iter=0; iter<n; ++iter) {
+        int u = argmin_keys(key, n);
+        if (u == -1) break;
+        dist[u] = key[u];
+        key[u] = INFINITY;
+        STAT_INC(nodes_settled);
+        if (u == dest) { reached = 1; break; }
+        EmotionNode *nu = &g->nodes[u];
+        STAT_ADD(edges_relaxed, nu->edges_count);
+        for (int ei=0; ei < nu->edges_count; ++ei) {
+            Edge *e = &nu->edges[ei];
+            int v = e->to;
+            if (key[v] == INFINITY || (nu->forbid & g->nodes[v].classes)) continue;   /* settled or ruled out */
+            float alt = dist[u] + personalized_weight(g, e);
+            if (alt < key[v]) { key[v] = alt; prev[v] = u; }
+        }
+    }
+
+    if (!reached) { TRACE_END("dijkstra_dense", t0); return FLT_MAX; }
+    *out_len = route_emit_path(dest, prev, out_path);
+    TRACE_END("dijkstra_dense", t0);
+    return dist[dest];
+}
+
+/* ---------- CSR routing snapshot ----------
+   A flat copy of the arcs (offsets/targets) with every arc's personalized cost
+   precomputed, both as float and as fixed-point integers (ROUTE_FIXED_SCALE units per
+   difficulty point, rounded, so the 0.85/0.8/valence factors are baked in). Arc k of
+   node u is entry offsets[u] + k. The snapshot is rebuilt lazily whenever the graph's
+   version changes, so engines built on it never see stale weights.
+*/
+
+#define ROUTE_FIXED_SCALE 1000
+
+typedef struct {
+    const EmotionGraph *graph;
+    unsigned long version;
+    int n;
+    long m;
+    int *offsets;            /* n + 1 */
+    int *targets;            /* m */
+    float *cost;             /* m, personalized_weight() */
+    unsigned char *guided;   /* m, 1 = the transition has a procedure */
+    uint32_t *fixed;         /* m, cost in 1/ROUTE_FIXED_SCALE units */
+    uint32_t max_fixed;
+    int n_cap; long m_cap;
+} RouteCSR;
+
+static RouteCSR route_csr;
+
+/* Costs below zero (a hand-edited valence under -19 flips the valence bias) map to 0:
+   converting a negative value to uint32_t is undefined. */
+static uint32_t cost_to_fixed(float c) {
+    if (!(c > 0.0f)) return 0;
+    double f = (double)c * ROUTE_FIXED_SCALE + 0.5;
+    return f >= 4294967295.0 ? UINT32_MAX : (uint32_t)f;
+}
+
+static const RouteCSR *route_csr_get(EmotionGraph *g) {
+    RouteCSR *c = &route_csr;
+    if (c->graph == g && c->version == g->version) return c;
+    TRACE_BEGIN(t0);
+    if (g->count + 1 > c->n_cap) {
+        c->offsets = realloc_or_die(c->offsets, c->n_cap, g->count + 1, sizeof(int), MEM_ROUTING);
+        c->n_cap = g->count + 1;
+    }
+    if (g->arcs > c->m_cap) {
+        c->targets = realloc_or_die(c->targets, c->m_cap, g->arcs, sizeof(int), MEM_ROUTING);
+        c->cost = realloc_or_die(c->cost, c->m_cap, g->arcs, sizeof(float), MEM_ROUTING);
+        c->guided = realloc_or_die(c->guided, c->m_cap, g->arcs, 1, MEM_ROUTING);
+        c->fixed = realloc_or_die(c->fixed, c->m_cap, g->arcs, sizeof(uint32_t), MEM_ROUTING);
+        c->m_cap = g->arcs;
+    }
+    long k = 0; uint32_t mx = 0;
+    for (int u=0;u<g->count;++u) {
+        c->offsets[u] = (int)k;
+        EmotionNode *nu = &g->nodes[u];
+        for (int ei=0;ei<nu->edges_count;++ei) {
+            int v = nu->edges[ei].to;
+            if (nu->forbid & g->nodes[v].classes) continue;   /* ruled out after it was added */
+            c->targets[k] = v;
+            c->cost[k] = personalized_weight(g, &nu->edges[ei]);
+            c->guided[k] = nu->edges[ei].procedure != NULL;
+            c->fixed[k] = cost_to_fixed(c->cost[k]);
+            if (c->fixed[k] > mx) mx = c->fixed[k];
+            ++k;
+        }
+    }
+    c->offsets[g->count] = (int)k;
+    c->n = g->count; c->m = k; c->max_fixed = mx;
+    c->graph = g; c->version = g->version;
+    TRACE_END("csr_build", t0);
+    return c;
+}
+
+/* ---------- Dial bucket-queue Dijkstra ----------
+   With integer arc costs bounded by C = max_fixed, tentative distances of open nodes
+   all lie in [d, d + C], so a circular array of C + 1 buckets (intrusive doubly linked
+   lists) replaces the heap: each settle is O(1) amortised plus a scan over empty buckets,
+   i.e. O(V + E + D) per query for a route of fixed-point length D. Difficulty 0-20 maps
+   to at most ~21000 buckets. Because arc costs are rounded to 1/ROUTE_FIXED_SCALE the
+   chosen route can be a near-tie away from the float optimum (at most half a unit per
+   step); the returned cost is the route's exact float cost. Maps with heavier arcs fall
+   back to the heap engine.
+*/
+
+#define DIAL_MAX_BUCKETS (1 << 20)
+
+static struct { uint64_t *dfix; int *next, *prevb, *prev_arc, *head; int cap, head_cap; } dial_scratch;
+
+float route_dial(EmotionGraph *g, int src, int dest, int out_path[], int *out_len) {
+    if (src < 0 || dest < 0) return FLT_MAX;
+    const RouteCSR *c = route_csr_get(g);
+    if (c->max_fixed >= DIAL_MAX_BUCKETS) return route_heap(g, src, dest, out_path, out_len);
+    TRACE_BEGIN(t0);
+    int n = c->n, nb = (int)c->max_fixed + 1;
+    if (n > dial_scratch.cap) {
+        int old = dial_scratch.cap;
+        dial_scratch.dfix = realloc_or_die(dial_scratch.dfix, old, n, sizeof(uint64_t), MEM_ROUTING);
+        dial_scratch.next = realloc_or_die(dial_scratch.next, old, n, sizeof(int), MEM_ROUTING);
+        dial_scratch.prevb = realloc_or_die(dial_scratch.prevb, old, n, sizeof(int), MEM_ROUTING);
+        dial_scratch.prev_arc = realloc_or_die(dial_scratch.prev_arc, old, n, sizeof(int), MEM_ROUTING);
+        dial_scratch.cap = n;
+    }
+    if (nb > dial_scratch.head_cap) {
+        dial_scratch.head = realloc_or_die(dial_scratch.head, dial_scratch.head_cap, nb, sizeof(int), MEM_ROUTING);
+        dial_scratch.head_cap = nb;
+    }
+    route_scratch_reserve(n);
+    uint64_t *dfix = dial_scratch.dfix;
+    int *next = dial_scratch.next, *prevb = dial_scratch.prevb, *prev_arc = dial_scratch.prev_arc, *head = dial_scratch.head;
+    int *visited = route_scratch.visited, *prev = route_scratch.prev;
+    for (int i=0;i<n;++i) { dfix[i] = UINT64_MAX; visited[i] = 0; prev[i] = -1; prev_arc[i] = -1; }
+    for (int b=0;b<nb;++b) head[b] = -1;
+    STAT_INC(queries);
+
+    dfix[src] = 0; head[0] = src; next[src] = -1; prevb[src] = -1;
+    long open = 1; uint64_t cur = 0; int reached = 0;
+    STAT_INC(heap_ops);
+    while (open > 0) {
+        int b = (int)(cur % (uint64_t)nb);
+        while (head[b] == -1) { ++cur; b = (int)(cur % (uint64_t)nb); }
+        int u = head[b];
+        head[b] = next[u]; if (next[u] != -1) prevb[next[u]] = -1;
+        --open;
+        STAT_INC(heap_ops);
+        visited[u] = 1;
+        STAT_INC(nodes_settled);
+        if (u == dest) { reached = 1; break; }
+        STAT_ADD(edges_relaxed, c->offsets[u+1] - c->offsets[u]);
+        for (int a=c->offsets[u]; a<c->offsets[u+1]; ++a) {
+            int v = c->targets[a];
+            if (visited[v]) continue;
+            uint64_t nd = dfix[u] + c->fixed[a];
+            if (nd >= dfix[v]) continue;
+            if (dfix[v] != UINT64_MAX) {   /* unlink from its current bucket */
+                if (prevb[v] != -1) next[prevb[v]] = next[v];
+                else head[dfix[v] % (uint64_t)nb] = next[v];
+                if (next[v] != -1) prevb[next[v]] = prevb[v];
+            } else ++open;
+            dfix[v] = nd; prev[v] = u; prev_arc[v] = a;
+            int nbk = (int)(nd % (uint64_t)nb);
+            next[v] = head[nbk]; prevb[v] = -1;
+            if (head[nbk] != -1) prevb[head[nbk]] = v;
+            head[nbk] = v;
+            STAT_INC(heap_ops);
+        }
+    }
+
+    if (!reached) { TRACE_END("dijkstra_dial", t0); return FLT_MAX; }
+    int len = route_emit_path(dest, prev, out_path);
+    float cost = 0.0f;
+    for (int i=1;i<len;++i) cost += c->cost[prev_arc[out_path[i]]];
+    *out_len = len;
+    TRACE_END("dijkstra_dial", t0);
+    return cost;
+}
+
+/* ---------- Delta-stepping parallel SSSP ----------
+   For offline analysis of huge merged maps: shortest costs from one source to every
+   state, with the same personalized weights (read from the CSR snapshot).
+    - Nodes are grouped in buckets of width delta by tentative cost. Bucket k is
+      processed in rounds: all threads relax the light arcs (cost <= delta) of the
+      current frontier, re-inserting nodes that improved within bucket k, then the heavy
+      arcs of everything settled in the bucket are relaxed once.
+    - Each worker keeps its own bucket lists; the coordinating thread merges them
+      between rounds, dropping stale entries (cost moved to a lower bucket) and repeats.
+    - A node's cost and predecessor share one 64-bit word updated by compare-and-swap.
+      Non-negative float bit patterns order like unsigned integers, so "atomic min" on
+      the high half keeps cost and predecessor consistent under contention.
+   With a destination, the search stops once that node's bucket is finished.
+*/
+
+typedef struct { int *v; int n, cap; } IntVec;
+
+static void intvec_push(IntVec *a, int x) {
+    if (a->n == a->cap) {
+        int nc = a->cap ? a->cap * 2 : 64;
+        a->v = realloc_or_die(a->v, a->cap, nc, sizeof(int), MEM_ROUTING);
+        a->cap = nc;
+    }
+    a->v[a->n++] = x;
+}
+static void intvec_free(IntVec *a) { free_array(a->v, a->cap, sizeof(int), MEM_ROUTING); a->v = NULL; a->n = a->cap = 0; }
+
+static uint64_t delta_pack(float d, int pred) {
+    uint32_t bits; memcpy(&bits, &d, sizeof(bits));
+    return ((uint64_t)bits << 32) | (uint32_t)(pred + 1);
+}
+static float delta_dist(uint64_t w) { uint32_t bits = (uint32_t)(w >> 32); float d; memcpy(&d, &bits, sizeof(d)); return d; }
+static int delta_pred(uint64_t w) { return (int)(uint32_t)w - 1; }
+
+typedef struct DeltaShared DeltaShared;
+
+typedef struct {
+    DeltaShared *sh;
+    int tid;
+    pthread_t thread;
+    IntVec next;         /* light-round improvements that stay in the current bucket */
+    IntVec *buckets;     /* later buckets, indexed by absolute bucket number */
+    int nbuckets;
+} DeltaWorker;
+
+struct DeltaShared {
+    const RouteCSR *c;
+    uint64_t *state;
+    float delta;
+    int threads;
+    const int *items; int nitems;
+    int heavy, k, done;
+    pthread_mutex_t mu; pthread_cond_t cv;
+    int arrived, generation;
+    DeltaWorker *workers;
+};
+
+/* Clamped so a tiny --delta cannot overflow the index; far buckets just share the last. */
+#define DELTA_MAX_BUCKET (1 << 24)
+static int delta_bucket(float d, float delta) {
+    double b = (double)d / delta;
+    return b < DELTA_MAX_BUCKET ? (int)b : DELTA_MAX_BUCKET;
+}
+
+/* All workers plus the coordinator meet here between phases. */
+static void delta_barrier(DeltaShared *sh) {
+    pthread_mutex_lock(&sh->mu);
+    int gen = sh->generation;
+    if (++sh->arrived == sh->threads + 1) { sh->arrived = 0; sh->generation++; pthread_cond_broadcast(&sh->cv); }
+    else while (gen == sh->generation) pthread_cond_wait(&sh->cv, &sh->mu);
+    pthread_mutex_unlock(&sh->mu);
+}
+
+static void delta_worker_push(DeltaWorker *w, int b, int v) {
+    if (b >= w->nbuckets) {
+        int nb = w->nbuckets ? w->nbuckets : 16;
+        while (nb <= b) nb *= 2;
+        w->buckets = realloc_or_die(w->buckets, w->nbuckets, nb, sizeof(IntVec), MEM_ROUTING);
+        memset(w->buckets + w->nbuckets, 0, sizeof(IntVec) * (size_t)(nb - w->nbuckets));
+        w->nbuckets = nb;
+    }
+    intvec_push(&w->buckets[b], v);
+}
+
+static void *delta_worker_main(void *arg) {
+    DeltaWorker *w = arg; DeltaShared *sh = w->sh;
+    const RouteCSR *c = sh->c;
+    for (;;) {
+        delta_barrier(sh);
+        if (sh->done) break;
+        for (int i = w->tid; i < sh->nitems; i += sh->threads) {
+            int u = sh->items[i];
+            float du = delta_dist(__atomic_load_n(&sh->state[u], __ATOMIC_RELAXED));
+            for (int a=c->offsets[u]; a<c->offsets[u+1]; ++a) {
+                float wgt = c->cost[a];
+                if ((wgt > sh->delta) != sh->heavy) continue;
+                int v = c->targets[a];
+                float nd = du + wgt;
+                uint64_t want = delta_pack(nd, u);
+                uint64_t cur = __atomic_load_n(&sh->state[v], __ATOMIC_RELAXED);
+                int improved = 0;
+                while ((cur >> 32) > (want >> 32)) {
+                    if (__atomic_compare_exchange_n(&sh->state[v], &cur, want, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) { improved = 1; break; }
+                }
+                if (!improved) continue;
+                int b = delta_bucket(nd, sh->delta);
+                if (b == sh->k) intvec_push(&w->next, v);
+                else delta_worker_push(w, b, v);
+            }
+        }
+        delta_barrier(sh);
+    }
+    return NULL;
+}
+
+static void delta_run_phase(DeltaShared *sh, const int *items, int nitems, int heavy) {
+    sh->items = items; sh->nitems = nitems; sh->heavy = heavy;
+    delta_barrier(sh);   /* start */
+    delta_barrier(sh);   /* all relaxations done */
+}
+
+/* Moves the workers' current-bucket improvements into frontier, once per node. */
+static void delta_collect_next(DeltaShared *sh, IntVec *frontier, int *mark, int stamp) {
+    frontier->n = 0;
+    for (int t=0;t<sh->threads;++t) {
+        IntVec *nx = &sh->workers[t].next;
+        for (int i=0;i<nx->n;++i) {
+            int v = nx->v[i];
+            if (mark[v] == stamp) continue;
+            mark[v] = stamp; intvec_push(frontier, v);
+        }
+        nx->n = 0;
+    }
+}
+
+/* Mean arc cost: a reasonable bucket width when the caller does not pick one. */
+static float delta_default_width(const RouteCSR *c) {
+    double sum = 0.0;
+    for (long a=0;a<c->m;++a) sum += c->cost[a];
+    float d = c->m ? (float)(sum / (double)c->m) : 1.0f;
+    return d > 1e-3f ? d : 1e-3f;
+}
+
+/* Fills dist[] (FLT_MAX = unreachable) and, if given, pred[] for every node. */
+void sssp_delta_stepping(const RouteCSR *c, int src, int dest, int threads, float delta, float *dist, int *pred) {
+    int n = c->n;
+    if (threads < 1) threads = 1;
+    if (delta <= 0.0f) delta = delta_default_width(c);
+    DeltaShared sh;
+    memset(&sh, 0, sizeof(sh));
+    sh.c = c; sh.delta = delta; sh.threads = threads;
+    sh.state = realloc_or_die(NULL, 0, (size_t)n, sizeof(uint64_t), MEM_ROUTING);
+    int *mark = realloc_or_die(NULL, 0, (size_t)n, sizeof(int), MEM_ROUTING);
+    for (int i=0;i<n;++i) { sh.state[i] = delta_pack(FLT_MAX, -1); mark[i] = 0; }
+    sh.state[src] = delta_pack(0.0f, -1);
+    pthread_mutex_init(&sh.mu, NULL); pthread_cond_init(&sh.cv, NULL);
+    sh.workers = realloc_or_die(NULL, 0, (size_t)threads, sizeof(DeltaWorker), MEM_ROUTING);
+    memset(sh.workers, 0, sizeof(DeltaWorker) * (size_t)threads);
+    for (int t=0;t<threads;++t) {
+        sh.workers[t].sh = &sh; sh.workers[t].tid = t;
+        if (pthread_create(&sh.workers[t].thread, NULL, delta_worker_main, &sh.workers[t]) != 0) { perror("pthread_create"); exit(1); }
+    }
+    STAT_INC(queries);
+
+    IntVec frontier = {0}, settled = {0};
+    delta_worker_push(&sh.workers[0], 0, src);
+    int stamp = 0;
+    for (int k = 0;; ++k) {
+        /* next non-empty bucket at or after k */
+        int found = 0;
+        for (;; ++k) {
+            int any_beyond = 0;
+            for (int t=0;t<threads;++t) {
+                DeltaWorker *w = &sh.workers[t];
+                if (k < w->nbuckets && w->buckets[k].n > 0) found = 1;
+                if (k < w->nbuckets) any_beyond = 1;
+            }
+            if (found || !any_beyond) break;
+        }
+        if (!found) break;
+        sh.k = k;
+        frontier.n = 0; settled.n = 0;
+        ++stamp;
+        for (int t=0;t<threads;++t) {
+            if (k >= sh.workers[t].nbuckets) continue;
+            IntVec *b = &sh.workers[t].buckets[k];
+            for (int i=0;i<b->n;++i) {
+                int v = b->v[i];
+                if (mark[v] == stamp || delta_bucket(delta_dist(sh.state[v]), delta) != k) continue;
+                mark[v] = stamp; intvec_push(&frontier, v);
+            }
+            intvec_free(b);
+        }
+        for (;;) {
+            while (frontier.n > 0) {
+                for (int i=0;i<frontier.n;++i) intvec_push(&settled, frontier.v[i]);
+                STAT_ADD(nodes_settled, frontier.n);
+                delta_run_phase(&sh, frontier.v, frontier.n, 0);
+                delta_collect_next(&sh, &frontier, mark, ++stamp);
+            }
+            /* a node can be re-settled in several rounds; heavy arcs only need its final cost */
+            ++stamp;
+            int kept = 0;
+            for (int i=0;i<settled.n;++i) { int v = settled.v[i]; if (mark[v] != stamp) { mark[v] = stamp; settled.v[kept++] = v; } }
+            settled.n = kept;
+            delta_run_phase(&sh, settled.v, settled.n, 1);
+            /* heavy arcs can only land in bucket k when it is the clamped last bucket */
+            delta_collect_next(&sh, &frontier, mark, ++stamp);
+            if (frontier.n == 0) break;
+            settled.n = 0;
+        }
+        float dd = dest >= 0 ? delta_dist(sh.state[dest]) : FLT_MAX;
+        if (dd != FLT_MAX && delta_bucket(dd, delta) <= k) break;
+    }
+
+    sh.done = 1;
+    delta_barrier(&sh);
+    for (int t=0;t<threads;++t) {
+        pthread_join(sh.workers[t].thread, NULL);
+        DeltaWorker *w = &sh.workers[t];
+        for (int b=0;b<w->nbuckets;++b) intvec_free(&w->buckets[b]);
+        free_array(w->buckets, w->nbuckets, sizeof(IntVec), MEM_ROUTING);
+        intvec_free(&w->next);
+    }
+    for (int i=0;i<n;++i) { dist[i] = delta_dist(sh.state[i]); if (pred) pred[i] = delta_pred(sh.state[i]); }
+    intvec_free(&frontier); intvec_free(&settled);
+    free_array(sh.workers, threads, sizeof(DeltaWorker), MEM_ROUTING);
+    free_array(mark, n, sizeof(int), MEM_ROUTING);
+    free_array(sh.state, n, sizeof(uint64_t), MEM_ROUTING);
+    pthread_mutex_destroy(&sh.mu); pthread_cond_destroy(&sh.cv);
+}
+
+static int delta_thread_count = 0;   /* 0 = one per online CPU */
+
+static long online_cpus(void) {
+#ifdef _SC_NPROCESSORS_ONLN
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > 0) return n;
+#endif
+    return 1;
+}
+
+static int default_thread_count(void) {
+    if (delta_thread_count > 0) return delta_thread_count;
+    long n = online_cpus();
+    return n > 64 ? 64 : (int)n;
+}
+
+/* Engine wrapper: one delta-stepping search that stops at dest. */
+float route_delta(EmotionGraph *g, int src, int dest, int out_path[], int *out_len) {
+    if (src < 0 || dest < 0) return FLT_MAX;
+    const RouteCSR *c = route_csr_get(g);
+    TRACE_BEGIN(t0);
+    route_scratch_reserve(c->n);
+    sssp_delta_stepping(c, src, dest, default_thread_count(), 0.0f, route_scratch.dist, route_scratch.prev);
+    float cost = route_scratch.dist[dest];
+    if (cost == FLT_MAX) { TRACE_END("sssp_delta", t0); return FLT_MAX; }
+    *out_len = route_emit_path(dest, route_scratch.prev, out_path);
+    TRACE_END("sssp_delta", t0);
+    return cost;
+}
+
+/* ---------- All-pairs cost table ----------
+   For reporting on maps of a few thousand states: cost[i*n+j] and the first step
+   next[i*n+j] of a cheapest i -> j route, so a pair query is one lookup plus a walk
+   along next hops. Two builders, both multi-threaded:
+    - dense maps: Floyd-Warshall in APSP_BLOCK x APSP_BLOCK tiles (diagonal tile, then
+      its row and column, then every other tile in parallel), inner loop in SSE2;
+    - sparse maps: one heap Dijkstra per source, sources handed out to threads.
+   The table is saved as <datafile>.apsp with a fingerprint of the routing-relevant map
+   content; load_graph() attaches it when the fingerprint still matches. Any edit
+   changes g->version, which makes the table stale until rebuilt.
+*/
+
+#define APSP_MAX_NODES 8192          /* n*n*6 bytes: ~400 MB at the limit */
+#define APSP_NO_HOP 0xFFFFu
+#define APSP_BLOCK 64
+/* Per-source Dijkstra measured faster until nearly every pair is an arc (2000 states:
+   2.8 s vs 3.9 s at 37% of pairs, parity around 75%), so tiles are for near-complete maps. */
+#define APSP_FW_PERCENT 75
+#define APSP_MAGIC "EMOAPSP1"
+
+typedef struct {
+    const EmotionGraph *graph;
+    unsigned long version;
+    uint64_t fingerprint;
+    int n;
+    float *cost;             /* n*n, FLT_MAX = unreachable */
+    uint16_t *next;          /* n*n, APSP_NO_HOP when unreachable or i == j */
+} ApspTable;
+
+static ApspTable route_apsp;
+
+/* Runs fn(ctx, 0..count-1) on up to 'threads' threads (the caller is one of them).
+   fn may allocate through the helpers (their counters are atomic) but must not use
+   STAT_ADD/STAT_INC or LAT_RECORD, which update shared counters without synchronization. */
+typedef struct { void (*fn)(void *, int); void *ctx; int count, next; } ParallelFor;
+
+static void *parallel_for_worker(void *arg) {
+    ParallelFor *p = arg;
+    for (;;) {
+        int i = __atomic_fetch_add(&p->next, 1, __ATOMIC_RELAXED);
+        if (i >= p->count) break;
+        p->fn(p->ctx, i);
+    }
+    return NULL;
+}
+
+static void parallel_for(int count, int threads, void (*fn)(void *, int), void *ctx) {
+    ParallelFor p = { fn, ctx, count, 0 };
+    if (threads > count) threads = count;
+    if (threads <= 1) { parallel_for_worker(&p); return; }
+    pthread_t *tid = realloc_or_die(NULL, 0, (size_t)threads - 1, sizeof(pthread_t), MEM_ROUTING);
+    for (int t=0;t<threads-1;++t)
+        if (pthread_create(&tid[t], NULL, parallel_for_worker, &p) != 0) { perror("pthread_create"); exit(1); }
+    parallel_for_worker(&p);
+    for (int t=0;t<threads-1;++t) pthread_join(tid[t], NULL);
+    free_array(tid, threads - 1, sizeof(pthread_t), MEM_ROUTING);
+}
+
+/* Sequential full SSSP: lazy binary heap of (cost, node) pairs. Optionally records
+   predecessors and the settle order; returns the number of settled nodes. */
+typedef struct { float d; int v; } SsspItem;
+
+static int sssp_heap_full(const RouteCSR *c, int src, float *dist, int *pred, int *order) {
+    int n = c->n, settled = 0; long cap = 1024, len = 0;
+    SsspItem *h = realloc_or_die(NULL, 0, (size_t)cap, sizeof(SsspItem), MEM_ROUTING);
+    for (int i=0;i<n;++i) dist[i] = FLT_MAX;
+    if (pred) for (int i=0;i<n;++i) pred[i] = -1;
+    dist[src] = 0.0f; h[len++] = (SsspItem){0.0f, src};
+    while (len > 0) {
+        SsspItem top = h[0], last = h[--len];
+        long i = 0;
+        for (;;) {
+            long l = 2*i+1; if (l >= len) break;
+            if (l+1 < len && h[l+1].d < h[l].d) ++l;
+            if (h[l].d >= last.d) break;
+            h[i] = h[l]; i = l;
+        }
+        if (len > 0) h[i] = last;
+        if (top.d > dist[top.v]) continue;
+        if (order) order[settled] = top.v;
+        ++settled;
+        for (int a=c->offsets[top.v]; a<c->offsets[top.v+1]; ++a) {
+            int v = c->targets[a]; float nd = top.d + c->cost[a];
+            if (nd >= dist[v]) continue;
+            dist[v] = nd;
+            if (pred) pred[v] = top.v;
+            if (len == cap) { h = realloc_or_die(h, cap, cap*2, sizeof(SsspItem), MEM_ROUTING); cap *= 2; }
+            long j = len++;
+            while (j > 0 && h[(j-1)/2].d > nd) { h[j] = h[(j-1)/2]; j = (j-1)/2; }
+            h[j] = (SsspItem){nd, v};
+        }
+    }
+    free_array(h, cap, sizeof(SsspItem), MEM_ROUTING);
+    return settled;
+}
+
+typedef struct { const RouteCSR *c; ApspTable *t; int32_t *next32; int nb, kb; } ApspJob;
+
+/* Source row by Dijkstra; the first hop of each target follows from the settle order
+   (a node's predecessor is settled before it). Lazy-heap ties can settle a node twice,
+   so first hops are assigned once per node. */
+static void apsp_dijkstra_row(void *ctx, int src) {
+    ApspJob *job = ctx; const RouteCSR *c = job->c; int n = c->n;
+    float *dist = job->t->cost + (size_t)src * n;
+    uint16_t *next = job->t->next + (size_t)src * n;
+    int *pred = realloc_or_die(NULL, 0, (size_t)n, sizeof(int), MEM_ROUTING);
+    int *order = realloc_or_die(NULL, 0, (size_t)n * 2, sizeof(int), MEM_ROUTING);
+    for (int i=0;i<n;++i) next[i] = APSP_NO_HOP;
+    int settled = sssp_heap_full(c, src, dist, pred, order);
+    for (int k=0;k<settled;++k) {
+        int v = order[k], p = pred[v];
+        if (v == src || next[v] != APSP_NO_HOP) continue;
+        next[v] = (uint16_t)(p == src ? v : next[p]);
+    }
+    free_array(order, (size_t)n * 2, sizeof(int), MEM_ROUTING);
+    free_array(pred, n, sizeof(int), MEM_ROUTING);
+}
+
+/* Relax tile (ib, jb) through every k of tile kb; k outermost keeps in-tile updates valid. */
+static void fw_tile(float *d, int32_t *nx, int n, int ib, int jb, int kb) {
+    int i0 = ib*APSP_BLOCK, i1 = i0+APSP_BLOCK < n ? i0+APSP_BLOCK : n;
+    int j0 = jb*APSP_BLOCK, j1 = j0+APSP_BLOCK < n ? j0+APSP_BLOCK : n;
+    int k0 = kb*APSP_BLOCK, k1 = k0+APSP_BLOCK < n ? k0+APSP_BLOCK : n;
+    for (int k=k0;k<k1;++k) {
+        const float *dk = d + (size_t)k*n;
+        for (int i=i0;i<i1;++i) {
+            float *di = d + (size_t)i*n; int32_t *ni = nx + (size_t)i*n;
+            float dik = di[k];
+            if (dik == FLT_MAX) continue;
+            int32_t nik = ni[k];
+            int j = j0;
+#ifdef __SSE2__
+            __m128 vik = _mm_set1_ps(dik);
+            __m128i vnik = _mm_set1_epi32(nik);
+            for (; j+4 <= j1; j += 4) {
+                __m128 cand = _mm_add_ps(vik, _mm_loadu_ps(dk + j));
+                __m128 cur = _mm_loadu_ps(di + j);
+                __m128 lt = _mm_cmplt_ps(cand, cur);
+                _mm_storeu_ps(di + j, _mm_or_ps(_mm_and_ps(lt, cand), _mm_andnot_ps(lt, cur)));
+                __m128i m = _mm_castps_si128(lt);
+                __m128i curn = _mm_loadu_si128((const __m128i *)(ni + j));
+                _mm_storeu_si128((__m128i *)(ni + j), _mm_or_si128(_mm_and_si128(m, vnik), _mm_andnot_si128(m, curn)));
+            }
+#endif
+            for (; j<j1; ++j) {
+                float cand = dik + dk[j];
+                if (cand < di[j]) { di[j] = cand; ni[j] = nik; }
+            }
+        }
+    }
+}
+
+static void fw_cross(void *ctx, int t) {   /* tiles in the pivot row and column */
+    ApspJob *job = ctx; int kb = job->kb, b = t / 2;
+    if (b == kb) return;
+    if (t & 1) fw_tile(job->t->cost, job->next32, job->t->n, b, kb, kb);
+    else fw_tile(job->t->cost, job->next32, job->t->n, kb, b, kb);
+}
+
+static void fw_rest(void *ctx, int ib) {  /* every other tile of one tile row */
+    ApspJob *job = ctx; int kb = job->kb;
+    if (ib == kb) return;
+    for (int jb=0;jb<job->nb;++jb) if (jb != kb) fw_tile(job->t->cost, job->next32, job->t->n, ib, jb, kb);
+}
+
+static void apsp_floyd_warshall(ApspJob *job, int threads) {
+    const RouteCSR *c = job->c; int n = c->n;
+    float *d = job->t->cost;
+    int32_t *nx = realloc_or_die(NULL, 0, (size_t)n * n, sizeof(int32_t), MEM_ROUTING);
+    for (size_t i=0;i<(size_t)n*n;++i) { d[i] = FLT_MAX; nx[i] = APSP_NO_HOP; }
+    for (int u=0;u<n;++u) {
+        d[(size_t)u*n+u] = 0.0f;
+        for (int a=c->offsets[u]; a<c->offsets[u+1]; ++a) {
+            size_t ij = (size_t)u*n + c->targets[a];
+            if (c->targets[a] != u && c->cost[a] < d[ij]) { d[ij] = c->cost[a]; nx[ij] = c->targets[a]; }
+        }
+    }
+    job->next32 = nx; job->nb = (n + APSP_BLOCK - 1) / APSP_BLOCK;
+    for (int kb=0; kb<job->nb; ++kb) {
+        job->kb = kb;
+        fw_tile(d, nx, n, kb, kb, kb);
+        parallel_for(2 * job->nb, threads, fw_cross, job);
+        parallel_for(job->nb, threads, fw_rest, job);
+    }
+    for (size_t i=0;i<(size_t)n*n;++i) job->t->next[i] = (uint16_t)nx[i];
+    free_array(nx, (size_t)n * n, sizeof(int32_t), MEM_ROUTING);
+}
+
+/* FNV-1a over names and the routing snapshot: identifies the map a saved table was built for. */
+static uint64_t apsp_fingerprint(const EmotionGraph *g, const RouteCSR *c) {
+    uint64_t h = 1469598103934665603ULL;
+#define FNV_BYTES(p, len) do { const unsigned char *b_ = (const unsigned char *)(p); \
+        for (size_t i_=0;i_<(size_t)(len);++i_) { h ^= b_[i_]; h *= 1099511628211ULL; } } while (0)
+    FNV_BYTES(&c->n, sizeof(c->n));
+    for (int i=0;i<g->count;++i) FNV_BYTES(g->nodes[i].name, strlen(g->nodes[i].name) + 1);
+    FNV_BYTES(c->offsets, sizeof(int) * (size_t)(c->n + 1));
+    FNV_BYTES(c->targets, sizeof(int) * (size_t)c->m);
+    FNV_BYTES(c->cost, sizeof(float) * (size_t)c->m);
+#undef FNV_BYTES
+    return h;
+}
+
+static void apsp_release(void) {
+    ApspTable *t = &route_apsp;
+    size_t nn = (size_t)t->n * t->n;
+    free_array(t->cost, nn, sizeof(float), MEM_ROUTING);
+    free_array(t->next, nn, sizeof(uint16_t), MEM_ROUTING);
+    memset(t, 0, sizeof(*t));
+}
+
+static void apsp_alloc(int n) {
+    apsp_release();
+    route_apsp.n = n;
+    route_apsp.cost = realloc_or_die(NULL, 0, (size_t)n * n, sizeof(float), MEM_ROUTING);
+    route_apsp.next = realloc_or_die(NULL, 0, (size_t)n * n, sizeof(uint16_t), MEM_ROUTING);
+}
+
+static int apsp_fresh(const EmotionGraph *g) {
+    return route_apsp.graph == g && route_apsp.version == g->version;
+}
+
+typedef enum { APSP_AUTO, APSP_FW, APSP_DIJKSTRA } ApspMethod;
+
+/* Returns 0 when the map is too large for a table. */
+int apsp_build(EmotionGraph *g, ApspMethod method, int threads) {
+    if (g->count < 1 || g->count > APSP_MAX_NODES) return 0;
+    TRACE_BEGIN(t0);
+    const RouteCSR *c = route_csr_get(g);
+    apsp_alloc(c->n);
+    ApspJob job = { c, &route_apsp, NULL, 0, 0 };
+    if (method == APSP_AUTO) method = (long long)c->m * 100 >= (long long)c->n * c->n * APSP_FW_PERCENT ? APSP_FW : APSP_DIJKSTRA;
+    if (method == APSP_FW) apsp_floyd_warshall(&job, threads);
+    else parallel_for(c->n, threads, apsp_dijkstra_row, &job);
+    route_apsp.graph = g; route_apsp.version = g->version;
+    route_apsp.fingerprint = apsp_fingerprint(g, c);
+    TRACE_END("apsp_build", t0);
+    return 1;
+}
+
+static void apsp_path_for(const char *datafile, char *buf, size_t size) {
+    snprintf(buf, size, "%s.apsp", datafile);
+}
+
+int apsp_save(const char *datafile) {
+    const ApspTable *t = &route_apsp;
+    if (!t->graph) return 0;
+    char path[1024]; apsp_path_for(datafile, path, sizeof(path));
+    FILE *f = fopen(path, "wb");
+    if (!f) return 0;
+    uint32_t n = (uint32_t)t->n; size_t nn = (size_t)t->n * t->n;
+    int ok = fwrite(APSP_MAGIC, 1, 8, f) == 8 && fwrite(&n, sizeof(n), 1, f) == 1
+          && fwrite(&t->fingerprint, sizeof(t->fingerprint), 1, f) == 1
+          && fwrite(t->cost, sizeof(float), nn, f) == nn && fwrite(t->next, sizeof(uint16_t), nn, f) == nn;
+    if (fclose(f) != 0) ok = 0;
+    return ok;
+}
+
+/* Attaches <datafile>.apsp to g if it was built for exactly this map; silent otherwise. */
+int apsp_attach(EmotionGraph *g, const char *datafile) {
+    char path[1024]; apsp_path_for(datafile, path, sizeof(path));
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    char magic[8]; uint32_t n = 0; uint64_t fp = 0;
+    int ok = fread(magic, 1, 8, f) == 8 && memcmp(magic, APSP_MAGIC, 8) == 0
+          && fread(&n, sizeof(n), 1, f) == 1 && fread(&fp, sizeof(fp), 1, f) == 1
+          && (int)n == g->count && n <= APSP_MAX_NODES && n > 0;
+    if (ok) ok = fp == apsp_fingerprint(g, route_csr_get(g));
+    if (ok) {
+        size_t nn = (size_t)n * n;
+        apsp_alloc((int)n);
+        ok = fread(route_apsp.cost, sizeof(float), nn, f) == nn && fread(route_apsp.next, sizeof(uint16_t), nn, f) == nn;
+        if (ok) { route_apsp.graph = g; route_apsp.version = g->version; route_apsp.fingerprint = fp; }
+        else apsp_release();
+    }
+    fclose(f);
+    return ok;
+}
+
+/* O(1) cost, path by following next hops. Caller checks apsp_fresh(). */
+static float apsp_lookup(EmotionGraph *g, int src, int dest, int out_path[], int *out_len) {
+    const ApspTable *t = &route_apsp; int n = t->n;
+    float cost = t->cost[(size_t)src*n + dest];
+    if (cost == FLT_MAX) return FLT_MAX;
+    int len = 0, cur = src;
+    out_path[len++] = cur;
+    while (cur != dest) {
+        unsigned h = t->next[(size_t)cur*n + dest];
+        /* zero-cost cycles can make per-source hop choices disagree; let a search decide */
+        if (h == APSP_NO_HOP || len >= n) return route_heap(g, src, dest, out_path, out_len);
+        out_path[len++] = cur = (int)h;
+    }
+    *out_len = len;
+    STAT_INC(queries);
+    return cost;
+}
+
+/* Engine form: (re)builds the table when stale, so it can be tested like the others. */
+float route_apsp_engine(EmotionGraph *g, int src, int dest, int out_path[], int *out_len) {
+    if (src < 0 || dest < 0) return FLT_MAX;
+    if (!apsp_fresh(g) && !apsp_build(g, APSP_AUTO, default_thread_count())) return route_heap(g, src, dest, out_path, out_len);
+    return apsp_lookup(g, src, dest, out_path, out_len);
+}
+
+/* Maps whose average out-degree reaches count/DENSE_DEGREE_DIVISOR use the dense engine;
+   below roughly a third of all pairs connected the heap engine measured faster. */
+#define DENSE_DEGREE_DIVISOR 3
+
+/* Below this size the per-query bucket reset costs more than the heap it replaces. */
+#define DIAL_MIN_NODES 1000
+
+/* Engine selector used for planning: a fresh all-pairs table when one is attached,
+   bitset for small maps, the SIMD dense scan when most nodes are connected to many
+   others, buckets for large sparse maps, heap otherwise. */
+float route_auto(EmotionGraph *g, int src, int dest, int out_path[], int *out_len) {
+    if (src >= 0 && dest >= 0 && apsp_fresh(g)) return apsp_lookup(g, src, dest, out_path, out_len);
+    if (g->count <= SMALL_GRAPH_MAX) return route_bitset(g, src, dest, out_path, out_len);
+    if ((long long)g->arcs * DENSE_DEGREE_DIVISOR >= (long long)g->count * g->count) return route_dense(g, src, dest, out_path, out_len);
+    if (g->count >= DIAL_MIN_NODES) return route_dial(g, src, dest, out_path, out_len);
+    return route_heap(g, src, dest, out_path, out_len);
+}
+
+/* ---------- Learning from plan outcomes ----------
+   After a plan the user can say whether each step helped. The step's difficulty moves
+   EDGE_LEARN_RATE of the way toward EDGE_LEARN_EASY (helped) or EDGE_LEARN_HARD (did
+   not), an exponential moving average: recent outcomes count most, and a "yes" never
+   makes a step harder nor a "no" easier. The edge update is O(1), and cached routing
+   state is repaired instead of dropped:
+    - the arc's CSR snapshot entry is rewritten in place (one scan of u's arcs);
+    - a fresh all-pairs table is patched. When the step got cheaper every pair is
+      relaxed through it (O(n^2)); when it got dearer only the sources whose cheapest
+      route to some state used it are searched again.
+   Both keep matching the graph under its new version. Feedback on a mirror arc makes it
+   a user transition, so the learned weight is saved.
+*/
+
+#define EDGE_LEARN_RATE 0.25f
+#define EDGE_LEARN_EASY 0.5f
+#define EDGE_LEARN_HARD 5.0f
+#define EDGE_LEARN_TOL 1e-5f           /* relative slack when asking whether a route used the arc */
+
+/* Rewrites the cost of arc u -> v in the CSR snapshot (absent when ruled out). */
+static void route_csr_patch(int u, int v, float cost) {
+    RouteCSR *c = &route_csr;
+    for (int a=c->offsets[u]; a<c->offsets[u+1]; ++a) {
+        if (c->targets[a] != v) continue;
+        c->cost[a] = cost; c->fixed[a] = cost_to_fixed(cost);
+        if (c->fixed[a] > c->max_fixed) c->max_fixed = c->fixed[a];   /* a loose bound stays valid */
+        return;
+    }
+}
+
+/* Arc u -> v now costs w, less than before: route every pair through it where that is cheaper. */
+static void apsp_patch_cheaper(int u, int v, float w) {
+    ApspTable *t = &route_apsp; int n = t->n;
+    const float *dv = t->cost + (size_t)v * n;
+    for (int i=0;i<n;++i) {
+        float *di = t->cost + (size_t)i * n; uint16_t *ni = t->next + (size_t)i * n;
+        float diu = di[u];
+        if (diu == FLT_MAX) continue;
+        uint16_t hop = i == u ? (uint16_t)v : ni[u];
+        for (int j=0;j<n;++j) {
+            if (dv[j] == FLT_MAX) continue;
+            float via = diu + w + dv[j];
+            if (via < di[j]) { di[j] = via; ni[j] = hop; }
+        }
+    }
+}
+
+typedef struct { ApspJob job; const int *rows; } ApspRowsJob;
+
+static void apsp_dijkstra_listed(void *ctx, int k) {
+    ApspRowsJob *r = ctx;
+    apsp_dijkstra_row(&r->job, r->rows[k]);
+}
+
+/* Arc u -> v cost w_old and now costs more (c already has the new cost): recompute the
+   rows of sources with some cheapest route through it. Returns how many were redone. */
+static int apsp_patch_dearer(const RouteCSR *c, int u, int v, float w_old) {
+    ApspTable *t = &route_apsp; int n = t->n, nrows = 0;
+    const float *dv = t->cost + (size_t)v * n;
+    int *rows = realloc_or_die(NULL, 0, (size_t)n, sizeof(int), MEM_ROUTING);
+    for (int i=0;i<n;++i) {
+        const float *di = t->cost + (size_t)i * n;
+        float diu = di[u];
+        if (diu == FLT_MAX) continue;
+        for (int j=0;j<n;++j) {
+            if (dv[j] == FLT_MAX) continue;
+            if (diu + w_old + dv[j] <= di[j] * (1.0f + EDGE_LEARN_TOL) + EDGE_LEARN_TOL) { rows[nrows++] = i; break; }
+        }
+    }
+    ApspRowsJob job = { { c, t, NULL, 0, 0 }, rows };
+    parallel_for(nrows, default_thread_count(), apsp_dijkstra_listed, &job);
+    free_array(rows, n, sizeof(int), MEM_ROUTING);
+    return nrows;
+}
+
+/* Outcome of step u -> v of a plan. Returns the arc's new weight, or -1 without such an arc. */
+float graph_learn_step(EmotionGraph *g, int u, int v, int helped) {
+    Edge *e = graph_find_arc(g, u, v);
+    if (!e) return -1.0f;
+    TRACE_BEGIN(t0);
+    int apsp_was_fresh = apsp_fresh(g);
+    if (apsp_was_fresh) route_csr_get(g);   /* the repair reads the snapshot */
+    int csr_was_fresh = route_csr.graph == g && route_csr.version == g->version;
+    float old_cost = personalized_weight(g, e);
+    float target = helped ? (e->weight < EDGE_LEARN_EASY ? e->weight : EDGE_LEARN_EASY)
+                          : (e->weight > EDGE_LEARN_HARD ? e->weight : EDGE_LEARN_HARD);
+    e->weight += EDGE_LEARN_RATE * (target - e->weight);
+    e->reverse = 0;
+    float cost = personalized_weight(g, e);
+    graph_touch(g);
+    if (csr_was_fresh) {
+        route_csr_patch(u, v, cost);
+        route_csr.version = g->version;
+    }
+    if (apsp_was_fresh && !(g->nodes[u].forbid & g->nodes[v].classes)) {
+        if (cost < old_cost) apsp_patch_cheaper(u, v, cost);
+        else if (cost > old_cost) apsp_patch_dearer(&route_csr, u, v, old_cost);
+    }
+    if (apsp_was_fresh) {
+        route_apsp.version = g->version;
+        route_apsp.fingerprint = apsp_fingerprint(g, &route_csr);
+    }
+    TRACE_END("learn_step", t0);
+    return e->weight;
+}
+
+/* ---------- Routing engines ----------
+   Every engine has the run_dijkstra_personalized signature and contract. 'route_active'
+   is what planning uses; the differential self-test checks all of them against the
+   reference.
+*/
+
+typedef float (*RouteFn)(EmotionGraph *g, int src, int dest, int out_path[], int *out_len);
+/* 'quantized' engines search on fixed-point costs and may return a near-tie route. */
+typedef struct { const char *name; RouteFn fn; int quantized; } RouteEngine;
+
+static const RouteEngine route_engines[] = {
+    {"reference", run_dijkstra_personalized, 0},
+    {"heap", route_heap, 0},
+    {"bitset", route_bitset, 0},
+    {"dense", route_dense, 0},
+    {"dial", route_dial, 1},
+    {"delta", route_delta, 0},
+    {"apsp", route_apsp_engine, 0},
+    {"auto", route_auto, 1},
+};
+#define ROUTE_ENGINE_COUNT ((int)(sizeof(route_engines)/sizeof(route_engines[0])))
+
+static RouteFn route_active = route_auto;
+
+static const RouteEngine *route_engine_find(const char *name) {
+    for (int i=0;i<ROUTE_ENGINE_COUNT;++i) if (strcmp(route_engines[i].name, name) == 0) return &route_engines[i];
+    return NULL;
+}
+
+/* One Dijkstra over the CSR snapshot that stops at the first goal it settles: that goal
+   is the cheapest one to reach. Goals are marked in route_scratch.visited for the query. */
+static float plan_multi_goal(EmotionGraph *g, int src, const int goal_idx[], int gcount,
+                             int out_path[], int *out_len, int *out_goal) {
+    const RouteCSR *c = route_csr_get(g);
+    int n = c->n;
+    route_scratch_reserve(n);
+    float *dist = route_scratch.dist; int *prev = route_scratch.prev, *mark = route_scratch.visited;
+    for (int i=0;i<n;++i) { dist[i] = FLT_MAX; prev[i] = -1; mark[i] = 0; }
+    for (int i=0;i<gcount;++i) if (goal_idx[i] >= 0) mark[goal_idx[i]] = 1;
+    STAT_INC(queries);
+    long cap = 256, len = 0;
+    SsspItem *h = realloc_or_die(NULL, 0, (size_t)cap, sizeof(SsspItem), MEM_ROUTING);
+    dist[src] = 0.0f; h[len++] = (SsspItem){0.0f, src};
+    int goal = -1;
+    while (len > 0) {
+        SsspItem top = h[0], last = h[--len];
+        long i = 0;
+        for (;;) {
+            long l = 2*i+1; if (l >= len) break;
+            if (l+1 < len && h[l+1].d < h[l].d) ++l;
+            if (h[l].d >= last.d) break;
+            h[i] = h[l]; i = l;
+        }
+        if (len > 0) h[i] = last;
+        STAT_INC(heap_ops);
+        if (top.d > dist[top.v]) continue;
+        STAT_INC(nodes_settled);
+        if (mark[top.v]) { goal = top.v; break; }
+        STAT_ADD(edges_relaxed, c->offsets[top.v+1] - c->offsets[top.v]);
+        for (int a=c->offsets[top.v]; a<c->offsets[top.v+1]; ++a) {
+            int v = c->targets[a]; float nd = top.d + c->cost[a];
+            if (nd >= dist[v]) continue;
+            dist[v] = nd; prev[v] = top.v;
+            if (len == cap) { h = realloc_or_die(h, cap, cap*2, sizeof(SsspItem), MEM_ROUTING); cap *= 2; }
+            long j = len++;
+            while (j > 0 && h[(j-1)/2].d > nd) { h[j] = h[(j-1)/2]; j = (j-1)/2; }
+            h[j] = (SsspItem){nd, v};
+            STAT_INC(heap_ops);
+        }
+    }
+    free_array(h, cap, sizeof(SsspItem), MEM_ROUTING);
+    if (out_goal) *out_goal = goal;
+    if (goal < 0) { *out_len = 0; return FLT_MAX; }
+    *out_len = route_emit_path(goal, prev, out_path);
+    return dist[goal];
+}
+
+/* Multi-goal planning: cheapest route from src to any of the given goals.
+   out_path must hold every step of the route (g->count always suffices).
+   Returns FLT_MAX when no goal is reachable. A fresh all-pairs table answers from
+   its rows; a single goal goes to the active engine; otherwise one search. */
+float plan_best_goal(EmotionGraph *g, int src, const int goal_idx[], int gcount,
+                     int out_path[], int *out_len, int *out_goal) {
+    *out_len = 0;
+    if (out_goal) *out_goal = -1;
+    if (src < 0 || gcount < 1) return FLT_MAX;
+    TRACE_BEGIN(t0);
+    float best_cost = FLT_MAX;
+    if (apsp_fresh(g)) {
+        int best_goal = -1;
+        for (int i=0;i<gcount;++i) {
+            float c = goal_idx[i] >= 0 ? route_apsp.cost[(size_t)src * route_apsp.n + goal_idx[i]] : FLT_MAX;
+            if (c < best_cost) { best_cost = c; best_goal = goal_idx[i]; }
+        }
+        if (best_goal >= 0) best_cost = apsp_lookup(g, src, best_goal, out_path, out_len);
+        if (out_goal) *out_goal = best_goal;
+    } else if (gcount == 1) {
+        if (goal_idx[0] >= 0) best_cost = route_active(g, src, goal_idx[0], out_path, out_len);
+        if (out_goal && best_cost != FLT_MAX) *out_goal = goal_idx[0];
+    } else {
+        best_cost = plan_multi_goal(g, src, goal_idx, gcount, out_path, out_len, out_goal);
+    }
+    TRACE_END("plan", t0);
+    return best_cost;
+}
+
+/* ---------- Hop-limited planning ----------
+   Cheapest route to any goal using at most max_steps transitions: a layered
+   Bellman-Ford over the CSR snapshot that only expands what changed. Layer h holds
+   one label per node whose cost with exactly h steps beat every cost found with fewer
+   steps (anything else is dominated: more steps and no cheaper). Labels live in
+   a reusable pool and point at their parent label, so the route is read back from the
+   goal's label. Per-node state is reset by epoch stamps, so a query costs O(touched
+   arcs), not O(n * max_steps).
+*/
+
+typedef struct { int node, parent; float cost; } HopLabel;
+
+static struct {
+    int n_cap;
+    unsigned *seen;          /* epoch in which best/best_label were set */
+    unsigned *in_layer;      /* epoch+layer stamp: node already has a label in that layer */
+    int *layer_label;        /* that label's index */
+    float *best;             /* cheapest cost with any step count so far */
+    int *best_label;
+    HopLabel *labels; int label_count, label_cap;
+    unsigned epoch;
+} hop_scratch;
+
+static void hop_scratch_reserve(int n) {
+    if (n <= hop_scratch.n_cap) return;
+    int old = hop_scratch.n_cap;
+    hop_scratch.seen = realloc_or_die(hop_scratch.seen, old, n, sizeof(unsigned), MEM_ROUTING);
+    hop_scratch.in_layer = realloc_or_die(hop_scratch.in_layer, old, n, sizeof(unsigned), MEM_ROUTING);
+    hop_scratch.layer_label = realloc_or_die(hop_scratch.layer_label, old, n, sizeof(int), MEM_ROUTING);
+    hop_scratch.best = realloc_or_die(hop_scratch.best, old, n, sizeof(float), MEM_ROUTING);
+    hop_scratch.best_label = realloc_or_die(hop_scratch.best_label, old, n, sizeof(int), MEM_ROUTING);
+    memset(hop_scratch.seen + old, 0, sizeof(unsigned) * (size_t)(n - old));
+    memset(hop_scratch.in_layer + old, 0, sizeof(unsigned) * (size_t)(n - old));
+    hop_scratch.n_cap = n;
+}
+
+static int hop_label_new(int node, int parent, float cost) {
+    if (hop_scratch.label_count == hop_scratch.label_cap) {
+        int nc = hop_scratch.label_cap ? hop_scratch.label_cap * 2 : 1024;
+        hop_scratch.labels = realloc_or_die(hop_scratch.labels, hop_scratch.label_cap, nc, sizeof(HopLabel), MEM_ROUTING);
+        hop_scratch.label_cap = nc;
+    }
+    hop_scratch.labels[hop_scratch.label_count] = (HopLabel){ node, parent, cost };
+    return hop_scratch.label_count++;
+}
+
+/* Like plan_best_goal, limited to max_steps transitions (max_steps <= 0: no limit). */
+float plan_hop_limited(EmotionGraph *g, int src, const int goal_idx[], int gcount, int max_steps,
+                       int out_path[], int *out_len, int *out_goal) {
+    if (max_steps <= 0 || max_steps >= g->count) return plan_best_goal(g, src, goal_idx, gcount, out_path, out_len, out_goal);
+    if (src < 0) return FLT_MAX;
+    TRACE_BEGIN(t0);
+    const RouteCSR *c = route_csr_get(g);
+    hop_scratch_reserve(c->n);
+    /* epochs advance by max_steps+1 per query so layer stamps never collide */
+    unsigned epoch = hop_scratch.epoch + 1;
+    if (epoch + (unsigned)max_steps + 2 < epoch) {   /* wrapped: clear stamps once */
+        memset(hop_scratch.seen, 0, sizeof(unsigned) * (size_t)hop_scratch.n_cap);
+        memset(hop_scratch.in_layer, 0, sizeof(unsigned) * (size_t)hop_scratch.n_cap);
+        epoch = 1;
+    }
+    hop_scratch.epoch = epoch + (unsigned)max_steps + 1;
+    unsigned *seen = hop_scratch.seen, *in_layer = hop_scratch.in_layer;
+    float *best = hop_scratch.best; int *best_label = hop_scratch.best_label, *layer_label = hop_scratch.layer_label;
+    STAT_INC(queries);
+
+    hop_scratch.label_count = 0;
+    int root = hop_label_new(src, -1, 0.0f);
+    seen[src] = epoch; best[src] = 0.0f; best_label[src] = root;
+    int layer_begin = root, layer_end = root + 1;
+    for (int h=1; h<=max_steps && layer_begin < layer_end; ++h) {
+        unsigned stamp = epoch + (unsigned)h;
+        for (int li=layer_begin; li<layer_end; ++li) {
+            HopLabel lab = hop_scratch.labels[li];   /* copy: the pool may move while we add */
+            STAT_INC(nodes_settled);
+            STAT_ADD(edges_relaxed, c->offsets[lab.node+1] - c->offsets[lab.node]);
+            for (int a=c->offsets[lab.node]; a<c->offsets[lab.node+1]; ++a) {
+                int v = c->targets[a]; float cand = lab.cost + c->cost[a];
+                if (seen[v] == epoch && cand >= best[v]) continue;
+                seen[v] = epoch; best[v] = cand;
+                if (in_layer[v] == stamp) {
+                    HopLabel *l = &hop_scratch.labels[layer_label[v]];
+                    l->cost = cand; l->parent = li;
+                } else {
+                    in_layer[v] = stamp;
+                    layer_label[v] = hop_label_new(v, li, cand);
+                }
+                best_label[v] = layer_label[v];
+            }
+        }
+        layer_begin = layer_end;
+        layer_end = hop_scratch.label_count;
+    }
+
+    float best_cost = FLT_MAX; int goal = -1;
+    for (int i=0;i<gcount;++i) {
+        int v = goal_idx[i];
+        if (v >= 0 && seen[v] == epoch && best[v] < best_cost) { best_cost = best[v]; goal = v; }
+    }
+    if (goal >= 0) {
+        int len = 0;
+        for (int li = best_label[goal]; li >= 0; li = hop_scratch.labels[li].parent) ++len;
+        *out_len = len;
+        for (int li = best_label[goal]; li >= 0; li = hop_scratch.labels[li].parent) out_path[--len] = hop_scratch.labels[li].node;
+    } else *out_len = 0;
+    if (out_goal) *out_goal = goal;
+    TRACE_END("plan_hops", t0);
+    return best_cost;
+}
+
+/* ---------- Pareto plans ----------
+   Plans that trade difficulty against length and guidance: every route to a goal
+   that no other route beats on all three of (cost, steps, steps without an action).
+   Label-setting search in cost order. Each node keeps its non-dominated labels in a
+   list; a new label is dropped if one of them (or a plan already found) is at least as
+   good on every criterion, and it retires the ones it beats. All criteria only grow
+   along a route, so a goal label is never extended and a dominated label can never
+   lead to a front member. Labels come from a reusable pool and per-node lists are
+   reset by epoch stamps.
+*/
+
+#define PARETO_MAX_PLANS 8
+
+typedef struct { float cost; int steps, unguided; int label; } ParetoPlan;
+
+typedef struct {
+    int node, parent, next_at_node;
+    float cost; int steps, unguided;
+    unsigned char dead;
+} ParetoLabel;
+
+static struct {
+    int n_cap;
+    unsigned *seen;          /* epoch in which head[] is valid */
+    int *head;               /* first live label at the node */
+    unsigned char *is_goal;
+    ParetoLabel *labels; int label_count, label_cap;
+    int *heap; int heap_len, heap_cap;
+    unsigned epoch;
+} pareto_scratch;
+
+static void pareto_scratch_reserve(int n) {
+    if (n <= pareto_scratch.n_cap) return;
+    int old = pareto_scratch.n_cap;
+    pareto_scratch.seen = realloc_or_die(pareto_scratch.seen, old, n, sizeof(unsigned), MEM_ROUTING);
+    pareto_scratch.head = realloc_or_die(pareto_scratch.head, old, n, sizeof(int), MEM_ROUTING);
+    pareto_scratch.is_goal = realloc_or_die(pareto_scratch.is_goal, old, n, 1, MEM_ROUTING);
+    memset(pareto_scratch.seen + old, 0, sizeof(unsigned) * (size_t)(n - old));
+    memset(pareto_scratch.is_goal + old, 0, (size_t)(n - old));
+    pareto_scratch.n_cap = n;
+}
+
+static int pareto_label_new(int node, int parent, float cost, int steps, int unguided) {
+    if (pareto_scratch.label_count == pareto_scratch.label_cap) {
+        int nc = pareto_scratch.label_cap ? pareto_scratch.label_cap * 2 : 1024;
+        pareto_scratch.labels = realloc_or_die(pareto_scratch.labels, pareto_scratch.label_cap, nc, sizeof(ParetoLabel), MEM_ROUTING);
+        pareto_scratch.label_cap = nc;
+    }
+    pareto_scratch.labels[pareto_scratch.label_count] = (ParetoLabel){ node, parent, -1, cost, steps, unguided, 0 };
+    return pareto_scratch.label_count++;
+}
+
+/* Heap order: cost, then steps, then unguided steps. */
+static int pareto_less(int a, int b) {
+    const ParetoLabel *x = &pareto_scratch.labels[a], *y = &pareto_scratch.labels[b];
+    if (x->cost != y->cost) return x->cost < y->cost;
+    if (x->steps != y->steps) return x->steps < y->steps;
+    return x->unguided < y->unguided;
+}
+
+static void pareto_push(int li) {
+    if (pareto_scratch.heap_len == pareto_scratch.heap_cap) {
+        int nc = pareto_scratch.heap_cap ? pareto_scratch.heap_cap * 2 : 1024;
+        pareto_scratch.heap = realloc_or_die(pareto_scratch.heap, pareto_scratch.heap_cap, nc, sizeof(int), MEM_ROUTING);
+        pareto_scratch.heap_cap = nc;
+    }
+    int *h = pareto_scratch.heap, i = pareto_scratch.heap_len++;
+    while (i > 0 && pareto_less(li, h[(i-1)/2])) { h[i] = h[(i-1)/2]; i = (i-1)/2; }
+    h[i] = li;
+    STAT_INC(heap_ops);
+}
+
+static int pareto_pop(void) {
+    int *h = pareto_scratch.heap, top = h[0], last = h[--pareto_scratch.heap_len], n = pareto_scratch.heap_len, i = 0;
+    for (;;) {
+        int l = 2*i+1; if (l >= n) break;
+        if (l+1 < n && pareto_less(h[l+1], h[l])) ++l;
+        if (!pareto_less(h[l], last)) break;
+        h[i] = h[l]; i = l;
+    }
+    if (n > 0) h[i] = last;
+    STAT_INC(heap_ops);
+    return top;
+}
+
+static int pareto_dominates(float c1, int s1, int u1, float c2, int s2, int u2) {
+    return c1 <= c2 && s1 <= s2 && u1 <= u2;
+}
+
+/* Fills plans[] (cheapest first) and returns how many; paths via pareto_plan_path()
+   until the next call. max_steps <= 0 means no step limit. */
+int plan_pareto(EmotionGraph *g, int src, const int goal_idx[], int gcount, int max_steps,
+                ParetoPlan plans[], int max_plans) {
+    if (src < 0 || max_plans < 1) return 0;
+    TRACE_BEGIN(t0);
+    const RouteCSR *c = route_csr_get(g);
+    pareto_scratch_reserve(c->n);
+    if (++pareto_scratch.epoch == 0) {
+        memset(pareto_scratch.seen, 0, sizeof(unsigned) * (size_t)pareto_scratch.n_cap);
+        pareto_scratch.epoch = 1;
+    }
+    unsigned epoch = pareto_scratch.epoch;
+    unsigned *seen = pareto_scratch.seen; int *head = pareto_scratch.head;
+    for (int i=0;i<gcount;++i) if (goal_idx[i] >= 0) pareto_scratch.is_goal[goal_idx[i]] = 1;
+    pareto_scratch.label_count = 0; pareto_scratch.heap_len = 0;
+    STAT_INC(queries);
+
+    int nplans = 0;
+    int root = pareto_label_new(src, -1, 0.0f, 0, 0);
+    seen[src] = epoch; head[src] = root;
+    pareto_push(root);
+    while (pareto_scratch.heap_len > 0) {
+        int li = pareto_pop();
+        ParetoLabel lab = pareto_scratch.labels[li];
+        if (lab.dead) continue;
+        /* labels leave the heap in cost order, so a goal label is final unless an
+           earlier plan already covers it */
+        if (pareto_scratch.is_goal[lab.node]) {
+            int covered = 0;
+            for (int p=0;p<nplans && !covered;++p)
+                covered = pareto_dominates(plans[p].cost, plans[p].steps, plans[p].unguided, lab.cost, lab.steps, lab.unguided);
+            if (!covered && nplans < max_plans) plans[nplans++] = (ParetoPlan){ lab.cost, lab.steps, lab.unguided, li };
+            continue;
+        }
+        if (max_steps > 0 && lab.steps >= max_steps) continue;
+        int beaten = 0;   /* plans found since this label was queued */
+        for (int p=0;p<nplans && !beaten;++p)
+            beaten = pareto_dominates(plans[p].cost, plans[p].steps, plans[p].unguided, lab.cost, lab.steps, lab.unguided);
+        if (beaten) continue;
+        STAT_INC(nodes_settled);
+        STAT_ADD(edges_relaxed, c->offsets[lab.node+1] - c->offsets[lab.node]);
+        for (int a=c->offsets[lab.node]; a<c->offsets[lab.node+1]; ++a) {
+            int v = c->targets[a];
+            float cost = lab.cost + c->cost[a];
+            int steps = lab.steps + 1, unguided = lab.unguided + !c->guided[a];
+            int beaten = 0;
+            for (int p=0;p<nplans && !beaten;++p)
+                beaten = pareto_dominates(plans[p].cost, plans[p].steps, plans[p].unguided, cost, steps, unguided);
+            if (beaten) continue;
+            if (seen[v] != epoch) { seen[v] = epoch; head[v] = -1; }
+            /* compare with v's live labels, unlinking the ones the new label beats */
+            int *link = &head[v];
+            while (*link >= 0 && !beaten) {
+                ParetoLabel *o = &pareto_scratch.labels[*link];
+                if (pareto_dominates(o->cost, o->steps, o->unguided, cost, steps, unguided)) beaten = 1;
+                else if (pareto_dominates(cost, steps, unguided, o->cost, o->steps, o->unguided)) { o->dead = 1; *link = o->next_at_node; }
+                else link = &o->next_at_node;
+            }
+            if (beaten) continue;
+            int nl = pareto_label_new(v, li, cost, steps, unguided);
+            pareto_scratch.labels[nl].next_at_node = head[v];
+            head[v] = nl;
+            pareto_push(nl);
+        }
+    }
+    for (int i=0;i<gcount;++i) if (goal_idx[i] >= 0) pareto_scratch.is_goal[goal_idx[i]] = 0;
+    TRACE_END("plan_pareto", t0);
+    return nplans;
+}
+
+/* Writes the plan's route into out_path (plan.steps + 1 entries) and returns its length. */
+int pareto_plan_path(const ParetoPlan *plan, int out_path[]) {
+    int len = plan->steps + 1;
+    for (int li = plan->label, i = len; li >= 0; li = pareto_scratch.labels[li].parent) out_path[--i] = pareto_scratch.labels[li].node;
+    return len;
+}
+
+/* ---------- I/O helpers ---------- */
+
+static void read_line_trim(char *buf, int size) {
+    if (!fgets(buf, size, stdin)) { buf[0]='\0'; return; }
+    size_t len = strlen(buf);
+    if (len>0 && buf[len-1]=='\n') buf[len-1] = '\0';
+    char *p=buf; while (*p && isspace((unsigned char)*p)) ++p;
+    if (p != buf) memmove(buf, p, strlen(p)+1);
+}
+static int read_int_in_range(const char *prompt, int lo, int hi) {
+    char buf[128]; int val;
+    while (1) {
+        printf("%s (%d-%d): ", prompt, lo, hi);
+        read_line_trim(buf, sizeof(buf));
+        if (sscanf(buf, "%d", &val) == 1 && val >= lo && val <= hi) return val;
+        printf("  Please enter a number between %d and %d.\n", lo, hi);
+    }
+}
+
+/* ---------- Persistence: save/load (format A) ---------- */
+
+static void fwrite_quoted(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; ++s) {
+        if (*s == '"' || *s == '\\') fputc('\\', f);
+        fputc((unsigned char)*s, f);
+    }
+    fputc('"', f);
+}
+
+int save_graph(EmotionGraph *g, const char *filename) {
+    LAT_BEGIN(t0);
+    FILE *f = fopen(filename, "w");
+    if (!f) { perror("fopen"); return 0; }
+    /* rules first, so the edges below are checked against them on load */
+    const RuleTable *r = &g->rules;
+    for (int c=0;c<r->count;++c) {
+        const RuleClass *rc = &r->classes[c];
+        for (int i=0;i<rc->members_count || i==0; i+=16) {   /* several CLASS lines keep lines short */
+            fprintf(f, "CLASS %s", rc->name);
+            for (int k=i;k<i+16 && k<rc->members_count;++k) fprintf(f, " %s", rc->members[k]);
+            fputc('\n', f);
+        }
+    }
+    for (int c=0;c<r->count;++c)
+        for (int t=0;t<r->count;++t)
+            if (r->classes[c].forbid_to >> t & 1) fprintf(f, "RULE %s %s\n", r->classes[c].name, r->classes[t].name);
+    const GoalTable *gt = &g->goals;
+    for (int s=0;s<gt->count;++s) {
+        const GoalSet *gs = &gt->sets[s];
+        for (int i=0;i<gs->members_count || i==0; i+=16) {
+            fprintf(f, "GOALSET %s", gs->name);
+            for (int k=i;k<i+16 && k<gs->members_count;++k) fprintf(f, " %s", gs->members[k]);
+            fputc('\n', f);
+        }
+    }
+    if (gt->count) fprintf(f, "GOALS %s\n", gt->sets[gt->active].name);
+    for (int i=0;i<g->aliases.count;++i) {
+        fprintf(f, "ALIAS ");
+        fwrite_quoted(f, g->aliases.items[i].surface);
+        fprintf(f, " %s\n", g->aliases.items[i].canonical);
+    }
+    for (int i=0;i<g->keywords.count;++i) {
+        fprintf(f, "KEYWORD ");
+        fwrite_quoted(f, g->keywords.items[i].phrase);
+        fprintf(f, " %s %.2f\n", g->keywords.items[i].emotion, g->keywords.items[i].weight);
+    }
+    for (int i=0;i<g->count;++i) {
+        EmotionNode *n = &g->nodes[i];
+        fprintf(f, "NODE %s %.3f %.3f\n", n->name, n->valence, n->baseline_intensity);
+        for (int t=0;t<n->tips_count;++t) {
+            const Tip *tp = &n->tips[t];
+            fprintf(f, "TIP %s ", n->name);
+            fwrite_quoted(f, tp->text);
+            fprintf(f, " %d %d %d", tp->tried, tp->helped, tp->day);   /* day too, so an untried tip keeps its age */
+            fputc('\n', f);
+        }
+    }
+    for (int i=0;i<g->count;++i) {
+        EmotionNode *n = &g->nodes[i];
+        for (int e=0;e<n->edges_count;++e) {
+            int to = n->edges[e].to;
+            if (!n->edges[e].reverse) { // mirror arcs are recreated on load
+                fprintf(f, "EDGE %s %s %.3f ", n->name, g->nodes[to].name, n->edges[e].weight);
+                if (n->edges[e].procedure) fwrite_quoted(f, n->edges[e].procedure);
+                else fprintf(f, "\"\"");
+                fputc('\n', f);
+            }
+        }
+    }
+    long written = ftell(f);
+    if (written > 0) STAT_ADD(bytes_saved, written);
+    fclose(f);
+    LAT_RECORD(OP_SAVE, t0);
+    return 1;
+}
+
+static char *parse_quoted(const char *s, const char **endptr) {
+    if (!s || *s != '"') { if (endptr) *endptr = s; return NULL; }
+    const char *p = s+1; char buf[MAX_LINE]; int bi=0;
+    while (*p && *p != '"') {
+        if (*p == '\\' && *(p+1)) { p++; buf[bi++] = *p++; }
+        else buf[bi++] = *p++;
+        if (bi >= MAX_LINE-1) break;
+    }
+    buf[bi]='\0'; if (*p == '"') p++;
+    if (endptr) *endptr = p;
+    return strdup_s(buf, MEM_OTHER);
+}
+
+int load_graph(EmotionGraph *g, const char *filename) {
+    LAT_BEGIN(t0);
+    FILE *f = fopen(filename, "r");
+    if (!f) return 0;
+    g->loading = 1;
+    char line[MAX_LINE];
+    int file_rules = 0, file_goals = 0;   /* the first CLASS/RULE (GOALSET) line replaces the current table */
+    char active_goals[MAX_NAME_LEN] = ""; /* GOALS is resolved after every GOALSET line is read */
+    while (fgets(line, sizeof(line), f)) {
+        size_t ln = strlen(line); STAT_ADD(bytes_loaded, ln);
+        if (ln>0 && line[ln-1]=='\n') line[ln-1]='\0';
+        char *p = line; while (*p && isspace((unsigned char)*p)) ++p;
+        if (!*p || *p == '#') continue;
+        char token[32];
+        if (sscanf(p, "%31s", token) != 1) continue;
+        if (strcmp(token, "NODE") == 0) {
+            p += 4; while (*p && isspace((unsigned char)*p)) ++p;
+            char name[MAX_NAME_LEN]; float val=0.0f, base=5.0f;
+            if (sscanf(p, "%47s %f %f", name, &val, &base) >= 1) {
+                graph_add_node(g, name, val, base);
+                int idx = graph_find(g, name);
+                if (idx != -1) {
+                    /* attempt more precise parse */
+                    char tmp[MAX_LINE]; strncpy(tmp, p, sizeof(tmp)); tmp[sizeof(tmp)-1]=0;
+                    char *tok = strtok(tmp, " \t");
+                    if (tok) { tok = strtok(NULL, " \t"); if (tok) g->nodes[idx].valence = atof(tok); tok = strtok(NULL, " \t"); if (tok) g->nodes[idx].baseline_intensity = atof(tok); }
+                    graph_touch(g);
+                }
+            }
+        } else if (strcmp(token, "CLASS") == 0 || strcmp(token, "RULE") == 0) {
+            if (!file_rules) { rules_clear(g); file_rules = 1; }
+            p += strlen(token);
+            char a[MAX_NAME_LEN], b[MAX_NAME_LEN]; int used = 0;
+            if (sscanf(p, "%47s%n", a, &used) != 1) continue;
+            int ca = rules_class_add(g, a);
+            if (ca < 0) { fprintf(stderr, "%s: more than %d rule classes, '%s' ignored\n", filename, RULE_MAX_CLASSES, a); continue; }
+            p += used;
+            if (token[0] == 'C') {
+                while (sscanf(p, "%47s%n", b, &used) == 1) { rules_add_member(g, ca, b); p += used; }
+            } else if (sscanf(p, "%47s", b) == 1) {
+                int cb = rules_class_add(g, b);
+                if (cb >= 0) rules_add_rule(g, ca, cb);
+            }
+        } else if (strcmp(token, "GOALSET") == 0) {
+            if (!file_goals) { goals_clear(g); file_goals = 1; }
+            p += 7;
+            char name[MAX_NAME_LEN]; int used = 0;
+            if (sscanf(p, "%47s%n", name, &used) != 1) continue;
+            int gs = goals_set_add(g, name);
+            if (gs < 0) { fprintf(stderr, "%s: more than %d goal sets, '%s' ignored\n", filename, GOALSET_MAX, name); continue; }
+            p += used;
+            while (sscanf(p, "%47s%n", name, &used) == 1) { goals_add_member(g, gs, name); p += used; }
+        } else if (strcmp(token, "GOALS") == 0) {
+            if (sscanf(p + 5, "%47s", active_goals) != 1) active_goals[0] = 0;
+        } else if (strcmp(token, "ALIAS") == 0) {
+            p += 5; while (*p && isspace((unsigned char)*p)) ++p;
+            const char *endptr; char *surface = parse_quoted(p, &endptr);
+            char canon[MAX_NAME_LEN];
+            if (surface && *surface && sscanf(endptr, "%47s", canon) == 1) aliases_add(g, surface, canon);
+            if (surface) free_str(surface, MEM_OTHER);
+        } else if (strcmp(token, "KEYWORD") == 0) {
+            p += 7; while (*p && isspace((unsigned char)*p)) ++p;
+            const char *endptr; char *phrase = parse_quoted(p, &endptr);
+            char emo[MAX_NAME_LEN]; float w = 1.0f;
+            if (phrase && *phrase && sscanf(endptr, "%47s %f", emo, &w) >= 1) keywords_add(g, phrase, emo, w);
+            if (phrase) free_str(phrase, MEM_OTHER);
+        } else if (strcmp(token, "TIP") == 0) {
+            p += 3; while (*p && isspace((unsigned char)*p)) ++p;
+            char emo[MAX_NAME_LEN];
+            if (sscanf(p, "%47s", emo) == 1) {
+                char *q = strchr(p, '"');
+                if (q) {
+                    const char *endptr; char *tip = parse_quoted(q, &endptr);
+                    int tried, helped, day;
+                    if (tip) {
+                        EmotionNode *n = graph_add_tip(g, emo, tip);
+                        if (sscanf(endptr, "%d %d %d", &tried, &helped, &day) == 3) {
+                            Tip *tp = &n->tips[n->tips_count - 1];
+                            tp->tried = tried < 0 ? 0 : tried;
+                            tp->helped = helped < 0 ? 0 : helped > tp->tried ? tp->tried : helped; tp->day = day;
+                            tip_rerank(n, n->tips_count - 1);
+                        }
+                        free_str(tip, MEM_OTHER);
+                    }
+                }
+            }
+        } else if (strcmp(token, "EDGE") == 0) {
+            p += 4; while (*p && isspace((unsigned char)*p)) ++p;
+            char from[MAX_NAME_LEN], to[MAX_NAME_LEN]; float w = 1.0f;
+            if (sscanf(p, "%47s %47s %f", from, to, &w) >= 2) {
+                char *q = strchr(p, '"'); char *proc = NULL;
+                if (q) { const char *endptr; proc = parse_quoted(q, &endptr); }
+                graph_add_edge(g, from, to, w, proc);
+                if (proc) free_str(proc, MEM_OTHER);
+            }
+        }
+    }
+    fclose(f);
+    g->loading = 0;
+    name_hash_sync(g);   /* one build for the names the file added */
+    if (active_goals[0]) {
+        int gs = goals_find(g, active_goals);
+        if (gs >= 0) g->goals.active = gs;
+    }
+    LAT_RECORD(OP_LOAD, t0);
+    apsp_attach(g, filename);
+    return 1;
+}
+
+/* ---------- Check-in log ----------
+   Every check-in (option 1, batch 'checkin') is appended to <datafile>.checkins, a
+   binary log in blocks of CHECKIN_BLOCK rows. Inside a block each column is stored
+   contiguously at a fixed width (timestamp, the four scores, inferred prototype, plan
+   length, source, goal, cost), so a question about one column reads only that column.
+   The file is mmap'd for reading. Blocks are allocated whole and the row count in the
+   header is written last, so an interrupted append leaves the earlier rows intact;
+   appends hold a write lock on the file, so two sessions cannot claim the same rows.
+   Daily averages use the time order of an append-only log: each block is cut at day
+   boundaries (local midnights from mktime, one per day, so a DST change inside the
+   history moves only the days after it) by binary search on its timestamps and the
+   score columns of each piece are
+   summed 16 bytes at a time (SSE2 SAD). A log whose clock went backwards (the header
+   remembers) falls back to one row at a time.
+*/
+
+#define CHECKIN_MAGIC 0x314E4B43u      /* "CKN1" */
+#define CHECKIN_BLOCK 4096
+#define CHECKIN_HEADER 64
+#define CHECKIN_NO_PLAN 255             /* steps column when no plan was found */
+
+typedef struct {
+    int64_t ts;                        /* seconds since 1970 */
+    unsigned char scores[4];           /* stress, overwhelm, anger, sadness: 0-10 */
+    unsigned char proto, steps;        /* inferred prototype; plan length or CHECKIN_NO_PLAN */
+    int32_t source, goal;              /* node indices; goal -1 without a plan */
+    float cost;
+} CheckinRow;
+
+typedef struct { uint32_t magic, block_rows; uint64_t rows; int64_t last_ts; uint32_t sorted; } CheckinHeader;
+
+enum { CK_TS, CK_STRESS, CK_OVERWHELM, CK_ANGER, CK_SADNESS, CK_PROTO, CK_STEPS, CK_SOURCE, CK_GOAL, CK_COST, CK_COLS };
+static const int checkin_width[CK_COLS] = { 8, 1, 1, 1, 1, 1, 1, 4, 4, 4 };
+#define CHECKIN_ROW_BYTES 26            /* sum of checkin_width */
+#define CHECKIN_BLOCK_BYTES ((size_t)CHECKIN_BLOCK * CHECKIN_ROW_BYTES)
+
+/* Byte offset of row r of column c within its block. */
+static size_t checkin_col_offset(int c, int r) {
+    size_t off = 0;
+    for (int k=0;k<c;++k) off += (size_t)checkin_width[k] * CHECKIN_BLOCK;
+    return off + (size_t)r * checkin_width[c];
+}
+
+static void checkin_log_path(const char *datafile, char *buf, size_t size) {
+    snprintf(buf, size, "%s.checkins", datafile);
+}
+
+/* Copies column c of n rows into out, packed at the column's width. */
+static void checkin_pack(const CheckinRow *rows, long n, int c, unsigned char *out) {
+    for (long i=0;i<n;++i) {
+        const CheckinRow *r = &rows[i];
+        switch (c) {
+        case CK_TS:     memcpy(out + 8*i, &r->ts, 8); break;
+        case CK_PROTO:  out[i] = r->proto; break;
+        case CK_STEPS:  out[i] = r->steps; break;
+        case CK_SOURCE: memcpy(out + 4*i, &r->source, 4); break;
+        case CK_GOAL:   memcpy(out + 4*i, &r->goal, 4); break;
+        case CK_COST:   memcpy(out + 4*i, &r->cost, 4); break;
+        default:        out[i] = r->scores[c - CK_STRESS]; break;
+        }
+    }
+}
+
+#ifndef _WIN32
+/* Appends n rows to the log at path, creating it if needed. Returns 1 on success. */
+int checkin_log_append(const char *path, const CheckinRow *rows, long n) {
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return 0;
+    struct flock lk;
+    memset(&lk, 0, sizeof(lk));
+    lk.l_type = F_WRLCK; lk.l_whence = SEEK_SET;   /* whole file; released by close */
+    if (fcntl(fd, F_SETLKW, &lk) != 0) { close(fd); return 0; }
+    CheckinHeader h;
+    ssize_t got = pread(fd, &h, sizeof(h), 0);
+    if (got == 0) { memset(&h, 0, sizeof(h)); h.magic = CHECKIN_MAGIC; h.block_rows = CHECKIN_BLOCK; h.sorted = 1; }
+    else if (got != (ssize_t)sizeof(h) || h.magic != CHECKIN_MAGIC || h.block_rows != CHECKIN_BLOCK) { close(fd); return 0; }
+    unsigned char *buf = realloc_or_die(NULL, 0, CHECKIN_BLOCK, 8, MEM_OTHER);
+    int ok = 1;
+    while (ok && n > 0) {
+        uint64_t b = h.rows / CHECKIN_BLOCK; int r = (int)(h.rows % CHECKIN_BLOCK);
+        off_t base = CHECKIN_HEADER + (off_t)b * (off_t)CHECKIN_BLOCK_BYTES;
+        if (r == 0 && ftruncate(fd, base + (off_t)CHECKIN_BLOCK_BYTES) != 0) { ok = 0; break; }
+        long m = n < CHECKIN_BLOCK - r ? n : CHECKIN_BLOCK - r;
+        for (int c=0; ok && c<CK_COLS; ++c) {
+            size_t bytes = (size_t)m * checkin_width[c];
+            checkin_pack(rows, m, c, buf);
+            ok = pwrite(fd, buf, bytes, base + (off_t)checkin_col_offset(c, r)) == (ssize_t)bytes;
+        }
+        for (long i=0;i<m;++i) {
+            if (h.rows + i > 0 && rows[i].ts < h.last_ts) h.sorted = 0;
+            h.last_ts = rows[i].ts;
+        }
+        if (ok) { h.rows += m; rows += m; n -= m; }
+    }
+    free_array(buf, CHECKIN_BLOCK, 8, MEM_OTHER);
+    if (ok) ok = pwrite(fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h);
+    if (close(fd) != 0) ok = 0;
+    return ok;
+}
+#else
+int checkin_log_append(const char *path, const CheckinRow *rows, long n) { (void)path; (void)rows; (void)n; return 0; }
+#endif
+
+typedef struct {
+    const unsigned char *base;
+    size_t size;
+    long rows;
+    int sorted;
+} CheckinLog;
+
+/* Maps the log read-only. Returns 0 when it is missing or not a check-in log. */
+int checkin_log_open(const char *path, CheckinLog *log) {
+    memset(log, 0, sizeof(*log));
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    struct stat st;
+    CheckinHeader h;
+    int ok = fstat(fd, &st) == 0 && pread(fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h)
+          && h.magic == CHECKIN_MAGIC && h.block_rows == CHECKIN_BLOCK
+          && (uint64_t)st.st_size >= CHECKIN_HEADER + (h.rows + CHECKIN_BLOCK - 1) / CHECKIN_BLOCK * CHECKIN_BLOCK_BYTES;
+    if (ok && h.rows > 0) {
+        void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) ok = 0;
+        else {
+            posix_madvise(p, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+            log->base = p; log->size = (size_t)st.st_size;
+        }
+    }
+    close(fd);
+    if (!ok) return 0;
+    log->rows = (long)h.rows; log->sorted = (int)h.sorted;
+    return 1;
+#else
+    (void)path;
+    return 0;
+#endif
+}
+
+void checkin_log_close(CheckinLog *log) {
+#ifndef _WIN32
+    if (log->base) munmap((void *)log->base, log->size);
+#endif
+    memset(log, 0, sizeof(*log));
+}
+
+static const unsigned char *checkin_column(const CheckinLog *log, long block, int c) {
+    return log->base + CHECKIN_HEADER + (size_t)block * CHECKIN_BLOCK_BYTES + checkin_col_offset(c, 0);
+}
+
+static uint64_t checkin_sum_u8(const unsigned char *p, long n) {
+    uint64_t s = 0; long i = 0;
+#if defined(__SSE2__)
+    __m128i acc = _mm_setzero_si128(), zero = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(p + i)), zero));
+    uint64_t lanes[2]; _mm_storeu_si128((__m128i *)lanes, acc);
+    s = lanes[0] + lanes[1];
+#endif
+    for (; i < n; ++i) s += p[i];
+    return s;
+}
+
+/* Days are numbered as calendar dates counted from 1970-01-01, whatever the zone. */
+static long checkin_civil_day(int y, int m, int d) {
+    y -= m <= 2;
+    long era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = (int)(y - era * 400);
+    int doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    return era * 146097 + (long)yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+}
+
+/* UTC day of a timestamp, rounding down. */
+static long checkin_utc_day(int64_t ts) {
+    return (long)(ts >= 0 ? ts / 86400 : -((-ts + 86399) / 86400));
+}
+
+/* Local calendar day of a timestamp. */
+static long checkin_local_day(int64_t ts) {
+    time_t t = (time_t)ts;
+    struct tm *lt = localtime(&t);
+    return lt ? checkin_civil_day(lt->tm_year + 1900, lt->tm_mon + 1, lt->tm_mday) : checkin_utc_day(ts);
+}
+
+/* bounds[d] = first second of day first+d, for d = 0..ndays (ndays + 1 entries). */
+static void checkin_utc_bounds(long first, long ndays, int64_t *bounds) {
+    for (long d=0; d<=ndays; ++d) bounds[d] = (int64_t)(first + d) * 86400;
+}
+
+static void checkin_local_bounds(long first, long ndays, int64_t *bounds) {
+    for (long d=0; d<=ndays; ++d) {
+        struct tm t;
+        memset(&t, 0, sizeof(t));
+        t.tm_year = 70; t.tm_mday = 1 + (int)(first + d); t.tm_isdst = -1;   /* mktime normalizes */
+        time_t at = mktime(&t);
+        bounds[d] = at == (time_t)-1 ? (int64_t)(first + d) * 86400 : (int64_t)at;
+    }
+}
+
+/* Day of ts within bounds: -1 before the first day, ndays after the last. */
+static long checkin_bounds_find(const int64_t *bounds, long ndays, int64_t ts) {
+    long lo = 0, hi = ndays + 1;                /* first bound above ts */
+    while (lo < hi) { long mid = (lo + hi) / 2; if (bounds[mid] <= ts) lo = mid + 1; else hi = mid; }
+    return lo - 1;
+}
+
+typedef struct { long day, count; uint64_t sum[4]; } CheckinDay;   /* sums of the four scores */
+
+/* Per-day counts and score sums for days first..first+ndays-1, whose starts are given
+   by bounds (see checkin_utc_bounds / checkin_local_bounds); days[] must hold ndays
+   entries and is cleared first. Returns the rows counted. */
+long checkin_log_daily(const CheckinLog *log, const int64_t *bounds, long first, long ndays, CheckinDay *days) {
+    TRACE_BEGIN(t0);
+    for (long d=0; d<ndays; ++d) { memset(&days[d], 0, sizeof(days[d])); days[d].day = first + d; }
+    long counted = 0, nblocks = (log->rows + CHECKIN_BLOCK - 1) / CHECKIN_BLOCK;
+    for (long b=0;b<nblocks;++b) {
+        int m = (int)(b + 1 < nblocks ? CHECKIN_BLOCK : log->rows - b * CHECKIN_BLOCK);
+        const int64_t *ts = (const int64_t *)checkin_column(log, b, CK_TS);
+        const unsigned char *col[4];
+        for (int k=0;k<4;++k) col[k] = checkin_column(log, b, CK_STRESS + k);
+        if (!log->sorted) {
+            for (int i=0;i<m;++i) {
+                long d = checkin_bounds_find(bounds, ndays, ts[i]);
+                if (d < 0 || d >= ndays) continue;
+                days[d].count++; ++counted;
+                for (int k=0;k<4;++k) days[d].sum[k] += col[k][i];
+            }
+            continue;
+        }
+        for (int i=0; i<m; ) {
+            long d = checkin_bounds_find(bounds, ndays, ts[i]);
+            if (d >= ndays) break;
+            int64_t next = bounds[d + 1];
+            int lo = i + 1, hi = m;                 /* first row of a later day */
+            while (lo < hi) { int mid = (lo + hi) / 2; if (ts[mid] < next) lo = mid + 1; else hi = mid; }
+            if (d >= 0) {
+                days[d].count += lo - i; counted += lo - i;
+                for (int k=0;k<4;++k) days[d].sum[k] += checkin_sum_u8(col[k] + i, lo - i);
+            }
+            i = lo;
+        }
+    }
+    TRACE_END("checkin_daily", t0);
+    return counted;
+}
+
+/* Timestamp of the last row (0 for an empty log). */
+static int64_t checkin_log_last_ts(const CheckinLog *log) {
+    if (log->rows == 0) return 0;
+    long b = (log->rows - 1) / CHECKIN_BLOCK;
+    return ((const int64_t *)checkin_column(log, b, CK_TS))[(log->rows - 1) % CHECKIN_BLOCK];
+}
+
+/* Records a check-in next to datafile; plan_len is the path length in states (0 = none). */
+static void checkin_record(const char *datafile, const int scores[4], int proto, int src,
+                           const int *path, int plan_len, float cost) {
+    CheckinRow row;
+    memset(&row, 0, sizeof(row));
+    row.ts = (int64_t)time(NULL);
+    for (int k=0;k<4;++k) row.scores[k] = (unsigned char)scores[k];
+    row.proto = (unsigned char)proto;
+    row.source = src;
+    row.steps = plan_len > 0 && plan_len - 1 < CHECKIN_NO_PLAN ? (unsigned char)(plan_len - 1) : CHECKIN_NO_PLAN;
+    row.goal = plan_len > 0 ? path[plan_len - 1] : -1;
+    row.cost = plan_len > 0 ? cost : -1.0f;
+    char log_path[1024]; checkin_log_path(datafile, log_path, sizeof(log_path));
+    checkin_log_append(log_path, &row, 1);
+}
+
+/* Prints daily averages for the last ndays local days with check-ins; returns rows seen. */
+static long checkin_print_recent(FILE *out, const char *datafile, int ndays, int batch) {
+    char log_path[1024]; checkin_log_path(datafile, log_path, sizeof(log_path));
+    CheckinLog log;
+    if (!checkin_log_open(log_path, &log) || log.rows == 0) {
+        if (batch) fprintf(out, "ok 0\n");
+        else fprintf(out, "No check-ins recorded yet - option 1 keeps a private history here.\n");
+        return 0;
+    }
+    long last = checkin_local_day(checkin_log_last_ts(&log)), today = checkin_local_day((int64_t)time(NULL));
+    if (today > last) last = today;
+    CheckinDay *days = realloc_or_die(NULL, 0, (size_t)ndays, sizeof(CheckinDay), MEM_OTHER);
+    int64_t *bounds = realloc_or_die(NULL, 0, (size_t)ndays + 1, sizeof(int64_t), MEM_OTHER);
+    checkin_local_bounds(last - ndays + 1, ndays, bounds);
+    long counted = checkin_log_daily(&log, bounds, last - ndays + 1, ndays, days);
+    free_array(bounds, (size_t)ndays + 1, sizeof(int64_t), MEM_OTHER);
+    int shown = 0;
+    for (int d=0; d<ndays; ++d) shown += days[d].count > 0;
+    if (batch) fprintf(out, "ok %d\n", shown);
+    else if (shown == 0) fprintf(out, "No check-ins in the last %d days.\n", ndays);
+    else fprintf(out, "Average scores per day (0-10), last %d days:\n", ndays);
+    for (int d=0; d<ndays; ++d) {
+        const CheckinDay *cd = &days[d];
+        if (!cd->count) continue;
+        time_t at = (time_t)cd->day * 86400;
+        char date[16]; strftime(date, sizeof(date), "%Y-%m-%d", gmtime(&at));
+        double c = (double)cd->count;
+        if (batch) fprintf(out, "day %s %ld %.2f %.2f %.2f %.2f\n", date, cd->count, cd->sum[0] / c, cd->sum[1] / c, cd->sum[2] / c, cd->sum[3] / c);
+        else fprintf(out, " %s  %ld check-in%s  stress %.1f  overwhelm %.1f  anger %.1f  sadness %.1f\n", date, cd->count,
+                     cd->count == 1 ? " " : "s", cd->sum[0] / c, cd->sum[1] / c, cd->sum[2] / c, cd->sum[3] / c);
+    }
+    free_array(days, (size_t)ndays, sizeof(CheckinDay), MEM_OTHER);
+    checkin_log_close(&log);
+    return counted;
+}
+
+/* ---------- Usage statistics ---------- */
+
+void stats_print(FILE *out) {
+    const EmoStats *st = &emo_stats;
+    fprintf(out, "Usage statistics (this session):\n");
+    fprintf(out, "  routing queries:     %llu\n", st->queries);
+    fprintf(out, "  nodes settled:       %llu\n", st->nodes_settled);
+    fprintf(out, "  edges relaxed:       %llu\n", st->edges_relaxed);
+    fprintf(out, "  heap operations:     %llu\n", st->heap_ops);
+    fprintf(out, "  name lookups:        %llu (%llu names compared)\n", st->find_calls, st->find_probes);
+    fprintf(out, "  allocations:         %llu\n", st->allocs);
+    fprintf(out, "  bytes saved/loaded:  %llu / %llu\n", st->bytes_saved, st->bytes_loaded);
+#ifndef EMO_NO_STATS
+    fprintf(out, "  memory (bytes):\n");
+    fprintf(out, "    %-16s %14s %14s\n", "category", "current", "peak");
+    for (int i=0;i<MEM_CAT_COUNT;++i)
+        fprintf(out, "    %-16s %14lld %14lld\n", mem_cat_names[i], mem_usage[i].current, mem_usage[i].peak);
+    fprintf(out, "    %-16s %14lld %14lld\n", "total", mem_total.current, mem_total.peak);
+#endif
+#ifdef EMO_NO_STATS
+    fprintf(out, "  (counters compiled out with EMO_NO_STATS)\n");
+#else
+    fprintf(out, "  latency (microseconds):\n");
+    fprintf(out, "    %-9s %8s %10s %10s %10s %10s %10s\n", "operation", "count", "p50", "p90", "p99", "p999", "max");
+    for (int i=0;i<OP_COUNT;++i) {
+        const LatencyHist *h = &op_hist[i];
+        fprintf(out, "    %-9s %8llu %10.1f %10.1f %10.1f %10.1f %10.1f\n", op_names[i], h->total,
+                hist_quantile(h, 0.50) / 1e3, hist_quantile(h, 0.90) / 1e3, hist_quantile(h, 0.99) / 1e3,
+                hist_quantile(h, 0.999) / 1e3, h->max_ns / 1e3);
+    }
+#endif
+}
+
+/* ---------- Friendly explanation for the user ---------- */
+
+void show_simple_explanation() {
+    printf("\nHow this helper chooses a plan (short version):\n");
+    printf("  - Emotions are like locations on a map.\n");
+    printf("  - Each connection has a difficulty - some routes are easier.\n");
+    printf("  - Your personal tips and actions make certain routes easier.\n");
+    printf("  - The system finds the smoothest step-by-step route from how you feel now\n");
+    printf("    to a nearby positive state (like calm or happy) and suggests actions.\n");
+    printf("  - Some jumps are blocked for safety and realism - e.g., if you're overwhelmed\n");
+    printf("    you first move to a grounding step before aiming for calm or happy.\n\n");
+}
+
+/* ---------- Interactive UI ---------- */
+
+static void read_line_trim_wrapper(char *buf, int size) { read_line_trim(buf, size); }
+static int read_int_in_range_wrapper(const char *prompt, int lo, int hi) { return read_int_in_range(prompt, lo, hi); }
+
+void seed_defaults_if_empty(EmotionGraph *g) {
+    if (g->count > 0) return;
+
+    /* Add nodes with internal valence/baseline (not shown to user) */
+    graph_add_node(g, "overwhelmed", -0.95f, 8.5f);
+    graph_add_node(g, "anxious", -0.7f, 7.0f);
+    graph_add_node(g, "frustrated", -0.6f, 6.0f);
+    graph_add_node(g, "angry", -0.7f, 6.5f);
+    graph_add_node(g, "sad", -0.8f, 6.0f);
+    graph_add_node(g, "lonely", -0.5f, 5.0f);
+    graph_add_node(g, "grounded", -0.1f, 3.0f);
+    graph_add_node(g, "calm", 0.6f, 3.0f);
+    graph_add_node(g, "hopeful", 0.7f, 2.5f);
+    graph_add_node(g, "happy", 1.0f, 1.5f);
+    graph_add_node(g, "peaceful", 0.9f, 1.5f);
+
+    /* Everyday words people use for the same states */
+    aliases_add(g, "stressed", "overwhelmed");
+    aliases_add(g, "stressed out", "overwhelmed");
+    aliases_add(g, "worried", "anxious");
+    aliases_add(g, "nervous", "anxious");
+    aliases_add(g, "annoyed", "frustrated");
+    aliases_add(g, "mad", "angry");
+    aliases_add(g, "down", "sad");
+    aliases_add(g, "alone", "lonely");
+    aliases_add(g, "relaxed", "calm");
+    aliases_add(g, "content", "peaceful");
+    aliases_add(g, "joyful", "happy");
+    keywords_add(g, "swamped", "overwhelmed", 1.0f);
+    keywords_add(g, "too much", "overwhelmed", 1.0f);
+    keywords_add(g, "burned out", "overwhelmed", 1.0f);
+    keywords_add(g, "panic", "anxious", 1.0f);
+    keywords_add(g, "on edge", "anxious", 1.0f);
+    keywords_add(g, "fed up", "frustrated", 1.0f);
+    keywords_add(g, "stuck", "frustrated", 0.5f);
+    keywords_add(g, "furious", "angry", 1.0f);
+    keywords_add(g, "crying", "sad", 1.0f);
+    keywords_add(g, "heartbroken", "sad", 1.0f);
+    keywords_add(g, "left out", "lonely", 1.0f);
+    keywords_add(g, "isolated", "lonely", 1.0f);
+    keywords_add(g, "at peace", "peaceful", 1.0f);
+
+    /* Add default tips for each node (at least one; many have more) */
+    graph_add_tip(g, "overwhelmed", "Put your phone away and take 3 big slow breaths.");
+    graph_add_tip(g, "overwhelmed", "Try: press your feet firmly into the ground for 30 seconds.");
+    graph_add_tip(g, "anxious", "5 slow breaths (inhale 4s, hold 2s, exhale 6s).");
+    graph_add_tip(g, "anxious", "Name 5 things you can see right now.");
+    graph_add_tip(g, "frustrated", "Step away for 2 minutes and stretch.");
+    graph_add_tip(g, "frustrated", "Count backwards from 20 slowly.");
+    graph_add_tip(g, "angry", "Take a 60-second walk or do physical movement.");
+    graph_add_tip(g, "sad", "Write 3 small things that went okay today.");
+    graph_add_tip(g, "sad", "Call or message someone you trust - say 'I need a small favor'.");
+    graph_add_tip(g, "lonely", "Try a brief message to a friend or online community.");
+    graph_add_tip(g, "grounded", "Place an object in your hand and describe it slowly.");
+    graph_add_tip(g, "calm", "Listen to a favorite 3-minute song.");
+    graph_add_tip(g, "hopeful", "List one small goal for the next 24 hours.");
+    graph_add_tip(g, "happy", "Celebrate: do one small reward for yourself.");
+    graph_add_tip(g, "peaceful", "Try a 2-minute body scan relaxation.");
+
+    /* Add edges (note: graph_add_edge will block direct overwhelmed -> positive) */
+    graph_add_edge(g, "overwhelmed", "grounded", 1.0f, "5 grounding breaths & plant feet");
+    graph_add_edge(g, "grounded", "calm", 1.5f, "2-minute breathing");
+    graph_add_edge(g, "calm", "happy", 1.5f, "play a mood-lifting song");
+    graph_add_edge(g, "calm", "peaceful", 1.0f, "gentle stretching");
+    graph_add_edge(g, "anxious", "grounded", 1.2f, "5 slow breaths");
+    graph_add_edge(g, "anxious", "frustrated", 1.8f, NULL);
+    graph_add_edge(g, "frustrated", "calm", 1.5f, "count to 10 and stretch");
+    graph_add_edge(g, "frustrated", "angry", 2.0f, "step away and breathe");
+    graph_add_edge(g, "angry", "grounded", 2.0f, "walk for 2 minutes");
+    graph_add_edge(g, "sad", "hopeful", 2.0f, "write 3 small wins");
+    graph_add_edge(g, "lonely", "hopeful", 2.5f, "reach out to one person");
+    /* Note: we do NOT add direct overwhelmed->happy/calm/hopeful edges. */
+
+    /* Also add some cross-connections to allow multiple paths */
+    graph_add_edge(g, "anxious", "sad", 1.7f, NULL);
+    graph_add_edge(g, "sad", "calm", 2.5f, "sit with feelings and breathe");
+    graph_add_edge(g, "hopeful", "happy", 1.0f, NULL);
+}
+
+/* ---------- Menu and flow ---------- */
+
+void print_welcome() {
+    printf("Welcome to the Emotion Path Helper - a calm, friendly assistant.\n");
+    printf("This tool helps suggest a simple, step-by-step plan from how you feel now\n");
+    printf("toward a more positive state. Your tips and actions are saved between runs.\n");
+    printf("Data file: %s\n\n", SAVE_FILE);
+    show_simple_explanation();
+}
+
+/* Lists the Pareto plans side by side, naming what each one is best at. */
+static void print_pareto_plans(EmotionGraph *g, const ParetoPlan *plans, int np) {
+    int fewest = 0, guided = 0;
+    for (int i=1;i<np;++i) {
+        if (plans[i].steps < plans[fewest].steps) fewest = i;
+        if (plans[i].unguided < plans[guided].unguided) guided = i;
+    }
+    int *path = realloc_or_die(NULL, 0, (size_t)g->count, sizeof(int), MEM_ROUTING);
+    for (int i=0;i<np;++i) {
+        int len = pareto_plan_path(&plans[i], path);
+        printf(" %c) ", 'A' + i);
+        for (int k=0;k<len;++k) printf("%s%s", k ? " -> " : "", g->nodes[path[k]].name);
+        printf("\n    %d step%s, ", plans[i].steps, plans[i].steps == 1 ? "" : "s");
+        if (plans[i].unguided == 0) printf("every step has an action");
+        else printf("%d step%s without an action yet", plans[i].unguided, plans[i].unguided == 1 ? "" : "s");
+        if (i == 0) printf(" - the easiest overall");
+        else if (i == fewest) printf(" - the shortest");
+        else if (i == guided) printf(" - the most guided");
+        printf("\n");
+    }
+    free_array(path, (size_t)g->count, sizeof(int), MEM_ROUTING);
+}
+
+/* Before an unknown name becomes a new emotion, offer the closest existing one.
+   Rewrites name in place when the user accepts. */
+static void confirm_emotion_name(EmotionGraph *g, char *name, size_t size) {
+    int idx = graph_resolve(g, name);
+    if (idx >= 0) { strncpy(name, g->nodes[idx].name, size-1); name[size-1] = '\0'; return; }
+    int s = graph_suggest_name(g, name);
+    if (s < 0) return;
+    printf("'%s' is new here - did you mean '%s'? (y/n): ", name, g->nodes[s].name);
+    char yn[8]; read_line_trim(yn, sizeof(yn));
+    if (yn[0]=='y' || yn[0]=='Y') { strncpy(name, g->nodes[s].name, size-1); name[size-1] = '\0'; }
+}
+
+/* Longest plan (in transitions) the menu offers; 0 = no limit. */
+static int plan_max_steps = 0;
+
+void interactive_menu(EmotionGraph *g) {
+    seed_defaults_if_empty(g);
+    int running = 1;
+    char buf[512];
+
+    Prototype *protos = default_protos;
+    int proto_count = DEFAULT_PROTO_COUNT;
+
+    while (running) {
+        printf("\n--- Menu ---\n");
+        printf("  1) Multi-question check-in (recommended)\n");
+        printf("  2) Quick: enter your emotion by name\n");
+        printf("  3) List emotions & tips\n");
+        printf("  4) Add a personal tip to an emotion\n");
+        printf("  5) Add/Edit action for a transition\n");
+        printf("  6) Save now\n");
+        printf("  7) Reload saved data (discard unsaved changes)\n");
+        printf("  8) Show ASCII graph view\n");
+        printf("  9) Show usage statistics\n");
+        if (plan_max_steps > 0) printf(" 10) Limit plan length (now: at most %d step%s)\n", plan_max_steps, plan_max_steps == 1 ? "" : "s");
+        else printf(" 10) Limit plan length (now: no limit)\n");
+        printf(" 11) Compare alternative plans (easier / shorter / more guided)\n");
+        printf(" 12) Choose which positive states to aim for (now: %s)\n", g->goals.count ? g->goals.sets[g->goals.active].name : "none");
+        printf(" 13) Describe how you feel in your own words\n");
+        printf(" 14) Search tips and actions\n");
+        printf(" 15) Tidy up near-duplicate tips\n");
+        printf(" 16) Look back at your check-ins\n");
+        printf("  0) Exit (auto-saves)\n");
+        int choice = read_int_in_range("Choose option", 0, 16);
+
+        if (choice == 0) { running = 0; }
+        else if (choice == 1 || choice == 2 || choice == 13) {
+            int src_idx = -1, scores[4] = {0}, pidx = -1;
+            if (choice == 13) {
+                printf("How are you feeling? (a sentence is fine): ");
+                char text[MAX_LINE]; read_line_trim(text, sizeof(text));
+                DetectHit hits[3];
+                LAT_BEGIN(t_cls);
+                int nh = detect_emotions(g, text, hits, 3);
+                LAT_RECORD(OP_CLASSIFY, t_cls);
+                if (nh == 0) { printf("I couldn't pick out a feeling from that - option 2 lets you name it directly.\n"); continue; }
+                printf("It sounds like you may be feeling: %s", g->nodes[hits[0].node].name);
+                for (int k=1;k<nh;++k) printf("%s%s", k == 1 ? " (and maybe " : " or ", g->nodes[hits[k].node].name);
+                printf("%s\n", nh > 1 ? ")" : "");
+                src_idx = hits[0].node;
+            } else if (choice == 1) {
+                printf("\nCheck-in: please rate the following 0 (none) to 10 (very high).\n");
+                int stress = scores[0] = read_int_in_range("Stress", 0, 10);
+                int overwhelm = scores[1] = read_int_in_range("Overwhelm", 0, 10);
+                int anger = scores[2] = read_int_in_range("Anger", 0, 10);
+                int sadness = scores[3] = read_int_in_range("Sadness", 0, 10);
+                LAT_BEGIN(t_cls);
+                pidx = choose_closest_prototype((float)stress, (float)overwhelm, (float)anger, (float)sadness, protos, proto_count);
+                LAT_RECORD(OP_CLASSIFY, t_cls);
+                TRACE_END("prototype_match", t_cls);
+                const char *inferred = protos[pidx].name;
+                printf("We think you may be feeling: %s\n", inferred);
+                if (graph_find(g, inferred) == -1) graph_add_node(g, inferred, -0.2f, (stress+overwhelm)/2.0f);
+                src_idx = graph_find(g, inferred);
+            } else {
+                printf("Enter your current emotion (e.g., anxious): ");
+                char emo[MAX_NAME_LEN]; read_line_trim(emo, sizeof(emo));
+                if (strlen(emo) == 0) { printf("No emotion entered.\n"); continue; }
+                confirm_emotion_name(g, emo, sizeof(emo));
+                if (graph_find(g, emo) == -1) graph_add_node(g, emo, -0.2f, 5.0f);
+                src_idx = graph_find(g, emo);
+            }
+
+            const int *goal_idx;
+            int gcount = goals_active(g, &goal_idx);
+
+            int best_len=0; size_t path_cap = (size_t)g->count;
+            int *best_path = realloc_or_die(NULL, 0, path_cap, sizeof(int), MEM_ROUTING);
+            LAT_BEGIN(t_route);
+            float best_cost = plan_hop_limited(g, src_idx, goal_idx, gcount, plan_max_steps, best_path, &best_len, NULL);
+            LAT_RECORD(OP_ROUTE, t_route);
+
+            if (best_cost == FLT_MAX && plan_max_steps > 0
+                && plan_best_goal(g, src_idx, goal_idx, gcount, best_path, &best_len, NULL) != FLT_MAX) {
+                printf("\nEvery plan from here needs more than %d step%s (the easiest has %d). You can raise the limit with option 10.\n",
+                       plan_max_steps, plan_max_steps == 1 ? "" : "s", best_len - 1);
+            } else if (best_cost == FLT_MAX) {
+                printf("\nSorry - no available path to a positive state. Try adding tips or transitions in the menu.\n");
+            } else {
+                LAT_BEGIN(t_render);
+                int *shown = realloc_or_die(NULL, 0, (size_t)best_len * TIP_TOP_K, sizeof(int), MEM_ROUTING);
+                int nshown = 0;   /* node * TIP_TOP_K + place in its top list */
+                printf("\nHere is a simple step-by-step plan:\n");
+                for (int i=0;i<best_len;i++) {
+                    int idx = best_path[i];
+                    const EmotionNode *sn = &g->nodes[idx];
+                    printf(" Step %d: %s\n", i+1, sn->name);
+                    if (sn->tips_count > 0) {
+                        printf("   Tips:\n");
+                        for (int k=0;k<sn->tip_top_count;++k) {
+                            printf("     %d. %s\n", nshown + 1, sn->tips[sn->tip_top[k]].text);
+                            shown[nshown++] = idx * TIP_TOP_K + k;
+                        }
+                        if (sn->tips_count > sn->tip_top_count)
+                            printf("     (%d more - menu option 3 lists them all)\n", sn->tips_count - sn->tip_top_count);
+                    }
+                    if (i < best_len-1) {
+                        /* find procedure */
+                        TRACE_BEGIN(t_proc);
+                        EmotionNode *cur = &g->nodes[idx];
+                        char *proc = NULL;
+                        for (int e=0;e<cur->edges_count;++e) if (cur->edges[e].to == best_path[i+1]) { proc = cur->edges[e].procedure; break; }
+                        TRACE_END("procedure_lookup", t_proc);
+                        if (proc) printf("   Action: %s\n", proc);
+                        else printf("   Action: (none - you can add one in menu option 5)\n");
+                    } else if (is_goal(g, idx)) {
+                        printf("   Goal reached: %s - well done for taking steps.\n", g->nodes[idx].name);
+                    }
+                }
+                LAT_RECORD(OP_RENDER, t_render);
+                TRACE_END("print_plan", t_render);
+                if (nshown > 0) {
+                    int pick = read_int_in_range("\nDid you try one of these tips? Its number, or 0 to skip", 0, nshown);
+                    if (pick > 0) {
+                        EmotionNode *tn = &g->nodes[shown[pick-1] / TIP_TOP_K];
+                        int slot = tn->tip_top[shown[pick-1] % TIP_TOP_K];
+                        printf("Did it help? (y/n): ");
+                        char yn[8]; read_line_trim(yn, sizeof(yn));
+                        tip_record(tn, slot, yn[0]=='y' || yn[0]=='Y');
+                        printf("Thanks - tips that help are shown first next time.\n");
+                    }
+                }
+                free_array(shown, (size_t)best_len * TIP_TOP_K, sizeof(int), MEM_ROUTING);
+                if (best_len > 1) {
+                    printf("Did you try the steps of this plan? (y/n): ");
+                    char yn[8]; read_line_trim(yn, sizeof(yn));
+                    if (yn[0]=='y' || yn[0]=='Y') {
+                        for (int i=0;i+1<best_len;++i) {
+                            printf("  %s -> %s: did this step help? (y/n, Enter to skip): ", g->nodes[best_path[i]].name, g->nodes[best_path[i+1]].name);
+                            read_line_trim(yn, sizeof(yn));
+                            if (yn[0]=='y' || yn[0]=='Y') graph_learn_step(g, best_path[i], best_path[i+1], 1);
+                            else if (yn[0]=='n' || yn[0]=='N') graph_learn_step(g, best_path[i], best_path[i+1], 0);
+                        }
+                        printf("Thanks - future plans will lean on the steps that work for you.\n");
+                    }
+                }
+            }
+            if (choice == 1) checkin_record(SAVE_FILE, scores, pidx, src_idx, best_path, best_cost == FLT_MAX ? 0 : best_len, best_cost);
+            free_array(best_path, path_cap, sizeof(int), MEM_ROUTING);
+        } else if (choice == 3) {
+            printf("\n");
+            graph_print_friendly(g);
+        } else if (choice == 4) {
+            printf("\nAdd a personal tip.\nEmotion name: ");
+            char emo[MAX_NAME_LEN]; read_line_trim(emo, sizeof(emo));
+            if (strlen(emo)==0) { printf("No emotion entered.\n"); continue; }
+            confirm_emotion_name(g, emo, sizeof(emo));
+            printf("Enter your tip (short): ");
+            char tip_buf[512]; read_line_trim(tip_buf, sizeof(tip_buf));
+            if (strlen(tip_buf)==0) { printf("No tip entered.\n"); continue; }
+            int v = graph_find(g, emo), near = v >= 0 ? tip_find_near(&g->nodes[v], tip_buf) : -1;
+            if (near >= 0) {
+                printf("That is very close to a tip already saved for %s:\n  \"%s\"\nAdd it anyway? (y/n): ", emo, g->nodes[v].tips[near].text);
+                char yn[8]; read_line_trim(yn, sizeof(yn));
+                if (yn[0]!='y' && yn[0]!='Y') { printf("Kept the existing tip.\n"); continue; }
+            }
+            graph_add_tip(g, emo, tip_buf);
+            printf("Tip added to %s.\n", emo);
+        } else if (choice == 5) {
+            printf("\nAdd/Edit an action for a transition.\nFrom: "); char from[MAX_NAME_LEN]; read_line_trim(from, sizeof(from));
+            printf("To: "); char to[MAX_NAME_LEN]; read_line_trim(to, sizeof(to));
+            if (strlen(from)==0 || strlen(to)==0) { printf("Invalid names.\n"); continue; }
+            confirm_emotion_name(g, from, sizeof(from));
+            confirm_emotion_name(g, to, sizeof(to));
+            /* blocked by a rule: explain and, where the rules allow it, offer to link via grounded */
+            if (rules_forbid_names(g, from, to)) {
+                printf("Direct transitions from '%s' to '%s' are blocked for safety.\n", from, to);
+                if (rules_forbid_names(g, from, "grounded") || rules_forbid_names(g, "grounded", to)) { printf("No direct change made.\n"); continue; }
+                printf("Would you like to create/inspect the path: %s -> grounded -> %s ? (y/n): ", from, to);
+                char yn[8]; read_line_trim(yn, sizeof(yn));
+                if (yn[0]=='y' || yn[0]=='Y') {
+                    /* ensure edges exist */
+                    graph_add_edge(g, from, "grounded", 1.0f, "5 grounding breaths & plant feet");
+                    graph_add_edge(g, "grounded", to, 1.5f, NULL);
+                    printf("Linked %s -> grounded -> %s. You can add actions on these transitions now.\n", from, to);
+                } else { printf("No direct change made.\n"); }
+                continue;
+            }
+            int u = graph_find(g, from); if (u==-1) u = graph_add_node(g, from, -0.2f, 5.0f);
+            int v = graph_find(g, to); if (v==-1) v = graph_add_node(g, to, -0.2f, 5.0f);
+            /* find existing edge u->v */
+            EmotionNode *nu = &g->nodes[u];
+            int found = -1;
+            for (int e=0;e<nu->edges_count;++e) if (nu->edges[e].to == v) { found = e; break; }
+            if (found == -1) {
+                int w = read_int_in_range("Enter transition difficulty (0 = easy, bigger = harder)", 0, 20);
+                printf("Enter action/procedure for this transition (blank for none):\n");
+                char proc_buf[512]; read_line_trim(proc_buf, sizeof(proc_buf));
+                graph_add_edge(g, from, to, (float)w, (strlen(proc_buf)>0)?proc_buf:NULL);
+                printf("Edge created.\n");
+            } else {
+                printf("Existing transition found. Enter new action (blank to remove):\n");
+                char proc_buf[512]; read_line_trim(proc_buf, sizeof(proc_buf));
+                graph_set_procedure(g, u, found, (strlen(proc_buf) > 0) ? proc_buf : NULL);
+                printf("Action updated.\n");
+            }
+        } else if (choice == 6) {
+            if (save_graph(g, SAVE_FILE)) printf("Saved to %s.\n", SAVE_FILE);
+            else printf("Save failed.\n");
+        } else if (choice == 7) {
+            printf("Reload from %s (discard unsaved changes)? (y/n): ", SAVE_FILE);
+            char a[8]; read_line_trim(a, sizeof(a));
+            if (a[0]=='y' || a[0]=='Y') {
+                /* free current graph, reinit */
+                graph_clear(g);
+                if (load_graph(g, SAVE_FILE)) printf("Reloaded from %s.\n", SAVE_FILE);
+                else { printf("No save found; reset to defaults.\n"); seed_defaults_if_empty(g); }
+            } else printf("Cancelled.\n");
+        } else if (choice == 8) {
+            graph_print_ascii(g);
+        } else if (choice == 9) {
+            printf("\n");
+            stats_print(stdout);
+        } else if (choice == 10) {
+            printf("\nShorter plans can feel more doable. 0 means no limit.\n");
+            plan_max_steps = read_int_in_range("Maximum steps per plan", 0, 20);
+        } else if (choice == 12) {
+            printf("\nGoal sets:\n");
+            for (int s=0;s<g->goals.count;++s) {
+                const GoalSet *gs = &g->goals.sets[s];
+                printf(" %d) %s%s:", s+1, gs->name, s == g->goals.active ? " (current)" : "");
+                for (int i=0;i<gs->members_count;++i) printf(" %s", gs->members[i]);
+                printf("\n");
+            }
+            if (g->goals.count > 0) {
+                g->goals.active = read_int_in_range("Use goal set", 1, g->goals.count) - 1;
+                printf("Plans now aim for '%s' (saved with your data).\n", g->goals.sets[g->goals.active].name);
+            }
+        } else if (choice == 16) {
+            printf("\n");
+            checkin_print_recent(stdout, SAVE_FILE, 14, 0);
+        } else if (choice == 15) {
+            long removed = tips_dedup(g);
+            if (removed) printf("Merged %ld near-duplicate tip%s. Save (option 6) to keep the tidy list.\n", removed, removed == 1 ? "" : "s");
+            else printf("No near-duplicate tips found.\n");
+        } else if (choice == 14) {
+            printf("\nSearch tips and actions for (one or more words): ");
+            char query[256]; read_line_trim(query, sizeof(query));
+            enum { SHOWN = 20 };
+            TextDoc found[SHOWN];
+            int total = text_search(g, query, found, SHOWN);
+            if (total == 0) { printf("Nothing mentions that yet.\n"); continue; }
+            printf("Found %d:\n", total);
+            for (int i=0;i<total && i<SHOWN;++i) {
+                const EmotionNode *n = &g->nodes[found[i].node];
+                if (found[i].kind == TEXT_TIP) printf(" - [%s] %s\n", n->name, n->tips[found[i].slot].text);
+                else {
+                    const Edge *e = &n->edges[found[i].slot];
+                    printf(" - [%s -> %s] %s\n", n->name, g->nodes[e->to].name, e->procedure);
+                }
+            }
+            if (total > SHOWN) printf(" ...and %d more - add a word to narrow it down.\n", total - SHOWN);
+        } else if (choice == 11) {
+            printf("\nCompare plans.\nYour current emotion: ");
+            char emo[MAX_NAME_LEN]; read_line_trim(emo, sizeof(emo));
+            confirm_emotion_name(g, emo, sizeof(emo));
+            int src = graph_find(g, emo);
+            if (src == -1) { printf("Unknown emotion '%s' - try option 3 to see the list.\n", emo); continue; }
+            const int *goal_idx;
+            int gcount = goals_active(g, &goal_idx);
+            ParetoPlan plans[PARETO_MAX_PLANS];
+            LAT_BEGIN(t_route);
+            int np = plan_pareto(g, src, goal_idx, gcount, plan_max_steps, plans, PARETO_MAX_PLANS);
+            LAT_RECORD(OP_ROUTE, t_route);
+            if (np == 0) printf("\nSorry - no available path to a positive state.\n");
+            else {
+                printf("\n%s:\n", np == 1 ? "One plan is best on every count" : "These plans each have something going for them");
+                print_pareto_plans(g, plans, np);
+            }
+        } else {
+            printf("Unknown option.\n");
         }
     }
+}
+
+/* ---------- Cleanup ---------- */
+
+/* Releases every node and leaves an empty, reusable graph (menu option 7 reload path). */
+void graph_clear(EmotionGraph *g) {
     for (int i=0;i<g->count;++i) {
         EmotionNode *n = &g->nodes[i];
-        for (int e=0;e<n->edges_count;++e) {
-            int to = n->edges[e].to;
-            if (i < to) { // avoid duplicate edges
-                fprintf(f, "EDGE %s %s %.3f ", n->name, g->nodes[to].name, n->edges[e].weight);
-                if (n->edges[e].procedure) fwrite_quoted(f, n->edges[e].procedure);
-                else fprintf(f, "\"\"");
-                fputc('\n', f);
-            }
-        }
+        for (int e=0;e<n->edges_count;++e) if (n->edges[e].procedure) free_str(n->edges[e].procedure, MEM_PROCEDURES);
+        for (int t=0;t<n->tips_count;++t) if (n->tips[t].text) free_str(n->tips[t].text, MEM_TIPS);
+        free_array(n->edges, n->edges_cap, sizeof(Edge), MEM_EDGES);
+        free_array(n->tips, n->tips_cap, sizeof(Tip), MEM_TIPS);
     }
-    fclose(f); return 1;
+    free_array(g->nodes, g->cap, sizeof(EmotionNode), MEM_NODES);
+    account_node_array(-(long long)g->cap);
+    g->nodes = NULL; g->count = 0; g->cap = 0; g->arcs = 0;
+    aliases_clear(g);   /* also drops the name hash, before the lookups below */
+    keywords_clear(g);
+    lexicon_free(g);
+    text_index_free(g);
+    name_index_free(g);
+    rules_reset_defaults(g);
+    goals_reset_defaults(g);
+    graph_touch(g);
 }
 
-static char *parse_quoted(const char *s, const char **endptr) {
-    if (!s || *s != '"') { if (endptr) *endptr = s; return NULL; }
-    const char *p = s+1; char buf[MAX_LINE]; int bi=0;
-    while (*p && *p != '"') {
-        if (*p == '\\' && *(p+1)) { p++; buf[bi++] = *p++; }
-        else buf[bi++] = *p++;
-        if (bi >= MAX_LINE-1) break;
+void graph_free(EmotionGraph *g) {
+    if (!g) return;
+    graph_clear(g);
+    rules_clear(g);
+    goals_clear(g);
+    name_hash_free(g);
+    mem_account(MEM_OTHER, -(long long)sizeof(EmotionGraph));
+    free(g);
+}
+
+/* ---------- Batch mode ----------
+   emo_tool batch [--data FILE] [--goals SET] [--stats-on-exit FILE|-]
+   Reads one command per line from stdin and answers on stdout, for scripts and services:
+     plan <emotion> [max_steps]                     best plan to a positive state
+     checkin <stress> <overwhelm> <anger> <sadness> [max_steps]
+                                                    infer the emotion (0-10 each), then plan;
+                                                    logged to <datafile>.checkins
+     history [days]                                 check-ins and average scores per day (default 14)
+     outcome <from> <to> yes|no                     whether that plan step helped; answers the
+                                                    transition's new difficulty
+     goals [<set>]                                  show or switch the active goal set
+     pareto <emotion> [max_steps]                   every plan not beaten on cost, steps and
+                                                    steps without an action, one line each
+     detect <text>                                  emotions the text mentions, strongest first
+     search <words>                                 tips and actions containing every word
+     dedup                                          merge near-duplicate tips (then 'save')
+     tips <emotion>                                 the tips a plan shows for it, best first
+     feedback <emotion> <tip> yes|no                record whether tip <tip> (numbered as in the
+                                                    data file) helped; answers its place in 'tips'
+     stats                                          counters; 'stats reset' clears them
+     save                                           write the data file
+     quit
+   The data file is loaded (or defaults seeded) at start and only written by 'save'.
+   --stats-on-exit writes the counters and latency percentiles when input ends ('-' = stderr).
+*/
+
+static void batch_unknown(EmotionGraph *g, const char *name) {
+    int s = graph_suggest_name(g, name);
+    if (s >= 0) printf("error unknown emotion '%s' (did you mean '%s'?)\n", name, g->nodes[s].name);
+    else printf("error unknown emotion '%s'\n", name);
+}
+
+/* Prints the plan; its path is left in path[0..*len) (len 0 when there is none). */
+static float batch_plan(EmotionGraph *g, int src, int max_steps, int *path, int *len) {
+    const int *goal_idx;
+    int gcount = goals_active(g, &goal_idx);
+    *len = 0;
+    LAT_BEGIN(t_route);
+    float cost = plan_hop_limited(g, src, goal_idx, gcount, max_steps, path, len, NULL);
+    LAT_RECORD(OP_ROUTE, t_route);
+    if (cost == FLT_MAX) { printf("none %s\n", g->nodes[src].name); *len = 0; }
+    else {
+        LAT_BEGIN(t_render);
+        printf("ok");
+        for (int i=0;i<*len;++i) printf("%s%s", i ? " > " : " ", g->nodes[path[i]].name);
+        printf(" (%.3f)\n", cost);
+        LAT_RECORD(OP_RENDER, t_render);
+        TRACE_END("print_plan", t_render);
     }
-    buf[bi]='\0'; if (*p == '"') p++;
-    if (endptr) *endptr = p;
-    return strdup_s(buf);
+    return cost;
 }
 
-int load_graph(EmotionGraph *g, const char *filename) {
-    FILE *f = fopen(filename, "r");
-    if (!f) return 0;
+int batch_main(int argc, char **argv) {
+    const char *data = SAVE_FILE, *stats_out = NULL, *goal_set = NULL;
+    for (int i=0;i<argc;++i) {
+        if (strcmp(argv[i], "--data") == 0 && i+1 < argc) data = argv[++i];
+        else if (strcmp(argv[i], "--goals") == 0 && i+1 < argc) goal_set = argv[++i];
+        else if (strcmp(argv[i], "--stats-on-exit") == 0 && i+1 < argc) stats_out = argv[++i];
+        else { fprintf(stderr, "usage: emo_tool batch [--data FILE] [--goals SET] [--stats-on-exit FILE|-]\n"); return 2; }
+    }
+    EmotionGraph *g = graph_new();
+    if (!load_graph(g, data)) seed_defaults_if_empty(g);
+    if (goal_set) {
+        int gs = goals_find(g, goal_set);
+        if (gs < 0) { fprintf(stderr, "unknown goal set '%s'\n", goal_set); graph_free(g); return 2; }
+        g->goals.active = gs;
+    }
+
     char line[MAX_LINE];
-    while (fgets(line, sizeof(line), f)) {
-        size_t ln = strlen(line); if (ln>0 && line[ln-1]=='\n') line[ln-1]='\0';
+    while (fgets(line, sizeof(line), stdin)) {
+        size_t ln = strlen(line);
+        while (ln > 0 && isspace((unsigned char)line[ln-1])) line[--ln] = '\0';
         char *p = line; while (*p && isspace((unsigned char)*p)) ++p;
         if (!*p || *p == '#') continue;
-        char token[32];
-        if (sscanf(p, "%31s", token) != 1) continue;
-        if (strcmp(token, "NODE") == 0) {
-            p += 4; while (*p && isspace((unsigned char)*p)) ++p;
-            char name[MAX_NAME_LEN]; float val=0.0f, base=5.0f;
-            if (sscanf(p, "%47s %f %f", name, &val, &base) >= 1) {
-                graph_add_node(g, name, val, base);
-                int idx = graph_find(g, name);
-                if (idx != -1) {
-                    /* attempt more precise parse */
-                    char tmp[MAX_LINE]; strncpy(tmp, p, sizeof(tmp)); tmp[sizeof(tmp)-1]=0;
-                    char *tok = strtok(tmp, " \t");
-                    if (tok) { tok = strtok(NULL, " \t"); if (tok) g->nodes[idx].valence = atof(tok); tok = strtok(NULL, " \t"); if (tok) g->nodes[idx].baseline_intensity = atof(tok); }
-                }
+        char cmd[32]; int used = 0;
+        if (sscanf(p, "%31s%n", cmd, &used) != 1) continue;
+        char *arg = p + used; while (*arg && isspace((unsigned char)*arg)) ++arg;
+
+        if (strcmp(cmd, "quit") == 0) break;
+        else if (strcmp(cmd, "plan") == 0) {
+            char emo[MAX_NAME_LEN]; int max_steps = 0;
+            if (sscanf(arg, "%47s %d", emo, &max_steps) < 1) { printf("error plan needs an emotion\n"); continue; }
+            int src = graph_resolve(g, emo);
+            if (src == -1) { batch_unknown(g, emo); continue; }
+            int *path = realloc_or_die(NULL, 0, (size_t)g->count, sizeof(int), MEM_ROUTING), len;
+            batch_plan(g, src, max_steps, path, &len);
+            free_array(path, (size_t)g->count, sizeof(int), MEM_ROUTING);
+        } else if (strcmp(cmd, "goals") == 0) {
+            if (*arg) {
+                int gs = goals_find(g, arg);
+                if (gs < 0) { printf("error unknown goal set '%s'\n", arg); continue; }
+                g->goals.active = gs;
             }
-        } else if (strcmp(token, "TIP") == 0) {
-            p += 3; while (*p && isspace((unsigned char)*p)) ++p;
-            char emo[MAX_NAME_LEN];
-            if (sscanf(p, "%47s", emo) == 1) {
-                char *q = strchr(p, '"');
-                if (q) {
-                    const char *endptr; char *tip = parse_quoted(q, &endptr);
-                    if (tip) { graph_add_tip(g, emo, tip); free(tip); }
+            const GoalSet *gs = &g->goals.sets[g->goals.active];
+            printf("ok %s", gs->name);
+            for (int i=0;i<gs->members_count;++i) printf(" %s", gs->members[i]);
+            printf("\n");
+        } else if (strcmp(cmd, "pareto") == 0) {
+            char emo[MAX_NAME_LEN]; int max_steps = 0;
+            if (sscanf(arg, "%47s %d", emo, &max_steps) < 1) { printf("error pareto needs an emotion\n"); continue; }
+            int src = graph_resolve(g, emo);
+            if (src == -1) { batch_unknown(g, emo); continue; }
+            const int *goal_idx;
+            int gcount = goals_active(g, &goal_idx);
+            ParetoPlan plans[PARETO_MAX_PLANS];
+            LAT_BEGIN(t0);
+            int np = plan_pareto(g, src, goal_idx, gcount, max_steps, plans, PARETO_MAX_PLANS);
+            LAT_RECORD(OP_ROUTE, t0);
+            int *path = realloc_or_die(NULL, 0, (size_t)g->count, sizeof(int), MEM_ROUTING);
+            printf("ok %d\n", np);
+            for (int i=0;i<np;++i) {
+                int len = pareto_plan_path(&plans[i], path);
+                printf("plan %.3f %d %d", plans[i].cost, plans[i].steps, plans[i].unguided);
+                for (int k=0;k<len;++k) printf("%s%s", k ? " > " : " ", g->nodes[path[k]].name);
+                printf("\n");
+            }
+            free_array(path, (size_t)g->count, sizeof(int), MEM_ROUTING);
+        } else if (strcmp(cmd, "detect") == 0) {
+            DetectHit hits[DETECT_MAX_HITS];
+            LAT_BEGIN(t0);
+            int nh = detect_emotions(g, arg, hits, DETECT_MAX_HITS);
+            LAT_RECORD(OP_CLASSIFY, t0);
+            printf(nh ? "ok" : "none");
+            for (int k=0;k<nh;++k) printf(" %s:%.2f", g->nodes[hits[k].node].name, hits[k].score);
+            printf("\n");
+        } else if (strcmp(cmd, "tips") == 0) {
+            int v = graph_resolve(g, arg);
+            if (v < 0) { batch_unknown(g, arg); continue; }
+            const EmotionNode *n = &g->nodes[v];
+            printf("ok %d %d\n", n->tip_top_count, n->tips_count);
+            for (int k=0;k<n->tip_top_count;++k) {
+                const Tip *tp = &n->tips[n->tip_top[k]];
+                printf("tip %d %d %d ", n->tip_top[k] + 1, tp->tried, tp->helped); fwrite_quoted(stdout, tp->text); printf("\n");
+            }
+        } else if (strcmp(cmd, "feedback") == 0) {
+            char emo[MAX_NAME_LEN], verdict[8]; int t;
+            if (sscanf(arg, "%47s %d %7s", emo, &t, verdict) != 3) { printf("error feedback needs an emotion, a tip number and yes or no\n"); continue; }
+            int v = graph_resolve(g, emo);
+            if (v < 0) { batch_unknown(g, emo); continue; }
+            EmotionNode *n = &g->nodes[v];
+            if (t < 1 || t > n->tips_count) { printf("error %s has %d tip%s\n", n->name, n->tips_count, n->tips_count == 1 ? "" : "s"); continue; }
+            tip_record(n, t - 1, verdict[0] == 'y' || verdict[0] == 'Y');
+            int place = 0;
+            for (int k=0;k<n->tip_top_count;++k) if (n->tip_top[k] == t - 1) place = k + 1;
+            printf("ok %d\n", place);
+        } else if (strcmp(cmd, "dedup") == 0) {
+            printf("ok %ld\n", tips_dedup(g));
+        } else if (strcmp(cmd, "search") == 0) {
+            enum { SHOWN = 100 };
+            TextDoc found[SHOWN];
+            int total = text_search(g, arg, found, SHOWN);
+            printf("ok %d\n", total);
+            for (int i=0;i<total && i<SHOWN;++i) {
+                const EmotionNode *n = &g->nodes[found[i].node];
+                if (found[i].kind == TEXT_TIP) { printf("tip %s ", n->name); fwrite_quoted(stdout, n->tips[found[i].slot].text); }
+                else {
+                    const Edge *e = &n->edges[found[i].slot];
+                    printf("action %s %s ", n->name, g->nodes[e->to].name); fwrite_quoted(stdout, e->procedure);
                 }
+                printf("\n");
             }
-        } else if (strcmp(token, "EDGE") == 0) {
-            p += 4; while (*p && isspace((unsigned char)*p)) ++p;
-            char from[MAX_NAME_LEN], to[MAX_NAME_LEN]; float w = 1.0f;
-            if (sscanf(p, "%47s %47s %f", from, to, &w) >= 2) {
-                char *q = strchr(p, '"'); char *proc = NULL;
-                if (q) { const char *endptr; proc = parse_quoted(q, &endptr); }
-                graph_add_edge(g, from, to, w, proc);
-                if (proc) free(proc);
+        } else if (strcmp(cmd, "checkin") == 0) {
+            int sc[4], max_steps = 0;
+            if (sscanf(arg, "%d %d %d %d %d", &sc[0], &sc[1], &sc[2], &sc[3], &max_steps) < 4) { printf("error checkin needs four scores\n"); continue; }
+            LAT_BEGIN(t0);
+            int pidx = choose_closest_prototype((float)sc[0], (float)sc[1], (float)sc[2], (float)sc[3], default_protos, DEFAULT_PROTO_COUNT);
+            LAT_RECORD(OP_CLASSIFY, t0);
+            TRACE_END("prototype_match", t0);
+            const char *inferred = default_protos[pidx].name;
+            if (graph_find(g, inferred) == -1) graph_add_node(g, inferred, -0.2f, (sc[0]+sc[1])/2.0f);
+            int src = graph_find(g, inferred), len;
+            int *path = realloc_or_die(NULL, 0, (size_t)g->count, sizeof(int), MEM_ROUTING);
+            float cost = batch_plan(g, src, max_steps, path, &len);
+            for (int k=0;k<4;++k) sc[k] = sc[k] < 0 ? 0 : sc[k] > 10 ? 10 : sc[k];
+            checkin_record(data, sc, pidx, src, path, len, cost);
+            free_array(path, (size_t)g->count, sizeof(int), MEM_ROUTING);
+        } else if (strcmp(cmd, "outcome") == 0) {
+            char from[MAX_NAME_LEN], to[MAX_NAME_LEN], verdict[8];
+            if (sscanf(arg, "%47s %47s %7s", from, to, verdict) != 3) { printf("error outcome needs two emotions and yes or no\n"); continue; }
+            int u = graph_resolve(g, from), v = graph_resolve(g, to);
+            if (u < 0) { batch_unknown(g, from); continue; }
+            if (v < 0) { batch_unknown(g, to); continue; }
+            float w = graph_learn_step(g, u, v, verdict[0] == 'y' || verdict[0] == 'Y');
+            if (w < 0.0f) printf("error no transition %s -> %s\n", g->nodes[u].name, g->nodes[v].name);
+            else printf("ok %.3f\n", w);
+        } else if (strcmp(cmd, "history") == 0) {
+            int ndays = *arg ? atoi(arg) : 14;
+            if (ndays < 1 || ndays > 36500) { printf("error history needs a number of days\n"); continue; }
+            checkin_print_recent(stdout, data, ndays, 1);
+        } else if (strcmp(cmd, "stats") == 0) {
+            if (strcmp(arg, "reset") == 0) {
+                memset(&emo_stats, 0, sizeof(emo_stats));
+#ifndef EMO_NO_STATS
+                memset(op_hist, 0, sizeof(op_hist));
+#endif
+                printf("ok\n");
+            } else stats_print(stdout);
+        } else if (strcmp(cmd, "save") == 0) {
+            printf(save_graph(g, data) ? "ok\n" : "error save failed\n");
+        } else printf("error unknown command '%s'\n", cmd);
+        fflush(stdout);
+    }
+    if (stats_out) {
+        FILE *f = (strcmp(stats_out, "-") == 0) ? stderr : fopen(stats_out, "w");
+        if (!f) perror("fopen");
+        else { stats_print(f); if (f != stderr) fclose(f); }
+    }
+    graph_free(g);
+    return 0;
+}
+
+/* ---------- Deterministic RNG ---------- */
+
+/* splitmix64: tiny and identical on every platform, so synthetic data is repeatable per seed */
+typedef struct { uint64_t s; } Rng;
+static uint64_t rng_next(Rng *r) {
+    uint64_t z = (r->s += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+static int rng_below(Rng *r, int n) { return (int)(rng_next(r) % (uint64_t)n); }
+static float rng_unit(Rng *r) { return (float)(rng_next(r) >> 40) / (float)(1ull << 24); }
+
+/* ---------- Synthetic graphs ----------
+   The first few nodes are the real anchors (goals, grounded, overwhelmed) so multi-goal
+   planning and the forbidden overwhelmed->positive rule behave as on a user map.
+   Every node is attached to an earlier one first, so the map is always connected.
+*/
+
+typedef enum { DEG_UNIFORM, DEG_POWERLAW, DEG_LOCAL } DegreeModel;
+
+typedef struct {
+    int nodes;
+    float avg_degree;       /* arcs per node; each edge contributes two */
+    DegreeModel degree;
+    float tip_density;      /* fraction of nodes carrying tips */
+    float proc_density;     /* fraction of edges carrying a procedure */
+    uint64_t seed;
+} SynthParams;
+
+static const char *synth_anchor_names[] = {"happy","calm","hopeful","peaceful","grounded","overwhelmed"};
+static const float synth_anchor_valence[] = {1.0f, 0.6f, 0.7f, 0.9f, -0.1f, -0.95f};
+#define SYNTH_ANCHORS 6
+#define SYNTH_GOALS 4      /* anchors 0..3 are the positive goals */
+
+static void synth_node_name(char *buf, size_t size, int i) {
+    if (i < SYNTH_ANCHORS) snprintf(buf, size, "%s", synth_anchor_names[i]);
+    else snprintf(buf, size, "state%07d", i);
+}
+
+static float synth_weight(Rng *r) { return (float)(5 + rng_below(r, 26)) / 10.0f; }   /* 0.5 .. 3.0 */
+
+static int parse_degree_model(const char *s, DegreeModel *out) {
+    if (strcmp(s, "uniform") == 0) *out = DEG_UNIFORM;
+    else if (strcmp(s, "powerlaw") == 0) *out = DEG_POWERLAW;
+    else if (strcmp(s, "local") == 0) *out = DEG_LOCAL;
+    else return 0;
+    return 1;
+}
+static const char *degree_model_name(DegreeModel d) {
+    return d == DEG_POWERLAW ? "powerlaw" : d == DEG_LOCAL ? "local" : "uniform";
+}
+
+/* Picks the other endpoint of a new edge from node u under the chosen degree model.
+   'ends' lists every endpoint inserted so far (preferential attachment for powerlaw). */
+static int synth_pick_target(Rng *r, const SynthParams *sp, int u, int limit, const int *ends, long ends_count) {
+    if (sp->degree == DEG_POWERLAW && ends_count > 0) {
+        int v = ends[rng_next(r) % (uint64_t)ends_count];
+        if (v < limit) return v;
+    }
+    if (sp->degree == DEG_LOCAL) {
+        int span = limit < 8 ? limit : 8;
+        int v = u - 1 - rng_below(r, span);
+        return v < 0 ? v + limit : v;
+    }
+    return rng_below(r, limit);
+}
+
+static EmotionGraph *synth_graph_build(const SynthParams *sp) {
+    EmotionGraph *g = graph_new();
+    Rng r = { sp->seed };
+    char name[MAX_NAME_LEN], text[96];
+    for (int i=0;i<sp->nodes;++i) {
+        synth_node_name(name, sizeof(name), i);
+        float val = (i < SYNTH_ANCHORS) ? synth_anchor_valence[i] : rng_unit(&r) * 2.0f - 1.0f;
+        graph_append_node(g, name, val, 1.0f + 9.0f * rng_unit(&r));
+    }
+    for (int i=0;i<sp->nodes;++i) {
+        if (rng_unit(&r) >= sp->tip_density) continue;
+        int k = 1 + rng_below(&r, 3);
+        for (int t=0;t<k;++t) {
+            snprintf(text, sizeof(text), "Synthetic tip %d for %s.", t+1, g->nodes[i].name);
+            graph_add_tip_idx(g, i, text);
+        }
+    }
+
+    long want = (long)((double)sp->nodes * sp->avg_degree / 2.0);
+    if (want < sp->nodes - 1) want = sp->nodes - 1;
+    int *ends = malloc(sizeof(int) * (size_t)(2 * want + 2));
+    if (!ends) { perror("malloc"); exit(1); }
+    long ends_count = 0;
+    for (long k=0;k<want;++k) {
+        int u, v;
+        if (k < sp->nodes - 1) {
+            /* spanning attachment: node k+1 joins an earlier node; overwhelmed hangs off grounded */
+            u = (int)k + 1;
+            v = (u == 5) ? 4 : synth_pick_target(&r, sp, u, u, ends, ends_count);
+        } else {
+            u = rng_below(&r, sp->nodes);
+            v = synth_pick_target(&r, sp, u, sp->nodes, ends, ends_count);
+            if (u == v) continue;
+        }
+        const char *proc = NULL;
+        if (rng_unit(&r) < sp->proc_density) { snprintf(text, sizeof(text), "synthetic action %ld", k); proc = text; }
+        graph_add_edge_idx(g, u, v, synth_weight(&r), proc);
+        ends[ends_count++] = u; ends[ends_count++] = v;
+    }
+    free(ends);
+    return g;
+}
+
+/* ---------- Synthetic data file generator ----------
+   emo_tool gen <file> [--nodes N] [--clusters K] [--avg-degree D] [--tips-per-node T]
+                       [--tip-len L] [--forbidden-rate P] [--seed S]
+   Streams NODE/TIP/EDGE records straight to disk (nothing is kept in memory), so files
+   of several GB can be produced for loader and router scale tests.
+    - nodes are grouped into K clusters of contiguous indices sharing a valence centre;
+      most edges stay inside a cluster
+    - every node is attached to an earlier node and each cluster head to "grounded",
+      so every state can reach the positive goals
+    - a fraction of edges is written as overwhelmed -> goal, which load_graph must drop
+    - tip texts are padded to the requested length (capped to fit MAX_LINE) and some
+      contain quotes to exercise escaping
+*/
+
+typedef struct {
+    int nodes;
+    int clusters;
+    float avg_degree;
+    int tips_per_node;
+    int tip_len;
+    float forbidden_rate;
+    uint64_t seed;
+} GenParams;
+
+static const char *gen_words[] = {
+    "breathe", "slowly", "notice", "your", "feet", "on", "the", "floor", "and", "name",
+    "three", "sounds", "around", "you", "then", "relax", "shoulders", "jaw", "hands", "for",
+    "a", "minute", "drink", "water", "step", "outside", "stretch", "gently", "write", "down"
+};
+#define GEN_WORDS ((int)(sizeof(gen_words)/sizeof(gen_words[0])))
+
+static void gen_tip_text(Rng *r, char *buf, int len, const char *node, int t) {
+    int n = snprintf(buf, (size_t)len + 1, "Tip %d for %s:", t + 1, node);
+    if (rng_below(r, 8) == 0 && n + 24 < len) n += snprintf(buf + n, (size_t)(len - n + 1), " say \"I need a break\"");
+    while (n < len) {
+        const char *w = gen_words[rng_below(r, GEN_WORDS)];
+        int wl = (int)strlen(w);
+        if (n + 1 + wl > len) break;
+        buf[n++] = ' ';
+        memcpy(buf + n, w, (size_t)wl); n += wl;
+    }
+    buf[n] = '\0';
+}
+
+/* Cluster c owns node indices [gen_cluster_start(c), gen_cluster_start(c+1)). */
+static int gen_cluster_start(const GenParams *gp, int c) {
+    long long body = gp->nodes - SYNTH_ANCHORS;
+    return SYNTH_ANCHORS + (int)(body * c / gp->clusters);
+}
+
+static int gen_cluster_of(const GenParams *gp, int i) {
+    long long body = gp->nodes - SYNTH_ANCHORS;
+    int c = (int)((long long)(i - SYNTH_ANCHORS) * gp->clusters / body);
+    while (c > 0 && gen_cluster_start(gp, c) > i) --c;
+    while (c + 1 < gp->clusters && gen_cluster_start(gp, c + 1) <= i) ++c;
+    return c;
+}
+
+static void gen_write_edge(FILE *f, Rng *r, int u, int v, long k) {
+    char a[MAX_NAME_LEN], b[MAX_NAME_LEN];
+    synth_node_name(a, sizeof(a), u); synth_node_name(b, sizeof(b), v);
+    fprintf(f, "EDGE %s %s %.3f ", a, b, synth_weight(r));
+    if (rng_below(r, 2)) { char proc[48]; snprintf(proc, sizeof(proc), "generated action %ld", k); fwrite_quoted(f, proc); }
+    else fprintf(f, "\"\"");
+    fputc('\n', f);
+}
+
+int generate_data_file(const GenParams *gp, const char *filename, long *out_tips, long *out_edges) {
+    FILE *f = fopen(filename, "w");
+    if (!f) { perror("fopen"); return 0; }
+    setvbuf(f, NULL, _IOFBF, 1 << 20);
+    Rng r = { gp->seed };
+    char name[MAX_NAME_LEN];
+    char *tip = malloc((size_t)gp->tip_len + 1);
+    float *centre = malloc(sizeof(float) * (size_t)gp->clusters);
+    if (!tip || !centre) { perror("malloc"); exit(1); }
+    for (int c=0;c<gp->clusters;++c) centre[c] = rng_unit(&r) * 1.6f - 0.8f;
+
+    long tips = 0, edges = 0;
+    for (int i=0;i<gp->nodes;++i) {
+        float val;
+        if (i < SYNTH_ANCHORS) val = synth_anchor_valence[i];
+        else {
+            val = centre[gen_cluster_of(gp, i)] + (rng_unit(&r) - 0.5f) * 0.2f;
+            if (val > 1.0f) val = 1.0f; else if (val < -1.0f) val = -1.0f;
+        }
+        synth_node_name(name, sizeof(name), i);
+        fprintf(f, "NODE %s %.3f %.3f\n", name, val, 1.0f + 9.0f * rng_unit(&r));
+        for (int t=0;t<gp->tips_per_node;++t) {
+            gen_tip_text(&r, tip, gp->tip_len, name, t);
+            fprintf(f, "TIP %s ", name); fwrite_quoted(f, tip); fputc('\n', f);
+            ++tips;
+        }
+    }
+
+    /* spanning part: guarantees every node can reach grounded and from there the goals */
+    static const int anchor_parent[SYNTH_ANCHORS] = {-1, 0, 0, 1, 1, 4};
+    for (int i=1;i<SYNTH_ANCHORS && i<gp->nodes;++i) gen_write_edge(f, &r, i, anchor_parent[i], edges++);
+    for (int i=SYNTH_ANCHORS;i<gp->nodes;++i) {
+        int c = gen_cluster_of(gp, i), start = gen_cluster_start(gp, c);
+        int parent = (i == start) ? 4 : start + rng_below(&r, i - start);
+        gen_write_edge(f, &r, i, parent, edges++);
+    }
+
+    long want = (long)((double)gp->nodes * gp->avg_degree / 2.0);
+    for (long k = edges; k < want; ++k) {
+        if (rng_unit(&r) < gp->forbidden_rate) {
+            fprintf(f, "EDGE overwhelmed %s %.3f \"\"\n", synth_anchor_names[rng_below(&r, SYNTH_GOALS)], synth_weight(&r));
+            continue;
+        }
+        int u = rng_below(&r, gp->nodes), v;
+        if (u >= SYNTH_ANCHORS && rng_below(&r, 100) < 85) {
+            int c = gen_cluster_of(gp, u), start = gen_cluster_start(gp, c);
+            int end = (c + 1 < gp->clusters) ? gen_cluster_start(gp, c + 1) : gp->nodes;
+            v = start + rng_below(&r, end - start);
+        } else v = rng_below(&r, gp->nodes);
+        if (u == v) continue;
+        gen_write_edge(f, &r, u, v, edges++);
+    }
+    free(tip); free(centre);
+    int ok = (fclose(f) == 0);
+    if (out_tips) *out_tips = tips;
+    if (out_edges) *out_edges = edges;
+    return ok;
+}
+
+static void gen_usage(void) {
+    fprintf(stderr, "usage: emo_tool gen <file> [--nodes 100000] [--clusters 32] [--avg-degree 4]\n"
+                    "                    [--tips-per-node 2] [--tip-len 120] [--forbidden-rate 0.001] [--seed 42]\n");
+}
+
+int gen_main(int argc, char **argv) {
+    GenParams gp = { 100000, 32, 4.0f, 2, 120, 0.001f, 42 };
+    if (argc < 1 || argv[0][0] == '-') { gen_usage(); return 2; }
+    const char *out = argv[0];
+    for (int i=1;i<argc;++i) {
+        const char *a = argv[i]; const char *v = (i+1 < argc) ? argv[i+1] : NULL;
+        if (!v) { gen_usage(); return 2; }
+        if (strcmp(a, "--nodes") == 0) gp.nodes = atoi(v);
+        else if (strcmp(a, "--clusters") == 0) gp.clusters = atoi(v);
+        else if (strcmp(a, "--avg-degree") == 0) gp.avg_degree = (float)atof(v);
+        else if (strcmp(a, "--tips-per-node") == 0) gp.tips_per_node = atoi(v);
+        else if (strcmp(a, "--tip-len") == 0) gp.tip_len = atoi(v);
+        else if (strcmp(a, "--forbidden-rate") == 0) gp.forbidden_rate = (float)atof(v);
+        else if (strcmp(a, "--seed") == 0) gp.seed = strtoull(v, NULL, 10);
+        else { gen_usage(); return 2; }
+        ++i;
+    }
+    if (gp.nodes < SYNTH_ANCHORS + 1) gp.nodes = SYNTH_ANCHORS + 1;
+    if (gp.clusters < 1) gp.clusters = 1;
+    if (gp.clusters > gp.nodes - SYNTH_ANCHORS) gp.clusters = gp.nodes - SYNTH_ANCHORS;
+    if (gp.tips_per_node < 0) gp.tips_per_node = 0;
+    /* a TIP line is "TIP <name> \"...\"" and must fit load_graph's line buffer even after escaping */
+    int max_tip = (MAX_LINE - 8 - MAX_NAME_LEN) / 2;
+    if (gp.tip_len > max_tip) { fprintf(stderr, "note: --tip-len capped at %d to fit the loader's line limit\n", max_tip); gp.tip_len = max_tip; }
+    if (gp.tip_len < 32) gp.tip_len = 32;
+
+    long tips = 0, edges = 0;
+    uint64_t t0 = now_ns();
+    if (!generate_data_file(&gp, out, &tips, &edges)) { fprintf(stderr, "Generation failed.\n"); return 1; }
+    double secs = (double)(now_ns() - t0) / 1e9;
+    FILE *f = fopen(out, "rb"); long long bytes = 0;
+    if (f) { fseek(f, 0, SEEK_END); bytes = ftell(f); fclose(f); }
+    printf("Wrote %s: %d nodes, %ld tips, %ld edges, %lld bytes in %.2fs\n", out, gp.nodes, tips, edges, bytes, secs);
+    return 0;
+}
+
+/* ---------- Routing benchmark ----------
+   emo_tool bench [--sizes 10,100,...] [--degree uniform|powerlaw|local] [--avg-degree D]
+                  [--tips P] [--procs P] [--queries Q] [--seed S] [--engine NAME]
+   Output is one line per (operation, size); the checksum column is the sum of returned
+   costs and only changes when routing results change, not when timings do.
+*/
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void bench_report(const char *op, int nodes, long arcs, uint64_t *samples, int count, int per_sample, double checksum) {
+    qsort(samples, count, sizeof(uint64_t), cmp_u64);
+    uint64_t total = 0;
+    for (int i=0;i<count;++i) total += samples[i];
+    double div = 1000.0 * per_sample;   /* ns per sample -> us per query */
+    double p50 = samples[(count - 1) * 50 / 100] / div;
+    double p90 = samples[(count - 1) * 90 / 100] / div;
+    double p99 = samples[(count - 1) * 99 / 100] / div;
+    double mx = samples[count - 1] / div;
+    double qps = total ? (double)count * per_sample * 1e9 / (double)total : 0.0;
+    printf("%-6s %8d %9ld %7d %10.3f %10.3f %10.3f %10.3f %12.0f %16.4f\n",
+           op, nodes, arcs, count * per_sample, p50, p90, p99, mx, qps, checksum);
+}
+
+static int parse_size_list(const char *s, int *out, int max) {
+    int n = 0;
+    while (*s && n < max) {
+        char *end; long v = strtol(s, &end, 10);
+        if (end == s || v < SYNTH_ANCHORS || v > 100000000L) return 0;
+        out[n++] = (int)v;
+        s = (*end == ',') ? end + 1 : end;
+        if (*end && *end != ',') return 0;
+    }
+    return n;
+}
+
+static void bench_usage(void) {
+    fprintf(stderr, "usage: emo_tool bench [--sizes 10,100,1000,10000] [--degree uniform|powerlaw|local]\n"
+                    "                      [--avg-degree 4] [--tips 0.5] [--procs 0.5] [--queries 200] [--seed 42]\n"
+                    "                      [--engine NAME]\nengines:");
+    for (int i=0;i<ROUTE_ENGINE_COUNT;++i) fprintf(stderr, " %s", route_engines[i].name);
+    fprintf(stderr, "\n");
+}
+
+int bench_main(int argc, char **argv) {
+    SynthParams sp = { 0, 4.0f, DEG_UNIFORM, 0.5f, 0.5f, 42 };
+    int sizes[16] = {10, 100, 1000, 10000}; int nsizes = 4;
+    int queries = 200;
+    const char *engine = "auto";
+    for (int i=0;i<argc;++i) {
+        const char *a = argv[i]; const char *v = (i+1 < argc) ? argv[i+1] : NULL;
+        if (!v) { bench_usage(); return 2; }
+        if (strcmp(a, "--sizes") == 0) { nsizes = parse_size_list(v, sizes, 16); if (!nsizes) { bench_usage(); return 2; } }
+        else if (strcmp(a, "--degree") == 0) { if (!parse_degree_model(v, &sp.degree)) { bench_usage(); return 2; } }
+        else if (strcmp(a, "--avg-degree") == 0) sp.avg_degree = (float)atof(v);
+        else if (strcmp(a, "--tips") == 0) sp.tip_density = (float)atof(v);
+        else if (strcmp(a, "--procs") == 0) sp.proc_density = (float)atof(v);
+        else if (strcmp(a, "--queries") == 0) queries = atoi(v);
+        else if (strcmp(a, "--seed") == 0) sp.seed = strtoull(v, NULL, 10);
+        else if (strcmp(a, "--engine") == 0) {
+            const RouteEngine *en = route_engine_find(v);
+            if (!en) { bench_usage(); return 2; }
+            route_active = en->fn; engine = en->name;
+        }
+        else { bench_usage(); return 2; }
+        ++i;
+    }
+    if (queries < 1) queries = 1;
+
+    printf("# routing benchmark: engine=%s seed=%llu degree=%s avg_degree=%.1f tips=%.2f procs=%.2f\n",
+           engine, (unsigned long long)sp.seed, degree_model_name(sp.degree), sp.avg_degree, sp.tip_density, sp.proc_density);
+    printf("# latencies in microseconds; above 1000 nodes route/plan queries scale by 1000/nodes\n");
+    printf("%-6s %8s %9s %7s %10s %10s %10s %10s %12s %16s\n",
+           "op", "nodes", "arcs", "queries", "p50_us", "p90_us", "p99_us", "max_us", "qps", "checksum");
+
+    for (int si=0; si<nsizes; ++si) {
+        sp.nodes = sizes[si];
+        EmotionGraph *g = synth_graph_build(&sp);
+        long arcs = 0;
+        for (int i=0;i<g->count;++i) arcs += g->nodes[i].edges_count;
+        int q = queries;
+        if (g->count > 1000) { q = (int)((long long)queries * 1000 / g->count); if (q < 1) q = 1; }
+        uint64_t *samples = malloc(sizeof(uint64_t) * (size_t)(q > queries ? q : queries));
+        int *path = malloc(sizeof(int) * (size_t)g->count);
+        if (!samples || !path) { perror("malloc"); exit(1); }
+        Rng r = { sp.seed ^ (uint64_t)g->count };
+        int goals[SYNTH_GOALS] = {0, 1, 2, 3};
+
+        double sum = 0.0;
+        for (int k=0;k<q;++k) {
+            int src = rng_below(&r, g->count), dst = rng_below(&r, g->count), len = 0;
+            uint64_t t0 = now_ns();
+            float c = route_active(g, src, dst, path, &len);
+            samples[k] = now_ns() - t0;
+            if (c != FLT_MAX) sum += c;
+        }
+        bench_report("route", g->count, arcs, samples, q, 1, sum);
+
+        sum = 0.0;
+        for (int k=0;k<q;++k) {
+            int src = SYNTH_GOALS + rng_below(&r, g->count - SYNTH_GOALS), len = 0;
+            uint64_t t0 = now_ns();
+            float c = plan_best_goal(g, src, goals, SYNTH_GOALS, path, &len, NULL);
+            samples[k] = now_ns() - t0;
+            if (c != FLT_MAX) sum += c;
+        }
+        bench_report("plan", g->count, arcs, samples, q, 1, sum);
+
+        sum = 0.0;
+        for (int k=0;k<q;++k) {
+            int src = SYNTH_GOALS + rng_below(&r, g->count - SYNTH_GOALS);
+            ParetoPlan plans[PARETO_MAX_PLANS];
+            uint64_t t0 = now_ns();
+            int np = plan_pareto(g, src, goals, SYNTH_GOALS, 0, plans, PARETO_MAX_PLANS);
+            samples[k] = now_ns() - t0;
+            for (int i=0;i<np;++i) sum += plans[i].cost + plans[i].steps + plans[i].unguided;
+        }
+        bench_report("pareto", g->count, arcs, samples, q, 1, sum);
+
+        /* a typo of an existing name: drop one character */
+        sum = 0.0;
+        for (int k=0;k<queries;++k) {
+            char typo[MAX_NAME_LEN];
+            const char *name = g->nodes[rng_below(&r, g->count)].name;
+            int len = (int)strlen(name), cut = rng_below(&r, len);
+            memcpy(typo, name, (size_t)cut); strcpy(typo + cut, name + cut + 1);
+            uint64_t t0 = now_ns();
+            int sidx = graph_suggest_name(g, typo);
+            samples[k] = now_ns() - t0;
+            sum += sidx >= 0 && strcmp(g->nodes[sidx].name, name) == 0;
+        }
+        bench_report("suggest", g->count, arcs, samples, queries, 1, sum);
+
+        /* a chat-sized sentence naming two emotions among filler words */
+        {
+            static const char *const filler[] = { "i", "feel", "kind", "of", "today", "and", "work", "was", "a", "lot", "but", "my", "friend", "called", "so", "maybe" };
+            char text[512];
+            sum = 0.0;
+            for (int k=0;k<queries;++k) {
+                int len = 0;
+                for (int w=0;w<16;++w) {
+                    const char *word = (w == 5 || w == 12) ? g->nodes[rng_below(&r, g->count)].name : filler[rng_below(&r, 16)];
+                    len += snprintf(text + len, sizeof(text) - (size_t)len, "%s%s", w ? " " : "", word);
+                }
+                DetectHit hits[DETECT_MAX_HITS];
+                uint64_t t0 = now_ns();
+                int nh = detect_emotions(g, text, hits, DETECT_MAX_HITS);
+                samples[k] = now_ns() - t0;
+                sum += nh;
             }
+            bench_report("detect", g->count, arcs, samples, queries, 1, sum);
+        }
+
+        /* two-word search: a word every synthetic tip has and a name prefix */
+        sum = 0.0;
+        for (int k=0;k<queries;++k) {
+            char query[MAX_NAME_LEN + 8];
+            snprintf(query, sizeof(query), "tip %s", g->nodes[rng_below(&r, g->count)].name);
+            TextDoc found[16];
+            uint64_t t0 = now_ns();
+            int total = text_search(g, query, found, 16);
+            samples[k] = now_ns() - t0;
+            sum += total;
+        }
+        bench_report("search", g->count, arcs, samples, queries, 1, sum);
+
+        /* name lookups are tens of ns, so each sample times a batch */
+        enum { FIND_BATCH = 100 };
+        sum = 0.0;
+        for (int k=0;k<queries;++k) {
+            const char *name = g->nodes[rng_below(&r, g->count)].name;
+            uint64_t t0 = now_ns();
+            int acc = 0;
+            for (int b=0;b<FIND_BATCH;++b) acc += graph_find(g, name);
+            samples[k] = now_ns() - t0;
+            sum += acc / FIND_BATCH;
+        }
+        bench_report("find", g->count, arcs, samples, queries, FIND_BATCH, sum);
+
+        /* prototype matching is ~10ns, so each sample times a batch of calls */
+        enum { PROTO_BATCH = 1000 };
+        sum = 0.0;
+        for (int k=0;k<queries;++k) {
+            float sc[4]; for (int j=0;j<4;++j) sc[j] = (float)rng_below(&r, 11);
+            uint64_t t0 = now_ns();
+            int acc = 0;
+            for (int b=0;b<PROTO_BATCH;++b)
+                acc += choose_closest_prototype(sc[0], sc[1], sc[2], (float)(b % 11), default_protos, DEFAULT_PROTO_COUNT);
+            samples[k] = now_ns() - t0;
+            sum += acc;
+        }
+        bench_report("proto", g->count, arcs, samples, queries, PROTO_BATCH, sum);
+
+        /* outcome feedback on random arcs of a routed map (snapshot patched, not rebuilt) */
+        route_csr_get(g);
+        sum = 0.0;
+        for (int k=0;k<queries;++k) {
+            int u = rng_below(&r, g->count);
+            if (!g->nodes[u].edges_count) { samples[k] = 0; continue; }
+            int v = g->nodes[u].edges[rng_below(&r, g->nodes[u].edges_count)].to;
+            uint64_t t0 = now_ns();
+            sum += graph_learn_step(g, u, v, rng_below(&r, 2));
+            samples[k] = now_ns() - t0;
+        }
+        bench_report("learn", g->count, arcs, samples, queries, 1, sum);
+
+        free(samples); free(path);
+        graph_free(g);
+    }
+    return 0;
+}
+
+/* ---------- Load/save benchmark ----------
+   emo_tool bench-io [--sizes 1000,5000,20000] [--dir .] [--tips-per-node 2] [--tip-len 120] [--seed 42]
+   For each size a data file is generated, then load, save, reload (the option 7 path:
+   graph_clear + load_graph) and graph_free are timed. Temporary files are removed.
+*/
+
+/* Peak resident set size of the process in KB (0 where unavailable). */
+static long peak_rss_kb(void) {
+#ifdef _WIN32
+    return 0;
+#else
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+#ifdef __APPLE__
+    return ru.ru_maxrss / 1024;
+#else
+    return ru.ru_maxrss;
+#endif
+#endif
+}
+
+static long long file_size_bytes(const char *filename) {
+    FILE *f = fopen(filename, "rb");
+    if (!f) return 0;
+    fseek(f, 0, SEEK_END);
+    long long n = ftell(f);
+    fclose(f);
+    return n;
+}
+
+static void bench_io_report(const char *op, int nodes, long long bytes, long records, uint64_t ns, unsigned long long allocs) {
+    double secs = ns / 1e9;
+    double mbs = secs > 0 ? (double)bytes / (1024.0 * 1024.0) / secs : 0.0;
+    double rps = secs > 0 ? (double)records / secs : 0.0;
+    printf("%-7s %8d %12lld %9ld %10.3f %10.1f %12.0f %10ld %12llu\n",
+           op, nodes, bytes, records, secs * 1000.0, mbs, rps, peak_rss_kb(), allocs);
+}
+
+static void bench_io_usage(void) {
+    fprintf(stderr, "usage: emo_tool bench-io [--sizes 1000,5000,20000] [--dir .] [--tips-per-node 2] [--tip-len 120] [--seed 42]\n");
+}
+
+int bench_io_main(int argc, char **argv) {
+    GenParams gp = { 0, 16, 4.0f, 2, 120, 0.001f, 42 };
+    int sizes[16] = {1000, 5000, 20000}; int nsizes = 3;
+    const char *dir = ".";
+    for (int i=0;i<argc;++i) {
+        const char *a = argv[i]; const char *v = (i+1 < argc) ? argv[i+1] : NULL;
+        if (!v) { bench_io_usage(); return 2; }
+        if (strcmp(a, "--sizes") == 0) { nsizes = parse_size_list(v, sizes, 16); if (!nsizes) { bench_io_usage(); return 2; } }
+        else if (strcmp(a, "--dir") == 0) dir = v;
+        else if (strcmp(a, "--tips-per-node") == 0) gp.tips_per_node = atoi(v);
+        else if (strcmp(a, "--tip-len") == 0) gp.tip_len = atoi(v);
+        else if (strcmp(a, "--seed") == 0) gp.seed = strtoull(v, NULL, 10);
+        else { bench_io_usage(); return 2; }
+        ++i;
+    }
+    if (gp.tip_len < 32) gp.tip_len = 32;
+    if (gp.tip_len > (MAX_LINE - 8 - MAX_NAME_LEN) / 2) gp.tip_len = (MAX_LINE - 8 - MAX_NAME_LEN) / 2;
+    if (gp.tips_per_node < 0) gp.tips_per_node = 0;
+
+    char in_path[1024], out_path[1024];
+    snprintf(in_path, sizeof(in_path), "%s/emo_bench_in.txt", dir);
+    snprintf(out_path, sizeof(out_path), "%s/emo_bench_out.txt", dir);
+
+    printf("# load/save benchmark: seed=%llu tips_per_node=%d tip_len=%d\n",
+           (unsigned long long)gp.seed, gp.tips_per_node, gp.tip_len);
+    printf("%-7s %8s %12s %9s %10s %10s %12s %10s %12s\n",
+           "op", "nodes", "bytes", "records", "ms", "MB/s", "records/s", "peak_kb", "allocs");
+
+    for (int si=0; si<nsizes; ++si) {
+        gp.nodes = sizes[si];
+        gp.clusters = gp.nodes / 64 > 0 ? gp.nodes / 64 : 1;
+        if (gp.clusters > gp.nodes - SYNTH_ANCHORS) gp.clusters = gp.nodes - SYNTH_ANCHORS;
+        long tips = 0, edges = 0;
+        if (!generate_data_file(&gp, in_path, &tips, &edges)) { fprintf(stderr, "Generation failed.\n"); return 1; }
+        long records = gp.nodes + tips + edges;
+        long long in_bytes = file_size_bytes(in_path);
+
+        unsigned long long a0 = emo_stats.allocs; uint64_t t0 = now_ns();
+        EmotionGraph *g = graph_new();
+        int ok = load_graph(g, in_path);
+        bench_io_report("load", gp.nodes, in_bytes, records, now_ns() - t0, emo_stats.allocs - a0);
+
+        a0 = emo_stats.allocs; t0 = now_ns();
+        ok = ok && save_graph(g, out_path);
+        uint64_t dt = now_ns() - t0;
+        bench_io_report("save", gp.nodes, file_size_bytes(out_path), records, dt, emo_stats.allocs - a0);
+
+        a0 = emo_stats.allocs; t0 = now_ns();
+        graph_clear(g);
+        ok = ok && load_graph(g, out_path);
+        bench_io_report("reload", gp.nodes, file_size_bytes(out_path), records, now_ns() - t0, emo_stats.allocs - a0);
+
+        a0 = emo_stats.allocs; t0 = now_ns();
+        tips_dedup(g);
+        bench_io_report("dedup", gp.nodes, 0, tips, now_ns() - t0, emo_stats.allocs - a0);
+
+        a0 = emo_stats.allocs; t0 = now_ns();
+        graph_free(g);
+        bench_io_report("free", gp.nodes, 0, records, now_ns() - t0, emo_stats.allocs - a0);
+
+        remove(in_path); remove(out_path);
+        if (!ok) { fprintf(stderr, "Load or save failed at %d nodes.\n", gp.nodes); return 1; }
+    }
+    return 0;
+}
+
+/* ---------- Check-in log benchmark ----------
+   emo_tool bench-log [--rows 20000000] [--per-day 5000] [--dir .] [--seed 42]
+   Appends a synthetic history (per-day check-ins on average, one day after another) to a
+   temporary log, then times the daily averages over the whole log: the mmap'd column
+   scan and, as a cross-check, a plain loop over every row. Both are timed after one
+   untimed scan, so the pages are mapped and cached for each. The file is removed.
+*/
+
+static void bench_log_usage(void) {
+    fprintf(stderr, "usage: emo_tool bench-log [--rows N] [--per-day N] [--dir DIR] [--seed S]\n");
+}
+
+int bench_log_main(int argc, char **argv) {
+    long rows = 20000000, per_day = 5000; const char *dir = "."; uint64_t seed = 42;
+    for (int i=0;i<argc;++i) {
+        const char *a = argv[i]; const char *v = (i+1 < argc) ? argv[i+1] : NULL;
+        if (!v) { bench_log_usage(); return 2; }
+        if (strcmp(a, "--rows") == 0) rows = atol(v);
+        else if (strcmp(a, "--per-day") == 0) per_day = atol(v);
+        else if (strcmp(a, "--dir") == 0) dir = v;
+        else if (strcmp(a, "--seed") == 0) seed = strtoull(v, NULL, 10);
+        else { bench_log_usage(); return 2; }
+        ++i;
+    }
+    if (rows < 1) rows = 1;
+    if (per_day < 1) per_day = 1;
+    char path[1024]; snprintf(path, sizeof(path), "%s/emo_bench.checkins", dir);
+    remove(path);
+
+    enum { CHUNK = 1 << 16 };
+    CheckinRow *chunk = realloc_or_die(NULL, 0, CHUNK, sizeof(CheckinRow), MEM_OTHER);
+    Rng r = { seed };
+    int64_t ts = 1700000000, step = 86400 / per_day;
+    if (step < 1) step = 1;
+    uint64_t t0 = now_ns();
+    int ok = 1;
+    for (long done = 0; ok && done < rows; ) {
+        long n = rows - done < CHUNK ? rows - done : CHUNK;
+        for (long i=0;i<n;++i) {
+            CheckinRow *c = &chunk[i];
+            ts += rng_below(&r, (int)(2 * step + 1));
+            c->ts = ts;
+            for (int k=0;k<4;++k) c->scores[k] = (unsigned char)rng_below(&r, 11);
+            c->proto = (unsigned char)rng_below(&r, DEFAULT_PROTO_COUNT);
+            c->steps = (unsigned char)rng_below(&r, 6);
+            c->source = rng_below(&r, 20); c->goal = rng_below(&r, 20);
+            c->cost = (float)rng_below(&r, 1000) / 100.0f;
         }
+        ok = checkin_log_append(path, chunk, n);
+        done += n;
+    }
+    double append_ms = (double)(now_ns() - t0) / 1e6;
+    free_array(chunk, CHUNK, sizeof(CheckinRow), MEM_OTHER);
+    CheckinLog log;
+    if (!ok || !checkin_log_open(path, &log)) { fprintf(stderr, "cannot write %s\n", path); remove(path); return 1; }
+
+    long first = checkin_utc_day(1700000000), ndays = checkin_utc_day(checkin_log_last_ts(&log)) - first + 1;
+    CheckinDay *days = realloc_or_die(NULL, 0, (size_t)ndays, sizeof(CheckinDay), MEM_OTHER);
+    int64_t *bounds = realloc_or_die(NULL, 0, (size_t)ndays + 1, sizeof(int64_t), MEM_OTHER);
+    checkin_utc_bounds(first, ndays, bounds);
+    printf("# check-in log: rows=%ld days=%ld file=%.1f MB\n", log.rows, ndays, (double)log.size / 1e6);
+    printf("%-10s %12s %10s %12s %16s\n", "step", "rows", "ms", "Mrows/s", "checksum");
+    printf("%-10s %12ld %10.2f %12.1f %16s\n", "append", log.rows, append_ms, log.rows / append_ms / 1e3, "-");
+
+    double col_sum = 0.0, row_sum = 0.0;
+    checkin_log_daily(&log, bounds, first, ndays, days);
+    t0 = now_ns();
+    long counted = checkin_log_daily(&log, bounds, first, ndays, days);
+    double col_ms = (double)(now_ns() - t0) / 1e6;
+    for (long d=0; d<ndays; ++d) for (int k=0;k<4;++k) if (days[d].count) col_sum += (double)days[d].sum[k] / days[d].count;
+    printf("%-10s %12ld %10.2f %12.1f %16.4f\n", "daily", counted, col_ms, counted / col_ms / 1e3, col_sum);
+
+    /* the same per-day averages, one row at a time */
+    for (long d=0; d<ndays; ++d) memset(&days[d], 0, sizeof(days[d]));
+    t0 = now_ns();
+    for (long i=0;i<log.rows;++i) {
+        long b = i / CHECKIN_BLOCK; int k = (int)(i % CHECKIN_BLOCK);
+        long d = checkin_utc_day(((const int64_t *)checkin_column(&log, b, CK_TS))[k]) - first;
+        days[d].count++;
+        for (int c=0;c<4;++c) days[d].sum[c] += checkin_column(&log, b, CK_STRESS + c)[k];
     }
-    fclose(f); return 1;
+    double row_ms = (double)(now_ns() - t0) / 1e6;
+    for (long d=0; d<ndays; ++d) for (int k=0;k<4;++k) if (days[d].count) row_sum += (double)days[d].sum[k] / days[d].count;
+    printf("%-10s %12ld %10.2f %12.1f %16.4f%s\n", "per-row", log.rows, row_ms, log.rows / row_ms / 1e3, row_sum,
+           fabs(row_sum - col_sum) > 1e-6 * (fabs(col_sum) + 1.0) ? "  MISMATCH" : "");
+
+    free_array(days, (size_t)ndays, sizeof(CheckinDay), MEM_OTHER);
+    free_array(bounds, (size_t)ndays + 1, sizeof(int64_t), MEM_OTHER);
+    checkin_log_close(&log);
+    remove(path);
+    return 0;
 }
 
-/* ---------- Friendly explanation for the user ---------- */
+/* ---------- Offline single-source analysis ----------
+   sssp:  costs from one emotion to every other state of a (large, merged) data file.
+   bench-sssp: delta-stepping at several thread counts against a sequential Dijkstra
+   over the same CSR snapshot, with a checksum so the runs can be compared.
+*/
 
-void show_simple_explanation() {
-    printf("\nHow this helper chooses a plan (short version):\n");
-    printf("  - Emotions are like locations on a map.\n");
-    printf("  - Each connection has a difficulty - some routes are easier.\n");
-    printf("  - Your personal tips and actions make certain routes easier.\n");
-    printf("  - The system finds the smoothest step-by-step route from how you feel now\n");
-    printf("    to a nearby positive state (like calm or happy) and suggests actions.\n");
-    printf("  - Some jumps are blocked for safety and realism - e.g., if you're overwhelmed\n");
-    printf("    you first move to a grounding step before aiming for calm or happy.\n\n");
+static double sssp_checksum(const float *dist, int n, int *reached) {
+    double sum = 0.0; int r = 0;
+    for (int i=0;i<n;++i) if (dist[i] != FLT_MAX) { sum += dist[i]; ++r; }
+    if (reached) *reached = r;
+    return sum;
 }
 
-/* ---------- Interactive UI ---------- */
+static int parse_thread_list(const char *s, int *out, int max) {
+    int n = 0;
+    while (*s && n < max) {
+        char *end; long v = strtol(s, &end, 10);
+        if (end == s || v < 1 || v > 1024) return 0;
+        out[n++] = (int)v;
+        if (*end && *end != ',') return 0;
+        s = (*end == ',') ? end + 1 : end;
+    }
+    return n;
+}
 
-static void read_line_trim_wrapper(char *buf, int size) { read_line_trim(buf, size); }
-static int read_int_in_range_wrapper(const char *prompt, int lo, int hi) { return read_int_in_range(prompt, lo, hi); }
+static void sssp_usage(void) {
+    fprintf(stderr, "usage: emo_tool sssp --from EMOTION [--data FILE] [--threads T] [--delta D] [--out FILE|-]\n"
+                    "       emo_tool bench-sssp [--nodes 1000000] [--degree uniform|powerlaw|local] [--avg-degree 4]\n"
+                    "                           [--threads 1,8,16,32,64] [--delta D] [--sources 3] [--seed 42]\n");
+}
 
-void seed_defaults_if_empty(EmotionGraph *g) {
-    if (g->count > 0) return;
+int sssp_main(int argc, char **argv) {
+    const char *data = SAVE_FILE, *from = NULL, *out = "-";
+    int threads = 0; float delta = 0.0f;
+    for (int i=0;i<argc;++i) {
+        const char *a = argv[i]; const char *v = (i+1 < argc) ? argv[i+1] : NULL;
+        if (!v) { sssp_usage(); return 2; }
+        if (strcmp(a, "--from") == 0) from = v;
+        else if (strcmp(a, "--data") == 0) data = v;
+        else if (strcmp(a, "--threads") == 0) threads = atoi(v);
+        else if (strcmp(a, "--delta") == 0) delta = (float)atof(v);
+        else if (strcmp(a, "--out") == 0) out = v;
+        else { sssp_usage(); return 2; }
+        ++i;
+    }
+    if (!from) { sssp_usage(); return 2; }
+    EmotionGraph *g = graph_new();
+    if (!load_graph(g, data)) { fprintf(stderr, "cannot load %s\n", data); graph_free(g); return 1; }
+    int src = graph_resolve(g, from);
+    if (src < 0) { fprintf(stderr, "unknown emotion: %s\n", from); graph_free(g); return 1; }
+    if (threads > 0) delta_thread_count = threads;
+    const RouteCSR *c = route_csr_get(g);
+    float *dist = realloc_or_die(NULL, 0, (size_t)c->n, sizeof(float), MEM_ROUTING);
+    int *pred = realloc_or_die(NULL, 0, (size_t)c->n, sizeof(int), MEM_ROUTING);
+    uint64_t t0 = now_ns();
+    sssp_delta_stepping(c, src, -1, default_thread_count(), delta, dist, pred);
+    double ms = (double)(now_ns() - t0) / 1e6;
 
-    /* Add nodes with internal valence/baseline (not shown to user) */
-    graph_add_node(g, "overwhelmed", -0.95f, 8.5f);
-    graph_add_node(g, "anxious", -0.7f, 7.0f);
-    graph_add_node(g, "frustrated", -0.6f, 6.0f);
-    graph_add_node(g, "angry", -0.7f, 6.5f);
-    graph_add_node(g, "sad", -0.8f, 6.0f);
-    graph_add_node(g, "lonely", -0.5f, 5.0f);
-    graph_add_node(g, "grounded", -0.1f, 3.0f);
-    graph_add_node(g, "calm", 0.6f, 3.0f);
-    graph_add_node(g, "hopeful", 0.7f, 2.5f);
-    graph_add_node(g, "happy", 1.0f, 1.5f);
-    graph_add_node(g, "peaceful", 0.9f, 1.5f);
+    FILE *f = strcmp(out, "-") == 0 ? stdout : fopen(out, "w");
+    if (!f) { perror(out); graph_free(g); return 1; }
+    fprintf(f, "# emotion\tcost\tvia\n");
+    for (int i=0;i<c->n;++i) {
+        if (dist[i] == FLT_MAX) continue;
+        fprintf(f, "%s\t%.4f\t%s\n", g->nodes[i].name, dist[i], pred[i] >= 0 ? g->nodes[pred[i]].name : "-");
+    }
+    if (f != stdout) fclose(f);
+    int reached = 0;
+    double sum = sssp_checksum(dist, c->n, &reached);
+    fprintf(stderr, "sssp from %s: %d/%d states reachable, %.2f ms, %d threads, checksum %.4f\n",
+            from, reached, c->n, ms, default_thread_count(), sum);
+    free_array(dist, c->n, sizeof(float), MEM_ROUTING);
+    free_array(pred, c->n, sizeof(int), MEM_ROUTING);
+    graph_free(g);
+    return 0;
+}
 
-    /* Add default tips for each node (at least one; many have more) */
-    graph_add_tip(g, "overwhelmed", "Put your phone away and take 3 big slow breaths.");
-    graph_add_tip(g, "overwhelmed", "Try: press your feet firmly into the ground for 30 seconds.");
-    graph_add_tip(g, "anxious", "5 slow breaths (inhale 4s, hold 2s, exhale 6s).");
-    graph_add_tip(g, "anxious", "Name 5 things you can see right now.");
-    graph_add_tip(g, "frustrated", "Step away for 2 minutes and stretch.");
-    graph_add_tip(g, "frustrated", "Count backwards from 20 slowly.");
-    graph_add_tip(g, "angry", "Take a 60-second walk or do physical movement.");
-    graph_add_tip(g, "sad", "Write 3 small things that went okay today.");
-    graph_add_tip(g, "sad", "Call or message someone you trust - say 'I need a small favor'.");
-    graph_add_tip(g, "lonely", "Try a brief message to a friend or online community.");
-    graph_add_tip(g, "grounded", "Place an object in your hand and describe it slowly.");
-    graph_add_tip(g, "calm", "Listen to a favorite 3-minute song.");
-    graph_add_tip(g, "hopeful", "List one small goal for the next 24 hours.");
-    graph_add_tip(g, "happy", "Celebrate: do one small reward for yourself.");
-    graph_add_tip(g, "peaceful", "Try a 2-minute body scan relaxation.");
+static void apsp_usage(void) {
+    fprintf(stderr, "usage: emo_tool apsp [--data FILE] [--threads T] [--method auto|fw|dijkstra] [--csv FILE|-] [--no-save]\n");
+}
 
-    /* Add edges (note: graph_add_edge will block direct overwhelmed -> positive) */
-    graph_add_edge(g, "overwhelmed", "grounded", 1.0f, "5 grounding breaths & plant feet");
-    graph_add_edge(g, "grounded", "calm", 1.5f, "2-minute breathing");
-    graph_add_edge(g, "calm", "happy", 1.5f, "play a mood-lifting song");
-    graph_add_edge(g, "calm", "peaceful", 1.0f, "gentle stretching");
-    graph_add_edge(g, "anxious", "grounded", 1.2f, "5 slow breaths");
-    graph_add_edge(g, "anxious", "frustrated", 1.8f, NULL);
-    graph_add_edge(g, "frustrated", "calm", 1.5f, "count to 10 and stretch");
-    graph_add_edge(g, "frustrated", "angry", 2.0f, "step away and breathe");
-    graph_add_edge(g, "angry", "grounded", 2.0f, "walk for 2 minutes");
-    graph_add_edge(g, "sad", "hopeful", 2.0f, "write 3 small wins");
-    graph_add_edge(g, "lonely", "hopeful", 2.5f, "reach out to one person");
-    /* Note: we do NOT add direct overwhelmed->happy/calm/hopeful edges. */
+/* Builds the all-pairs table for a data file, saves it next to the file and
+   optionally writes the cost matrix as CSV (empty cell = unreachable). */
+int apsp_main(int argc, char **argv) {
+    const char *data = SAVE_FILE, *csv = NULL;
+    int threads = 0, save = 1; ApspMethod method = APSP_AUTO;
+    for (int i=0;i<argc;++i) {
+        const char *a = argv[i]; const char *v = (i+1 < argc) ? argv[i+1] : NULL;
+        if (strcmp(a, "--no-save") == 0) { save = 0; continue; }
+        if (!v) { apsp_usage(); return 2; }
+        if (strcmp(a, "--data") == 0) data = v;
+        else if (strcmp(a, "--threads") == 0) threads = atoi(v);
+        else if (strcmp(a, "--csv") == 0) csv = v;
+        else if (strcmp(a, "--method") == 0) {
+            if (strcmp(v, "auto") == 0) method = APSP_AUTO;
+            else if (strcmp(v, "fw") == 0) method = APSP_FW;
+            else if (strcmp(v, "dijkstra") == 0) method = APSP_DIJKSTRA;
+            else { apsp_usage(); return 2; }
+        }
+        else { apsp_usage(); return 2; }
+        ++i;
+    }
+    EmotionGraph *g = graph_new();
+    if (!load_graph(g, data)) { fprintf(stderr, "cannot load %s\n", data); graph_free(g); return 1; }
+    if (threads > 0) delta_thread_count = threads;
+    uint64_t t0 = now_ns();
+    if (!apsp_build(g, method, default_thread_count())) {
+        fprintf(stderr, "%d states: all-pairs table supports at most %d\n", g->count, APSP_MAX_NODES);
+        graph_free(g); return 1;
+    }
+    double ms = (double)(now_ns() - t0) / 1e6;
+    const ApspTable *t = &route_apsp; int n = t->n;
+    long reachable = 0;
+    for (size_t i=0;i<(size_t)n*n;++i) if (t->cost[i] != FLT_MAX) ++reachable;
+    fprintf(stderr, "apsp: %d states, %ld reachable pairs, %.2f ms, %d threads, %.1f MB\n",
+            n, reachable, ms, default_thread_count(), (double)n * n * (sizeof(float) + sizeof(uint16_t)) / 1e6);
+    if (save && !apsp_save(data)) fprintf(stderr, "could not write %s.apsp\n", data);
+    if (csv) {
+        FILE *f = strcmp(csv, "-") == 0 ? stdout : fopen(csv, "w");
+        if (!f) { perror(csv); graph_free(g); return 1; }
+        fprintf(f, "from\\to");
+        for (int j=0;j<n;++j) fprintf(f, ",%s", g->nodes[j].name);
+        fputc('\n', f);
+        for (int i=0;i<n;++i) {
+            fputs(g->nodes[i].name, f);
+            for (int j=0;j<n;++j) {
+                float c = t->cost[(size_t)i*n + j];
+                if (c == FLT_MAX) fputc(',', f); else fprintf(f, ",%.4f", c);
+            }
+            fputc('\n', f);
+        }
+        if (f != stdout) fclose(f);
+    }
+    graph_free(g);
+    return 0;
+}
 
-    /* Also add some cross-connections to allow multiple paths */
-    graph_add_edge(g, "anxious", "sad", 1.7f, NULL);
-    graph_add_edge(g, "sad", "calm", 2.5f, "sit with feelings and breathe");
-    graph_add_edge(g, "hopeful", "happy", 1.0f, NULL);
+int bench_sssp_main(int argc, char **argv) {
+    SynthParams sp = { 1000000, 4.0f, DEG_UNIFORM, 0.5f, 0.5f, 42 };
+    int threads[16] = {1, 8, 16, 32, 64}; int nthreads = 5;
+    int sources = 3; float delta = 0.0f;
+    for (int i=0;i<argc;++i) {
+        const char *a = argv[i]; const char *v = (i+1 < argc) ? argv[i+1] : NULL;
+        if (!v) { sssp_usage(); return 2; }
+        if (strcmp(a, "--nodes") == 0) sp.nodes = atoi(v);
+        else if (strcmp(a, "--degree") == 0) { if (!parse_degree_model(v, &sp.degree)) { sssp_usage(); return 2; } }
+        else if (strcmp(a, "--avg-degree") == 0) sp.avg_degree = (float)atof(v);
+        else if (strcmp(a, "--threads") == 0) { nthreads = parse_thread_list(v, threads, 16); if (!nthreads) { sssp_usage(); return 2; } }
+        else if (strcmp(a, "--delta") == 0) delta = (float)atof(v);
+        else if (strcmp(a, "--sources") == 0) sources = atoi(v);
+        else if (strcmp(a, "--seed") == 0) sp.seed = strtoull(v, NULL, 10);
+        else { sssp_usage(); return 2; }
+        ++i;
+    }
+    if (sp.nodes < SYNTH_ANCHORS) sp.nodes = SYNTH_ANCHORS;
+    if (sources < 1) sources = 1;
+    EmotionGraph *g = synth_graph_build(&sp);
+    const RouteCSR *c = route_csr_get(g);
+    if (delta <= 0.0f) delta = delta_default_width(c);
+    float *dist = realloc_or_die(NULL, 0, (size_t)c->n, sizeof(float), MEM_ROUTING);
+    int *src = realloc_or_die(NULL, 0, (size_t)sources, sizeof(int), MEM_ROUTING);
+    Rng r = { sp.seed };
+    for (int s=0;s<sources;++s) src[s] = rng_below(&r, c->n);
+
+    printf("# full SSSP: nodes=%d arcs=%ld degree=%s delta=%.3f sources=%d cpus=%ld\n",
+           c->n, c->m, degree_model_name(sp.degree), delta, sources, online_cpus());
+    printf("%-10s %8s %12s %9s %16s\n", "engine", "threads", "ms/source", "speedup", "checksum");
+    double base_sum = 0.0;
+    uint64_t t0 = now_ns();
+    for (int s=0;s<sources;++s) {
+        sssp_heap_full(c, src[s], dist, NULL, NULL);
+        base_sum += sssp_checksum(dist, c->n, NULL);
+    }
+    double base_ms = (double)(now_ns() - t0) / 1e6 / sources;
+    printf("%-10s %8d %12.2f %9.2f %16.4f\n", "dijkstra", 1, base_ms, 1.0, base_sum);
+    for (int ti=0; ti<nthreads; ++ti) {
+        double sum = 0.0;
+        t0 = now_ns();
+        for (int s=0;s<sources;++s) {
+            sssp_delta_stepping(c, src[s], -1, threads[ti], delta, dist, NULL);
+            sum += sssp_checksum(dist, c->n, NULL);
+        }
+        double ms = (double)(now_ns() - t0) / 1e6 / sources;
+        printf("%-10s %8d %12.2f %9.2f %16.4f%s\n", "delta", threads[ti], ms, base_ms / ms, sum,
+               fabs(sum - base_sum) > 1e-6 * (fabs(base_sum) + 1.0) ? "  MISMATCH" : "");
+    }
+    free_array(src, sources, sizeof(int), MEM_ROUTING);
+    free_array(dist, c->n, sizeof(float), MEM_ROUTING);
+    graph_free(g);
+    return 0;
 }
 
-/* ---------- Menu and flow ---------- */
+/* ---------- Differential routing self-test ----------
+   emo_tool selftest [--graphs N] [--queries Q] [--max-nodes M] [--seed S]
+   Builds random maps through the public graph API (so the forbidden-transition rule is
+   exercised), edits them between queries (so cached snapshots must be invalidated, or
+   patched for learned weights) and
+   checks every engine against run_dijkstra_personalized:
+    - reachability and cost agree (relative tolerance ROUTE_COST_TOL; tied routes may
+      differ and float sums can round differently). Quantized engines may also lose up
+      to half a fixed-point unit per step of either route.
+    - the path starts at src, ends at dest and every step is an existing arc
+    - re-summing the path's personalized weights gives the reported cost
+    - no step is a forbidden overwhelmed -> positive transition
+   Exits non-zero and prints the failing case on the first mismatch.
+*/
 
-void print_welcome() {
-    printf("Welcome to the Emotion Path Helper - a calm, friendly assistant.\n");
-    printf("This tool helps suggest a simple, step-by-step plan from how you feel now\n");
-    printf("toward a more positive state. Your tips and actions are saved between runs.\n");
-    printf("Data file: %s\n\n", SAVE_FILE);
-    show_simple_explanation();
+#define ROUTE_COST_TOL 1e-4f
+
+static int route_costs_match_within(float a, float b, float extra) {
+    if (a == FLT_MAX || b == FLT_MAX) return a == b;
+    float scale = fabsf(a) > 1.0f ? fabsf(a) : 1.0f;
+    return fabsf(a - b) <= ROUTE_COST_TOL * scale + extra;
 }
+static int route_costs_match(float a, float b) { return route_costs_match_within(a, b, 0.0f); }
 
-void interactive_menu(EmotionGraph *g) {
-    seed_defaults_if_empty(g);
-    int running = 1;
-    char buf[512];
+/* Returns NULL when the path is a valid src..dest route costing 'cost', else a reason. */
+static const char *route_check_path(EmotionGraph *g, int src, int dest, const int *path, int len, float cost) {
+    if (len < 1 || path[0] != src || path[len-1] != dest) return "path endpoints";
+    float sum = 0.0f;
+    for (int i=0;i+1<len;++i) {
+        int u = path[i], v = path[i+1];
+        if (is_forbidden_transition(g, u, v)) return "forbidden transition in path";
+        float best = FLT_MAX;
+        for (int e=0;e<g->nodes[u].edges_count;++e)
+            if (g->nodes[u].edges[e].to == v) { float w = personalized_weight(g, &g->nodes[u].edges[e]); if (w < best) best = w; }
+        if (best == FLT_MAX) return "step without an arc";
+        sum += best;
+    }
+    if (!route_costs_match(sum, cost)) return "path cost differs from reported cost";
+    return NULL;
+}
+
+static EmotionGraph *selftest_random_graph(Rng *r, int max_nodes) {
+    static const char *pool[] = {"overwhelmed","grounded","happy","calm","hopeful","peaceful","anxious","sad"};
+    EmotionGraph *g = graph_new();
+    int n = 2 + rng_below(r, max_nodes - 1);
+    char name[MAX_NAME_LEN];
+    for (int i=0;i<n;++i) {
+        if (i < 8) snprintf(name, sizeof(name), "%s", pool[i]);
+        else snprintf(name, sizeof(name), "emo%d", i);
+        graph_add_node(g, name, rng_unit(r) * 2.0f - 1.0f, 5.0f);
+    }
+    int edges = rng_below(r, 3 * n + 1);
+    for (int k=0;k<edges;++k) {
+        int u = rng_below(r, n), v = rng_below(r, n);
+        /* integer difficulties as typed in option 5, and the 0.1-step defaults */
+        float w = rng_below(r, 2) ? (float)rng_below(r, 21) : (float)rng_below(r, 40) / 10.0f;
+        graph_add_edge(g, g->nodes[u].name, g->nodes[v].name, w, rng_below(r, 2) ? "act" : NULL);
+    }
+    for (int i=0;i<n;++i) if (rng_below(r, 3) == 0) graph_add_tip_idx(g, i, "tip");
+    /* extra rules added after the edges exist: routing must skip the arcs they rule out */
+    if (rng_below(r, 3) == 0) {
+        int a = rules_class_add(g, "rand_from"), b = rules_class_add(g, "rand_to");
+        for (int i=0;i<n;++i) {
+            if (rng_below(r, 4) == 0) rules_add_member(g, a, g->nodes[i].name);
+            if (rng_below(r, 4) == 0) rules_add_member(g, b, g->nodes[i].name);
+        }
+        rules_add_rule(g, a, b);
+    }
+    return g;
+}
+
+/* Feedback events against one emotion's tips: after each, the incrementally kept top
+   list must equal the best TIP_TOP_K of a full ranking. Returns NULL or what went wrong. */
+static const char *selftest_tip_ranking(Rng *r, int events, long *checks) {
+    EmotionGraph *g = graph_new();
+    int idx = graph_add_node(g, "calm", 0.5f, 5.0f);
+    char text[32];
+    const char *why = NULL;
+    for (int ev=0; ev<events && !why; ++ev) {
+        EmotionNode *n = &g->nodes[idx];
+        if (n->tips_count < 2 || rng_below(r, 10) == 0) {
+            snprintf(text, sizeof(text), "tip %d", n->tips_count);
+            graph_add_tip_idx(g, idx, text);
+        } else tip_record(n, rng_below(r, n->tips_count), rng_below(r, 3) == 0);
+        n = &g->nodes[idx];
+        int want[TIP_TOP_K], nw = 0;
+        for (int k=0;k<TIP_TOP_K && k<n->tips_count;++k) {
+            int best = -1;
+            for (int t=0;t<n->tips_count;++t) {
+                int taken = 0;
+                for (int j=0;j<nw;++j) taken |= want[j] == t;
+                if (!taken && (best < 0 || tip_better(n, t, best))) best = t;
+            }
+            want[nw++] = best;
+        }
+        if (n->tip_top_count != nw) why = "top tip count differs from full ranking";
+        for (int k=0; !why && k<nw; ++k) if (n->tip_top[k] != want[k]) why = "top tips differ from full ranking";
+        ++*checks;
+    }
+    graph_free(g);
+    return why;
+}
 
-    Prototype protos[] = {
-        {"anxious", 7, 6, 2, 3},
-        {"sad", 3, 3, 1, 8},
-        {"angry", 4, 2, 8, 2},
-        {"overwhelmed", 8, 9, 3, 6},
-        {"lonely", 2, 3, 1, 6},
-        {"calm", 1, 1, 0, 0},
-        {"hopeful", 1, 1, 0, 1},
-        {"happy", 0, 0, 0, 0}
+/* Free-text detection: negations must cancel through intensifiers and filler words, but
+   not across a clause. want NULL means nothing may be detected. */
+static const char *selftest_detect(long *checks) {
+    static const struct { const char *text, *want; float score; } cases[] = {
+        {"not sad", NULL, 0.0f},
+        {"I don't feel very sad", NULL, 0.0f},
+        {"I have never felt so down", NULL, 0.0f},
+        {"I am not at all stressed out", NULL, 0.0f},
+        {"I am not sad, just a bit tired", NULL, 0.0f},
+        {"I feel so sad", "sad", 1.5f},
+        {"I'm not sure, but I feel sad", "sad", 1.0f},
+        {"Not tired. Sad though.", "sad", 1.0f},
+        {"I am stressed out", "overwhelmed", 1.0f},
+        {"totally swamped", "overwhelmed", 1.5f},
     };
-    int proto_count = sizeof(protos)/sizeof(protos[0]);
+    EmotionGraph *g = graph_new();
+    graph_add_node(g, "sad", -0.6f, 5.0f);
+    graph_add_node(g, "overwhelmed", -0.9f, 8.0f);
+    keywords_add(g, "down", "sad", 1.0f);
+    keywords_add(g, "stressed out", "overwhelmed", 1.0f);
+    keywords_add(g, "swamped", "overwhelmed", 1.0f);
+    const char *why = NULL;
+    for (size_t i=0; i<sizeof(cases)/sizeof(cases[0]) && !why; ++i) {
+        DetectHit hits[2];
+        int nh = detect_emotions(g, cases[i].text, hits, 2);
+        if (!cases[i].want) { if (nh != 0) why = "detected an emotion the text negates"; }
+        else if (nh != 1 || strcmp(g->nodes[hits[0].node].name, cases[i].want) != 0) why = "missed the emotion the text names";
+        else if (fabsf(hits[0].score - cases[i].score) > 1e-6f) why = "wrong detection score";
+        if (why) printf("  text: \"%s\"\n", cases[i].text);
+        ++*checks;
+    }
+    graph_free(g);
+    return why;
+}
 
-    while (running) {
-        printf("\n--- Menu ---\n");
-        printf("  1) Multi-question check-in (recommended)\n");
-        printf("  2) Quick: enter your emotion by name\n");
-        printf("  3) List emotions & tips\n");
-        printf("  4) Add a personal tip to an emotion\n");
-        printf("  5) Add/Edit action for a transition\n");
-        printf("  6) Save now\n");
-        printf("  7) Reload saved data (discard unsaved changes)\n");
-        printf("  8) Show ASCII graph view\n");
-        printf("  0) Exit (auto-saves)\n");
-        int choice = read_int_in_range("Choose option", 0, 8);
+/* Real tip edits that must merge, and different tips that share most of their words. */
+static const char *selftest_tip_variants[][2] = {
+    {"Step away for 2 minutes and stretch.", "Step away for 3 minutes and stretch."},
+    {"Name 5 things you can see right now.", "Name 5 things you can see now."},
+    {"5 slow breaths (inhale 4s, hold 2s, exhale 6s).", "5 slow breaths (inhale 4 s, hold 2 s, exhale 6 s)."},
+    {"5 slow breaths (inhale 4s, hold 2s, exhale 6s).", "Five slow breaths (inhale 4s, hold 2s, exhale 6s)"},
+    {"Count backwards from 20 slowly.", "Count backwards slowly from 20."},
+    {"Listen to a favorite 3-minute song.", "Listen to your favorite 3 minute song."},
+    {"Take a 60-second walk or do physical movement.", "Take a 60 second walk or do some physical movement."},
+    {"Write 3 small things that went okay today.", "Write down 3 small things that went okay today."},
+    {"Try a 2-minute body scan relaxation.", "Try a 5-minute body scan relaxation."},
+    {"Put your phone away and take 3 big slow breaths.", "Put your phone away and take three big slow breaths."},
+    {"Place an object in your hand and describe it slowly.", "Place an object in your hand and describe it."},
+    {"Celebrate: do one small reward for yourself.", "Celebrate - do one small reward for yourself!"},
+    {"Try a brief message to a friend or online community.", "Send a brief message to a friend or online community."},
+    {"List one small goal for the next 24 hours.", "List one small goal for the next 24h."},
+};
+static const char *selftest_tip_distinct[][2] = {
+    {"Name 5 things you can see right now.", "Name 3 things you can hear right now."},
+    {"Take 3 slow breaths.", "Take a 3-minute walk outside."},
+    {"Put your phone away and take 3 big slow breaths.", "5 slow breaths (inhale 4s, hold 2s, exhale 6s)."},
+    {"Step away for 2 minutes and stretch.", "Stretch your arms and shoulders for 2 minutes."},
+    {"Write 3 small things that went okay today.", "Write one thing you are grateful for today."},
+    {"Count backwards from 20 slowly.", "Count to 10 slowly before you answer."},
+    {"Step away for 2 minutes and stretch.", "Step outside and feel the air for a minute."},
+    {"Play one song you love and sing along.", "Listen to a favorite 3-minute song."},
+};
 
-        if (choice == 0) { running = 0; }
-        else if (choice == 1 || choice == 2) {
-            int src_idx = -1;
-            if (choice == 1) {
-                printf("\nCheck-in: please rate the following 0 (none) to 10 (very high).\n");
-                int stress = read_int_in_range("Stress", 0, 10);
-                int overwhelm = read_int_in_range("Overwhelm", 0, 10);
-                int anger = read_int_in_range("Anger", 0, 10);
-                int sadness = read_int_in_range("Sadness", 0, 10);
-                int pidx = choose_closest_prototype((float)stress, (float)overwhelm, (float)anger, (float)sadness, protos, proto_count);
-                const char *inferred = protos[pidx].name;
-                printf("We think you may be feeling: %s\n", inferred);
-                if (graph_find(g, inferred) == -1) graph_add_node(g, inferred, -0.2f, (stress+overwhelm)/2.0f);
-                src_idx = graph_find(g, inferred);
-            } else {
-                printf("Enter your current emotion (e.g., anxious): ");
-                char emo[MAX_NAME_LEN]; read_line_trim(emo, sizeof(emo));
-                if (strlen(emo) == 0) { printf("No emotion entered.\n"); continue; }
-                if (graph_find(g, emo) == -1) graph_add_node(g, emo, -0.2f, 5.0f);
-                src_idx = graph_find(g, emo);
-            }
+/* Each pair gets its own emotion: the first tip is added, the second must (or must not)
+   be found near it; then both are added with feedback and tips_dedup must merge exactly
+   the variants, summing tried/helped and keeping the later day. */
+static const char *selftest_tip_dedup(long *checks) {
+    int nv = (int)(sizeof(selftest_tip_variants) / sizeof(selftest_tip_variants[0]));
+    int nd = (int)(sizeof(selftest_tip_distinct) / sizeof(selftest_tip_distinct[0]));
+    EmotionGraph *g = graph_new();
+    char name[MAX_NAME_LEN];
+    const char *why = NULL;
+    for (int i=0; i<nv+nd && !why; ++i) {
+        const char *const *pair = i < nv ? selftest_tip_variants[i] : selftest_tip_distinct[i - nv];
+        snprintf(name, sizeof(name), "pair%d", i);
+        int idx = graph_add_node(g, name, 0.0f, 5.0f);
+        graph_add_tip_idx(g, idx, pair[0]);
+        int near = tip_find_near(&g->nodes[idx], pair[1]);
+        if (i < nv && near != 0) why = "tip_find_near misses a variant";
+        else if (i >= nv && near != -1) why = "tip_find_near matches a different tip";
+        graph_add_tip_idx(g, idx, pair[1]);
+        EmotionNode *n = &g->nodes[idx];
+        n->tips[0].tried = 2; n->tips[0].helped = 1; n->tips[0].day = 100;
+        n->tips[1].tried = 3; n->tips[1].helped = 2; n->tips[1].day = 105;
+        tip_rerank(n, 0); tip_rerank(n, 1);
+        ++*checks;
+    }
+    long removed = why ? 0 : tips_dedup(g);
+    if (!why && removed != nv) why = "tips_dedup removed the wrong number of tips";
+    for (int i=0; i<nv+nd && !why; ++i) {
+        const EmotionNode *n = &g->nodes[i];
+        if (i >= nv) { if (n->tips_count != 2) why = "tips_dedup merged different tips"; continue; }
+        const Tip *t = &n->tips[0];
+        if (n->tips_count != 1 || strcmp(t->text, selftest_tip_variants[i][0]) != 0) why = "tips_dedup kept the wrong copy";
+        else if (t->tried != 5 || t->helped != 3 || t->day != 105) why = "tips_dedup lost the merged feedback";
+        else if (n->tip_top_count != 1 || n->tip_top[0] != 0 || t->rank != tip_rank(t)) why = "tips_dedup left a stale top list";
+        ++*checks;
+    }
+    graph_free(g);
+    return why;
+}
 
-            /* goals */
-            const char *goals[] = {"happy","calm","peaceful","hopeful"};
-            int gcount = 4, goal_idx[4];
-            for (int i=0;i<gcount;++i) {
-                goal_idx[i] = graph_find(g, goals[i]);
-                if (goal_idx[i] == -1) { graph_add_node(g, goals[i], 0.9f, 2.0f); goal_idx[i] = graph_find(g, goals[i]); }
-            }
+static void selftest_usage(void) {
+    fprintf(stderr, "usage: emo_tool selftest [--graphs 500] [--queries 20] [--max-nodes 80] [--seed 1] [--threads T]\n");
+}
 
-            float best_cost = FLT_MAX; int best_goal=-1; int best_len=0; int best_path[128];
-            int tmp_path[128], tmp_len;
-            for (int i=0;i<gcount;++i) {
-                float cost = run_dijkstra_personalized(g, src_idx, goal_idx[i], tmp_path, &tmp_len);
-                if (cost < best_cost) { best_cost = cost; best_goal = goal_idx[i]; best_len = tmp_len; memcpy(best_path, tmp_path, sizeof(int)*tmp_len); }
+/* Dense layered DP: cheapest src -> dest cost with at most max_steps transitions. */
+static float selftest_hop_reference(EmotionGraph *g, int src, int dest, int max_steps) {
+    int n = g->count;
+    float *d = malloc(sizeof(float) * (size_t)n), *nd = malloc(sizeof(float) * (size_t)n);
+    if (!d || !nd) { perror("malloc"); exit(1); }
+    for (int i=0;i<n;++i) d[i] = FLT_MAX;
+    d[src] = 0.0f;
+    for (int h=0;h<max_steps;++h) {
+        memcpy(nd, d, sizeof(float) * (size_t)n);
+        for (int u=0;u<n;++u) {
+            if (d[u] == FLT_MAX) continue;
+            for (int e=0;e<g->nodes[u].edges_count;++e) {
+                Edge *ed = &g->nodes[u].edges[e];
+                if (is_forbidden_transition(g, u, ed->to)) continue;
+                float c = d[u] + personalized_weight(g, ed);
+                if (c < nd[ed->to]) nd[ed->to] = c;
             }
+        }
+        float *t = d; d = nd; nd = t;
+    }
+    float r = d[dest];
+    free(d); free(nd);
+    return r;
+}
 
-            if (best_cost == FLT_MAX) {
-                printf("\nSorry - no available path to a positive state. Try adding tips or transitions in the menu.\n");
-            } else {
-                printf("\nHere is a simple step-by-step plan:\n");
-                for (int i=0;i<best_len;i++) {
-                    int idx = best_path[i];
-                    printf(" Step %d: %s\n", i+1, g->nodes[idx].name);
-                    if (g->nodes[idx].tips_count > 0) {
-                        printf("   Tips:\n");
-                        for (int t=0;t<g->nodes[idx].tips_count;++t) printf("     - %s\n", g->nodes[idx].tips[t].text);
-                    }
-                    if (i < best_len-1) {
-                        /* find procedure */
-                        EmotionNode *cur = &g->nodes[idx];
-                        char *proc = NULL;
-                        for (int e=0;e<cur->edges_count;++e) if (cur->edges[e].to == best_path[i+1]) { proc = cur->edges[e].procedure; break; }
-                        if (proc) printf("   Action: %s\n", proc);
-                        else printf("   Action: (none - you can add one in menu option 5)\n");
-                    } else {
-                        printf("   Goal reached: %s - well done for taking steps.\n", g->nodes[idx].name);
+int selftest_main(int argc, char **argv) {
+    int graphs = 500, queries = 20, max_nodes = 80; uint64_t seed = 1;
+    for (int i=0;i<argc;++i) {
+        const char *a = argv[i]; const char *v = (i+1 < argc) ? argv[i+1] : NULL;
+        if (!v) { selftest_usage(); return 2; }
+        if (strcmp(a, "--graphs") == 0) graphs = atoi(v);
+        else if (strcmp(a, "--queries") == 0) queries = atoi(v);
+        else if (strcmp(a, "--max-nodes") == 0) max_nodes = atoi(v);
+        else if (strcmp(a, "--seed") == 0) seed = strtoull(v, NULL, 10);
+        else if (strcmp(a, "--threads") == 0) delta_thread_count = atoi(v);
+        else { selftest_usage(); return 2; }
+        ++i;
+    }
+    if (max_nodes < 2) max_nodes = 2;
+    Rng r = { seed };
+    long checks = 0;
+    const char *unit_why = selftest_tip_ranking(&r, 400, &checks);
+    if (unit_why) { printf("FAIL tip ranking: %s\n", unit_why); return 1; }
+    if ((unit_why = selftest_tip_dedup(&checks)) != NULL) { printf("FAIL tip dedup: %s\n", unit_why); return 1; }
+    if ((unit_why = selftest_detect(&checks)) != NULL) { printf("FAIL detection: %s\n", unit_why); return 1; }
+    for (int gi=0; gi<graphs; ++gi) {
+        EmotionGraph *g = selftest_random_graph(&r, max_nodes);
+        int *ref_path = malloc(sizeof(int) * (size_t)g->count);
+        int *path = malloc(sizeof(int) * (size_t)g->count);
+        if (!ref_path || !path) { perror("malloc"); exit(1); }
+        for (int q=0;q<queries;++q) {
+            /* edit the map between queries so cached engine state must follow it */
+            if (rng_below(&r, 5) == 0) {
+                int u = rng_below(&r, g->count), v = rng_below(&r, g->count), kind = rng_below(&r, 3);
+                if (kind == 0) graph_add_edge(g, g->nodes[u].name, g->nodes[v].name, (float)rng_below(&r, 21), NULL);
+                else if (kind == 1) graph_add_tip_idx(g, u, "tip");
+                else if (g->nodes[u].edges_count)   /* patches the snapshot and table in place */
+                    graph_learn_step(g, u, g->nodes[u].edges[rng_below(&r, g->nodes[u].edges_count)].to, rng_below(&r, 2));
+            }
+            int src = rng_below(&r, g->count), dest = rng_below(&r, g->count), ref_len = 0;
+            float ref = run_dijkstra_personalized(g, src, dest, ref_path, &ref_len);
+            const char *why = (ref == FLT_MAX) ? NULL : route_check_path(g, src, dest, ref_path, ref_len, ref);
+            const char *who = "reference";
+            for (int ei=0; !why && ei<ROUTE_ENGINE_COUNT; ++ei) {
+                int len = 0;
+                float c = route_engines[ei].fn(g, src, dest, path, &len);
+                who = route_engines[ei].name;
+                float extra = route_engines[ei].quantized ? 0.5f * (float)(ref_len + len) / ROUTE_FIXED_SCALE : 0.0f;
+                if (!route_costs_match_within(ref, c, extra)) why = "cost differs from reference";
+                else if (c != FLT_MAX) why = route_check_path(g, src, dest, path, len, c);
+                ++checks;
+            }
+            if (!why) {
+                /* multi-goal planning equals the best single-goal reference */
+                int goals[3], ng = 1 + rng_below(&r, 3), len = 0, got_goal = -1;
+                float want = FLT_MAX;
+                for (int i=0;i<ng;++i) {
+                    goals[i] = rng_below(&r, g->count);
+                    float c = run_dijkstra_personalized(g, src, goals[i], ref_path, &ref_len);
+                    if (c < want) want = c;
+                }
+                float c = plan_best_goal(g, src, goals, ng, path, &len, &got_goal);
+                who = "multi-goal";
+                float extra = ng == 1 ? (float)len / ROUTE_FIXED_SCALE : 0.0f;   /* one goal uses the (quantized) active engine */
+                if (!route_costs_match_within(want, c, extra)) why = "cost differs from best single-goal reference";
+                else if (c != FLT_MAX) why = route_check_path(g, src, got_goal, path, len, c);
+                ++checks;
+            }
+            if (!why) {
+                /* front: cheapest plan matches the reference, fewest steps matches a hop
+                   search, every plan is a real route, and no plan beats another */
+                ParetoPlan plans[PARETO_MAX_PLANS];
+                int np = plan_pareto(g, src, &dest, 1, 0, plans, PARETO_MAX_PLANS);
+                int min_steps = -1;
+                if (np > 0) for (int h=1; h<g->count && min_steps < 0; ++h) {
+                    int len = 0;
+                    if (plan_hop_limited(g, src, &dest, 1, h, path, &len, NULL) != FLT_MAX) min_steps = h;
+                }
+                if (src == dest && np > 0) min_steps = 0;
+                who = "pareto";
+                if ((np == 0) != (ref == FLT_MAX)) why = "front empty but a route exists (or the reverse)";
+                else if (np > 0 && !route_costs_match(ref, plans[0].cost)) why = "cheapest plan differs from reference";
+                for (int i=0; !why && i<np; ++i) {
+                    int len = pareto_plan_path(&plans[i], path), unguided = 0;
+                    why = route_check_path(g, src, dest, path, len, plans[i].cost);
+                    for (int k=0; !why && k+1<len; ++k) {
+                        Edge *e = graph_find_arc(g, path[k], path[k+1]);
+                        if (e && !e->procedure) ++unguided;
                     }
+                    if (!why && unguided != plans[i].unguided) why = "unguided step count wrong";
+                    for (int j=0; !why && j<np; ++j)
+                        if (j != i && pareto_dominates(plans[j].cost, plans[j].steps, plans[j].unguided, plans[i].cost, plans[i].steps, plans[i].unguided))
+                            why = "front holds a dominated plan";
                 }
+                if (!why && np > 0 && np < PARETO_MAX_PLANS) {
+                    int fewest = plans[0].steps;
+                    for (int i=1;i<np;++i) if (plans[i].steps < fewest) fewest = plans[i].steps;
+                    if (fewest != min_steps) why = "front misses the fewest-step plan";
+                }
+                ++checks;
             }
-        } else if (choice == 3) {
-            printf("\n");
-            graph_print_friendly(g);
-        } else if (choice == 4) {
-            printf("\nAdd a personal tip.\nEmotion name: ");
-            char emo[MAX_NAME_LEN]; read_line_trim(emo, sizeof(emo));
-            if (strlen(emo)==0) { printf("No emotion entered.\n"); continue; }
-            printf("Enter your tip (short): ");
-            char tip_buf[512]; read_line_trim(tip_buf, sizeof(tip_buf));
-            if (strlen(tip_buf)==0) { printf("No tip entered.\n"); continue; }
-            graph_add_tip(g, emo, tip_buf);
-            printf("Tip added to %s.\n", emo);
-        } else if (choice == 5) {
-            printf("\nAdd/Edit an action for a transition.\nFrom: "); char from[MAX_NAME_LEN]; read_line_trim(from, sizeof(from));
-            printf("To: "); char to[MAX_NAME_LEN]; read_line_trim(to, sizeof(to));
-            if (strlen(from)==0 || strlen(to)==0) { printf("Invalid names.\n"); continue; }
-            /* blocked direct edges check: if from==\"overwhelmed\" and to positive, explain and offer to link via grounded */
-            if (strcmp(from, "overwhelmed")==0 && is_positive_goal_name(to)) {
-                printf("Direct transitions from 'overwhelmed' to positive states are blocked for safety.\n");
-                printf("Would you like to create/inspect the path: overwhelmed -> grounded -> %s ? (y/n): ", to);
-                char yn[8]; read_line_trim(yn, sizeof(yn));
-                if (yn[0]=='y' || yn[0]=='Y') {
-                    /* ensure edges exist */
-                    graph_add_edge(g, "overwhelmed", "grounded", 1.0f, "5 grounding breaths & plant feet");
-                    graph_add_edge(g, "grounded", to, 1.5f, NULL);
-                    printf("Linked overwhelmed -> grounded -> %s. You can add actions on these transitions now.\n", to);
-                } else { printf("No direct change made.\n"); }
-                continue;
+            if (!why) {
+                int hops = 1 + rng_below(&r, 6), len = 0;
+                float want = selftest_hop_reference(g, src, dest, hops);
+                float c = plan_hop_limited(g, src, &dest, 1, hops, path, &len, NULL);
+                who = "hop-limited";
+                if (!route_costs_match(want, c)) why = "cost differs from layered reference";
+                else if (c != FLT_MAX && len > hops + 1) why = "more steps than the limit";
+                else if (c != FLT_MAX) why = route_check_path(g, src, dest, path, len, c);
+                ++checks;
             }
-            int u = graph_find(g, from); if (u==-1) u = graph_add_node(g, from, -0.2f, 5.0f);
-            int v = graph_find(g, to); if (v==-1) v = graph_add_node(g, to, -0.2f, 5.0f);
-            /* find existing edge u->v */
-            EmotionNode *nu = &g->nodes[u];
-            int found = -1;
-            for (int e=0;e<nu->edges_count;++e) if (nu->edges[e].to == v) { found = e; break; }
-            if (found == -1) {
-                int w = read_int_in_range("Enter transition difficulty (0 = easy, bigger = harder)", 0, 20);
-                printf("Enter action/procedure for this transition (blank for none):\n");
-                char proc_buf[512]; read_line_trim(proc_buf, sizeof(proc_buf));
-                graph_add_edge(g, from, to, (float)w, (strlen(proc_buf)>0)?proc_buf:NULL);
-                printf("Edge created.\n");
-            } else {
-                printf("Existing transition found. Enter new action (blank to remove):\n");
-                char proc_buf[512]; read_line_trim(proc_buf, sizeof(proc_buf));
-                if (nu->edges[found].procedure) { free(nu->edges[found].procedure); nu->edges[found].procedure = NULL; }
-                if (strlen(proc_buf) > 0) nu->edges[found].procedure = strdup_s(proc_buf);
-                printf("Action updated.\n");
+            if (why) {
+                printf("FAIL graph %d (%d nodes) %s -> %s, engine %s: %s\n",
+                       gi, g->count, g->nodes[src].name, g->nodes[dest].name, who, why);
+                free(ref_path); free(path); graph_free(g);
+                return 1;
             }
-        } else if (choice == 6) {
-            if (save_graph(g, SAVE_FILE)) printf("Saved to %s.\n", SAVE_FILE);
-            else printf("Save failed.\n");
-        } else if (choice == 7) {
-            printf("Reload from %s (discard unsaved changes)? (y/n): ", SAVE_FILE);
-            char a[8]; read_line_trim(a, sizeof(a));
-            if (a[0]=='y' || a[0]=='Y') {
-                /* free current graph, reinit */
-                for (int i=0;i<g->count;++i) {
-                    EmotionNode *n = &g->nodes[i];
-                    for (int e=0;e<n->edges_count;++e) if (n->edges[e].procedure) free(n->edges[e].procedure);
-                    for (int t=0;t<n->tips_count;++t) if (n->tips[t].text) free(n->tips[t].text);
-                    free(n->edges); free(n->tips);
-                }
-                free(g->nodes); g->nodes = NULL; g->count = 0; g->cap = 0;
-                if (load_graph(g, SAVE_FILE)) printf("Reloaded from %s.\n", SAVE_FILE);
-                else { printf("No save found; reset to defaults.\n"); seed_defaults_if_empty(g); }
-            } else printf("Cancelled.\n");
-        } else if (choice == 8) {
-            graph_print_ascii(g);
-        } else {
-            printf("Unknown option.\n");
         }
+        free(ref_path); free(path);
+        graph_free(g);
     }
-}
-
-/* ---------- Cleanup ---------- */
-
-void graph_free(EmotionGraph *g) {
-    if (!g) return;
-    for (int i=0;i<g->count;++i) {
-        EmotionNode *n = &g->nodes[i];
-        for (int e=0;e<n->edges_count;++e) if (n->edges[e].procedure) free(n->edges[e].procedure);
-        for (int t=0;t<n->tips_count;++t) if (n->tips[t].text) free(n->tips[t].text);
-        free(n->edges); free(n->tips);
-    }
-    free(g->nodes); free(g);
+    printf("selftest ok: %d graphs, %ld engine checks, engines:", graphs, checks);
+    for (int i=0;i<ROUTE_ENGINE_COUNT;++i) printf(" %s", route_engines[i].name);
+    printf(", hop-limited and pareto planning, tip ranking and dedup, detection\n");
+    return 0;
 }
 
 /* ---------- main ---------- */
 
-int main(void) {
+int main(int argc, char **argv) {
+    if (argc > 2 && strcmp(argv[1], "--trace") == 0) {
+        trace_start(argv[2]);
+        argv[2] = argv[0]; argc -= 2; argv += 2;
+    }
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) return bench_main(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "gen") == 0) return gen_main(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "bench-io") == 0) return bench_io_main(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "bench-log") == 0) return bench_log_main(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "batch") == 0) return batch_main(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "selftest") == 0) return selftest_main(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "sssp") == 0) return sssp_main(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "bench-sssp") == 0) return bench_sssp_main(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "apsp") == 0) return apsp_main(argc - 2, argv + 2);
     EmotionGraph *g = graph_new();
     printf("Emotion Path Helper - friendly & private\n");
     if (load_graph(g, SAVE_FILE)) {